@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+/* --max-delay: Nagle with a deadline for row-at-a-time output
+ *
+ * Rows are held until the batch holds target() rows or its oldest row is max_delay old, whichever
+ * comes first. The target follows the arrival rate: a quarter of the rows that arrived in the
+ * previous max_delay window, so a steady stream fills a batch in about a quarter of the deadline and
+ * only the tail of a burst waits for it. With a handful of UEs that is fewer than 2 rows per window,
+ * and every row is written at once; a replay reaches max_rows, already within its first window once
+ * more than max_rows rows arrived in it. A zero max_delay always writes at once.
+ */
+class AdaptiveBatch {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t max_rows = 1024;
+
+private:
+    Clock::duration max_delay;
+    Clock::time_point window_start;
+    size_t window_rows = 0;
+    size_t target_rows = 1;
+    size_t pending = 0;
+    Clock::time_point oldest; // of the pending rows
+    uint64_t writes = 0;
+    uint64_t rows_written = 0;
+
+public:
+    explicit AdaptiveBatch(std::chrono::milliseconds delay) : max_delay(delay), window_start(Clock::now()) {
+    }
+
+    // A row was buffered; true when the batch should be written now
+    bool add(Clock::time_point now) {
+        if (now - window_start >= max_delay) {
+            // Longer than a window since the last one started: the window in between was empty
+            size_t last = now - window_start < 2 * max_delay ? window_rows : 0;
+            target_rows = std::clamp<size_t>(last / 4, 1, max_rows);
+            window_start = now;
+            window_rows = 0;
+        }
+        // A replay starting up: no need to wait for the window to end
+        if (++window_rows > max_rows) {
+            target_rows = std::max(target_rows, std::min(window_rows / 4, max_rows));
+        }
+        if (pending++ == 0) {
+            oldest = now;
+        }
+        return pending >= target_rows;
+    }
+
+    bool has_pending() const {
+        return pending > 0;
+    }
+
+    // When the pending rows have to be written at the latest
+    Clock::time_point deadline() const {
+        return oldest + max_delay;
+    }
+
+    // The batch was written
+    void written() {
+        if (pending > 0) {
+            writes++;
+            rows_written += pending;
+            pending = 0;
+        }
+    }
+
+    // The current batch size, in rows
+    size_t target() const {
+        return target_rows;
+    }
+
+    uint64_t write_count() const {
+        return writes;
+    }
+
+    double mean_batch() const {
+        return writes ? static_cast<double>(rows_written) / static_cast<double>(writes) : 0;
+    }
+};
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "compression.h"
+#include "endpoint.h"
+#include "output_file.h"
+#include "summary.h"
+
+
+/* gnb_aggregator: merges the --export summaries of any number of gnb_parser instances
+ *
+ * Parsers connect over Unix or TCP sockets and send one frame per export interval. Frames are
+ * merged per cell as they arrive; every --interval seconds the merged window is written as CSV,
+ * one row per cell plus a "*" row for all cells together, and the window starts over.
+ */
+
+namespace {
+    constexpr double quantiles[] = {0.5, 0.9, 0.99};
+
+    void print_usage(const char *program) {
+        std::cerr << "Usage: " << program << " --listen <endpoint> [options]\n"
+                << "  --listen <endpoint>   accept parsers on unix:/path or tcp:host:port (repeatable)\n"
+                << "  --interval <s>        seconds per report window (default 10)\n"
+                << "  --output <file>       append the reports to file instead of stdout\n"
+                << "  --compress zstd       append to <file>.zst instead, one zstd frame per second at most\n";
+    }
+
+    std::string report_header() {
+        std::string header = "time,cell,records";
+        for (size_t i = 0; i < static_cast<size_t>(Metric::Count); i++) {
+            std::string name = metric_info(static_cast<Metric>(i)).name;
+            header += "," + name + "_mean";
+            for (double q: quantiles) {
+                header += "," + name + "_p" + std::to_string(static_cast<int>(q * 100));
+            }
+        }
+        return header + ",top_dl_bytes\n";
+    }
+
+    void report_row(std::ostream &out, const char *stamp, const std::string &cell, const CellSummary &summary,
+                    bool with_top) {
+        char number[32];
+        out << stamp << ',' << cell << ',' << summary.records;
+        for (size_t i = 0; i < static_cast<size_t>(Metric::Count); i++) {
+            const MetricInfo &info = metric_info(static_cast<Metric>(i));
+            const Histogram &histogram = summary.metrics[i];
+            if (!histogram.count()) {
+                out << std::string(std::size(quantiles) + 1, ',');
+                continue;
+            }
+            std::snprintf(number, sizeof(number), "%.6g", histogram.mean());
+            out << ',' << number;
+            for (double q: quantiles) {
+                std::snprintf(number, sizeof(number), "%.6g", histogram.quantile(q, info));
+                out << ',' << number;
+            }
+        }
+        out << ',';
+        if (with_top) {
+            // "928c:344885 6542:120034", largest first
+            const char *separator = "";
+            for (auto [rnti, bytes]: summary.top_dl.top()) {
+                out << separator << rnti_str(rnti) << ':' << bytes;
+                separator = " ";
+            }
+        }
+        out << '\n';
+    }
+
+    void report(std::ostream &out, std::map<std::string, CellSummary> &window) {
+        time_t now = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+
+        CellSummary network;
+        for (const auto &[cell, summary]: window) {
+            report_row(out, stamp, cell, summary, true);
+            network.merge(summary);
+        }
+        if (!window.empty()) {
+            // RNTIs are only unique within a cell, so the network row has no top-K
+            report_row(out, stamp, "*", network, false);
+        }
+        window.clear();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> endpoints;
+    int interval = 10;
+    std::string outputFile;
+    bool compress = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--listen" && i + 1 < argc) {
+            endpoints.push_back(argv[++i]);
+        } else if (arg == "--interval" && i + 1 < argc) {
+            std::string_view text(argv[++i]);
+            auto [end, code] = std::from_chars(text.data(), text.data() + text.size(), interval);
+            if (code != std::errc() || end != text.data() + text.size() || interval < 1 || interval > 86400) {
+                std::cerr << "Invalid --interval: " << text << " (1 to 86400)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (arg == "--compress" && i + 1 < argc && std::string(argv[i + 1]) == "zstd") {
+            compress = true;
+            i++;
+        } else {
+            print_usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    if (endpoints.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (compress && (outputFile.empty() || !zstd_available())) {
+        std::cerr << (outputFile.empty() ? "--compress needs --output" : "--compress zstd: built without zstd")
+                << std::endl;
+        return 1;
+    }
+    // Declared before the file, so the file is closed before the thread writes its last frame
+    std::unique_ptr<CompressionThread> compressor;
+    if (compress) {
+        compressor = std::make_unique<CompressionThread>(3, std::chrono::milliseconds(1000));
+    }
+    OutputFile file;
+    if (!outputFile.empty() && !file.open(outputFile, OutputOptions{compressor.get()}, true)) {
+        std::cerr << "Cannot open " << outputFile << (compress ? ".zst" : "") << std::endl;
+        return 1;
+    }
+    std::ostringstream text;
+    auto emit = [&] {
+        if (outputFile.empty()) {
+            std::cout << text.str() << std::flush;
+        } else {
+            file.write(text.str());
+            file.flush();
+        }
+        text.str("");
+    };
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    itimerspec period{{interval, 0}, {interval, 0}};
+    timerfd_settime(timer_fd, 0, &period, nullptr);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    auto watch = [&](int fd) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    };
+    watch(signal_fd);
+    watch(timer_fd);
+
+    std::vector<int> listeners;
+    for (const std::string &endpoint: endpoints) {
+        std::string error;
+        int fd = listen_endpoint(endpoint, error);
+        if (fd < 0) {
+            std::cerr << "Cannot listen on " << error << std::endl;
+            return 1;
+        }
+        listeners.push_back(fd);
+        watch(fd);
+    }
+
+    text << report_header();
+    emit();
+
+    std::map<std::string, CellSummary> window;
+    std::unordered_map<int, std::string> pending; // partial frame per connection
+    bool running = true;
+    while (running) {
+        epoll_event events[64];
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == signal_fd) {
+                running = false;
+            } else if (fd == timer_fd) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    report(text, window);
+                    emit();
+                }
+            } else if (std::find(listeners.begin(), listeners.end(), fd) != listeners.end()) {
+                int connection;
+                while ((connection = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    pending[connection];
+                    watch(connection);
+                }
+            } else {
+                std::string &buffer = pending[fd];
+                char data[65536];
+                ssize_t got;
+                while ((got = read(fd, data, sizeof(data))) > 0) {
+                    buffer.append(data, got);
+                }
+                ptrdiff_t used;
+                while ((used = decode_frame(buffer.data(), buffer.size(), window)) > 0) {
+                    buffer.erase(0, used);
+                }
+                bool closed = got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR);
+                if (used < 0) {
+                    std::cerr << "Dropping a connection that sent an invalid frame" << std::endl;
+                    closed = true;
+                }
+                if (closed) {
+                    // A partial frame from a parser that went away is discarded
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    close(fd);
+                    pending.erase(fd);
+                }
+            }
+        }
+    }
+
+    report(text, window);
+    emit();
+    for (const std::string &endpoint: endpoints) {
+        unlink_endpoint(endpoint);
+    }
+}
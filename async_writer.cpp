@@ -0,0 +1,314 @@
+#include "async_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "placement.h"
+
+
+namespace {
+    // pwrite(2) all of [data, data + size); 0 or the errno
+    int write_all(int fd, const char *data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t n = pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return n < 0 ? errno : EIO;
+            }
+            data += n;
+            size -= n;
+            offset += n;
+        }
+        return 0;
+    }
+
+    template<class T>
+    T *at(void *base, uint32_t offset) {
+        return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+    }
+}
+
+AsyncWriter::~AsyncWriter() {
+    if (write_error) {
+        std::cerr << "Output (" << name() << "): " << std::strerror(write_error) << std::endl;
+    }
+}
+
+std::unique_ptr<AsyncWriter> AsyncWriter::create(bool threads_only) {
+    if (!threads_only) {
+        auto uring = std::make_unique<UringWriter>();
+        if (uring->ok()) {
+            return uring;
+        }
+    }
+    return std::make_unique<ThreadPoolWriter>();
+}
+
+std::string AsyncWriter::buffer() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (pool.empty()) {
+        return {};
+    }
+    std::string data = std::move(pool.back());
+    pool.pop_back();
+    return data;
+}
+
+void AsyncWriter::wait(int fd) {
+    std::unique_lock<std::mutex> guard(lock);
+    file_done.wait(guard, [&] { return !outstanding.contains(fd); });
+}
+
+void AsyncWriter::started(int fd) {
+    outstanding[fd]++;
+}
+
+void AsyncWriter::completed(int fd, std::string &&data, int error) {
+    if (error && !write_error) {
+        write_error = error;
+    }
+    auto it = outstanding.find(fd);
+    if (--it->second == 0) {
+        outstanding.erase(it);
+        file_done.notify_all();
+    }
+    if (pool.size() < max_pooled) {
+        data.clear();
+        pool.push_back(std::move(data));
+    }
+}
+
+UringWriter::UringWriter() : AsyncWriter("io_uring") {
+    io_uring_params params{};
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &params));
+    if (ring_fd < 0) {
+        return; // ENOSYS, or EPERM under seccomp / io_uring_disabled
+    }
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+    }
+    sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                  IORING_OFF_SQ_RING);
+    cq_map = single ? sq_map : mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ring_fd, IORING_OFF_CQ_RING);
+    sqe_map_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqe_map = mmap(nullptr, sqe_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                   IORING_OFF_SQES);
+    if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqe_map == MAP_FAILED) {
+        if (sqe_map != MAP_FAILED) {
+            munmap(sqe_map, sqe_map_size);
+        }
+        if (!single && cq_map != MAP_FAILED) {
+            munmap(cq_map, cq_map_size);
+        }
+        if (sq_map != MAP_FAILED) {
+            munmap(sq_map, sq_map_size);
+        }
+        close(ring_fd);
+        ring_fd = -1;
+        return;
+    }
+
+    sq_tail = at<unsigned>(sq_map, params.sq_off.tail);
+    sq_mask = *at<unsigned>(sq_map, params.sq_off.ring_mask);
+    // Ring position i always holds SQE i
+    auto *array = at<unsigned>(sq_map, params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+    cq_head = at<unsigned>(cq_map, params.cq_off.head);
+    cq_tail = at<unsigned>(cq_map, params.cq_off.tail);
+    cq_mask = *at<unsigned>(cq_map, params.cq_off.ring_mask);
+    cqes = at<void>(cq_map, params.cq_off.cqes);
+
+    // Never more slots than SQ entries, and the CQ has twice as many, so neither ring overflows
+    slots.resize(std::min(queue_depth, params.sq_entries));
+    for (unsigned i = 0; i < slots.size(); i++) {
+        free_slots.push_back(i);
+    }
+    completions = std::thread(&UringWriter::run, this);
+}
+
+UringWriter::~UringWriter() {
+    if (ring_fd < 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    completions.join();
+    munmap(sqe_map, sqe_map_size);
+    if (cq_map != sq_map) {
+        munmap(cq_map, cq_map_size);
+    }
+    munmap(sq_map, sq_map_size);
+    close(ring_fd);
+}
+
+void UringWriter::write(int fd, uint64_t offset, std::string &&data) {
+    std::unique_lock<std::mutex> guard(lock);
+    slot_free.wait(guard, [&] { return !free_slots.empty(); });
+    unsigned index = free_slots.back();
+    free_slots.pop_back();
+    Slot &slot = slots[index];
+    slot.fd = fd;
+    slot.offset = offset;
+    slot.data = std::move(data);
+    started(fd);
+
+    unsigned tail = *sq_tail; // only written here, under lock
+    io_uring_sqe &sqe = static_cast<io_uring_sqe *>(sqe_map)[tail & sq_mask];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITE;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(slot.data.data());
+    sqe.len = static_cast<uint32_t>(slot.data.size());
+    sqe.off = offset;
+    sqe.user_data = index;
+    std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+
+    if (++queued >= submit_batch) {
+        submit();
+    } else if (queued == 1) {
+        wake.notify_one();
+    }
+}
+
+void UringWriter::submit() {
+    while (queued > 0) {
+        long n = syscall(__NR_io_uring_enter, ring_fd, queued, 0, 0, nullptr, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The kernel took none of them: take them back out of the ring and write them here, so
+            // their rows are kept and nobody waits on a write that never completes
+            write_error = errno;
+            unsigned tail = *sq_tail - queued;
+            std::atomic_ref<unsigned>(*sq_tail).store(tail, std::memory_order_release);
+            for (; queued > 0; queued--, tail++) {
+                unsigned index = static_cast<unsigned>(
+                        static_cast<io_uring_sqe *>(sqe_map)[tail & sq_mask].user_data);
+                Slot &slot = slots[index];
+                int error = write_all(slot.fd, slot.data.data(), slot.data.size(), slot.offset);
+                completed(slot.fd, std::move(slot.data), error);
+                free_slots.push_back(index);
+            }
+            slot_free.notify_all();
+            return;
+        }
+        queued -= n;
+        in_flight += n;
+    }
+}
+
+void UringWriter::reap() {
+    unsigned head = *cq_head;
+    unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+        const io_uring_cqe &cqe = static_cast<io_uring_cqe *>(cqes)[head & cq_mask];
+        Slot &slot = slots[cqe.user_data];
+        int error = 0;
+        if (cqe.res < 0) {
+            error = -cqe.res;
+        } else if (static_cast<size_t>(cqe.res) < slot.data.size()) {
+            // Short writes are rare on regular files; finish them here
+            error = write_all(slot.fd, slot.data.data() + cqe.res, slot.data.size() - cqe.res,
+                              slot.offset + cqe.res);
+        }
+        in_flight--;
+        completed(slot.fd, std::move(slot.data), error);
+        free_slots.push_back(cqe.user_data);
+    }
+    std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+    slot_free.notify_all();
+}
+
+void UringWriter::run() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        if (in_flight == 0 && queued == 0) {
+            if (stopping) {
+                return;
+            }
+            // A writer may have submitted a full batch itself by the time this thread runs again
+            wake.wait(guard, [&] { return queued > 0 || in_flight > 0 || stopping; });
+            // Give the first write a millisecond to gather company
+            wake.wait_for(guard, std::chrono::milliseconds(1), [&] {
+                return queued >= submit_batch || in_flight > 0 || stopping;
+            });
+        }
+        submit();
+        if (in_flight == 0) {
+            continue;
+        }
+        guard.unlock();
+        long n = syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        guard.lock();
+        if (n < 0 && errno != EINTR) {
+            write_error = errno;
+        }
+        reap();
+    }
+}
+
+ThreadPoolWriter::ThreadPoolWriter() : AsyncWriter("thread pool") {
+    for (unsigned i = 0; i < thread_count; i++) {
+        threads.emplace_back(&ThreadPoolWriter::run, this);
+    }
+}
+
+ThreadPoolWriter::~ThreadPoolWriter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+void ThreadPoolWriter::write(int fd, uint64_t offset, std::string &&data) {
+    std::unique_lock<std::mutex> guard(lock);
+    space.wait(guard, [&] { return jobs.size() < queue_depth; });
+    started(fd);
+    jobs.push_back(Job{fd, offset, std::move(data)});
+    guard.unlock();
+    wake.notify_one();
+}
+
+void ThreadPoolWriter::run() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&] { return !jobs.empty() || stopping; });
+        if (jobs.empty()) {
+            return;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        space.notify_one();
+        guard.unlock();
+        int error = write_all(job.fd, job.data.data(), job.data.size(), job.offset);
+        guard.lock();
+        completed(job.fd, std::move(job.data), error);
+    }
+}
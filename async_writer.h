@@ -0,0 +1,154 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+/* --writer async / threads: the uncompressed output files are written off the parsing threads
+ *
+ * An OutputFile hands each filled buffer over as a write at an explicit file offset and carries on
+ * with a recycled buffer, so the writes of one file may complete in any order; closing a file
+ * waits for its outstanding writes. Only when queue_depth writes are outstanding does a writer
+ * block, which bounds the memory a stalled disk can take.
+ */
+class AsyncWriter {
+private:
+    static constexpr size_t max_pooled = 256;
+
+    const char *writer_name;
+    std::vector<std::string> pool; // empty buffers that keep their capacity
+    std::unordered_map<int, unsigned> outstanding; // per fd
+    std::condition_variable file_done;
+
+protected:
+    static constexpr unsigned queue_depth = 256;
+
+    std::mutex lock;
+    int write_error = 0;
+
+    // Called with lock held before a write is queued
+    void started(int fd);
+
+    // Called with lock held once a write finished; its buffer goes back to the pool
+    void completed(int fd, std::string &&data, int error);
+
+    explicit AsyncWriter(const char *name) : writer_name(name) {
+    }
+
+public:
+    virtual ~AsyncWriter();
+
+    // io_uring when the kernel allows it (unless threads_only), else a thread pool
+    static std::unique_ptr<AsyncWriter> create(bool threads_only);
+
+    const char *name() const {
+        return writer_name;
+    }
+
+    // An empty buffer to fill next
+    std::string buffer();
+
+    // Writes data at offset of fd; takes the buffer
+    virtual void write(int fd, uint64_t offset, std::string &&data) = 0;
+
+    // Returns once every write of fd completed
+    void wait(int fd);
+
+    int error() const {
+        return write_error;
+    }
+};
+
+/* io_uring, with the raw system calls (no liburing needed)
+ *
+ * The writes of all files share one submission ring. They are submitted together once
+ * submit_batch are queued, or else by the completion thread, which submits whatever is queued
+ * before it waits for completions and reaps them. A single io_uring_enter thus usually carries the
+ * rows of many per-UE files.
+ */
+class UringWriter : public AsyncWriter {
+private:
+    static constexpr unsigned submit_batch = 16;
+
+    struct Slot {
+        int fd;
+        uint64_t offset;
+        std::string data;
+    };
+
+    int ring_fd = -1;
+    void *sq_map = nullptr;
+    size_t sq_map_size = 0;
+    void *cq_map = nullptr;
+    size_t cq_map_size = 0;
+    void *sqe_map = nullptr;
+    size_t sqe_map_size = 0;
+
+    unsigned *sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    void *cqes = nullptr;
+
+    std::vector<Slot> slots;
+    std::vector<unsigned> free_slots;
+    std::condition_variable slot_free;
+    std::condition_variable wake;
+    unsigned queued = 0; // in the ring, not yet submitted
+    unsigned in_flight = 0; // submitted, not yet completed
+    bool stopping = false;
+    std::thread completions;
+
+    void submit(); // with lock held
+
+    void reap();
+
+    void run();
+
+public:
+    UringWriter();
+
+    ~UringWriter() override;
+
+    bool ok() const {
+        return ring_fd >= 0;
+    }
+
+    void write(int fd, uint64_t offset, std::string &&data) override;
+};
+
+// The fallback: a few threads pwrite(2) the buffers
+class ThreadPoolWriter : public AsyncWriter {
+private:
+    static constexpr unsigned thread_count = 2;
+
+    struct Job {
+        int fd;
+        uint64_t offset;
+        std::string data;
+    };
+
+    std::condition_variable wake;
+    std::condition_variable space;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    void run();
+
+public:
+    ThreadPoolWriter();
+
+    ~ThreadPoolWriter() override;
+
+    void write(int fd, uint64_t offset, std::string &&data) override;
+};
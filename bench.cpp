@@ -0,0 +1,170 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "huge_pages.h"
+#include "kernels.h"
+
+
+namespace {
+    constexpr int repetitions = 5;
+
+    // Same shape as a real stats block, enough UEs to give a few hundred MB/s something to chew on
+    std::vector<char> synthetic_log(size_t target_bytes) {
+        std::vector<char> log;
+        char line[256];
+        unsigned frame = 0;
+        while (log.size() < target_bytes) {
+            int n = snprintf(line, sizeof(line), "[NR_MAC]   Frame.Slot %u.0\n", frame++ % 1024);
+            log.insert(log.end(), line, line + n);
+            for (unsigned ue = 0; ue < 32; ue++) {
+                unsigned rnti = 0x4601 + ue * 0x1d3;
+                const char *lines[] = {
+                    "UE RNTI %04x CU-UE-ID %u in-sync PH 45 dB PCMAX 21 dBm, average RSRP -83 (17 meas)\n",
+                    "UE %04x: CQI 13, RI 2, PMI (0,0)\n",
+                    "UE %04x: UL-RI 1, TPMI 0\n",
+                    "UE %04x: dlsch_rounds 681/10/1/0, dlsch_errors 0, pucch0_DTX 9, BLER 0.02678 MCS (1) 22\n",
+                    "UE %04x: ulsch_rounds 1136/77/0/0, ulsch_errors 0, ulsch_DTX 0, BLER 0.07390 MCS (1) 6 "
+                    "(Qm 4 deltaMCS 0 dB) NPRB 106  SNR 17.5 dB\n",
+                    "UE %04x: MAC:    TX         344885 RX        2627890 bytes\n",
+                    "UE %04x: LCID 1: TX            369 RX           1074 bytes\n",
+                    "UE %04x: LCID 4: TX          43621 RX        2616709 bytes\n",
+                };
+                for (const char *fmt: lines) {
+                    n = snprintf(line, sizeof(line), fmt, rnti, ue + 1);
+                    log.insert(log.end(), line, line + n);
+                }
+            }
+        }
+        return log;
+    }
+
+    template<class F>
+    double best_mb_per_s(size_t bytes, F &&body) {
+        double best = 0;
+        for (int i = 0; i < repetitions; i++) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::max(best, bytes / elapsed.count() / 1e6);
+        }
+        return best;
+    }
+
+    // Keeps the optimizer from dropping the measured loops
+    volatile uint64_t sink;
+
+    void bench_kernels(const std::vector<char> &log) {
+        const char *begin = log.data();
+        const char *end = begin + log.size();
+
+        printf("%-8s %14s %14s\n", "kernels", "newline MB/s", "digits MB/s");
+        for (const Kernels *k: supported_kernels()) {
+            double newline = best_mb_per_s(log.size(), [&] {
+                const char *lines[1024];
+                uint64_t total = 0;
+                for (const char *p = begin; p < end;) {
+                    size_t count = 0;
+                    p = k->index_newlines(p, end, lines, count, 1024);
+                    total += count;
+                }
+                sink = total;
+            });
+
+            // Every token start is a candidate numeric field, the same as the field extractors see
+            double digits = best_mb_per_s(log.size(), [&] {
+                uint64_t sum = 0;
+                bool token_start = true;
+                for (const char *p = begin; p < end;) {
+                    if (token_start) {
+                        size_t len = k->digit_run(p, end);
+                        uint64_t v = 0;
+                        for (size_t i = 0; i < len; i++) {
+                            v = v * 10 + static_cast<uint64_t>(p[i] - '0');
+                        }
+                        sum += v;
+                        p += len;
+                        if (len > 0) {
+                            continue;
+                        }
+                    }
+                    token_start = *p == ' ' || *p == '\n';
+                    p++;
+                }
+                sink = sum;
+            });
+
+            printf("%-8s %14.1f %14.1f\n", k->name, newline, digits);
+        }
+    }
+
+    // The log in buffers on each kind of page: fill is the first touch (page faults included), scan
+    // the active newline kernel over memory that is already mapped (TLB misses)
+    void bench_pages(const std::vector<char> &log) {
+        printf("\n%-8s %14s %14s %10s %10s\n", "pages", "fill MB/s", "scan MB/s", "fill +/-", "scan +/-");
+        double base_fill = 0;
+        double base_scan = 0;
+        for (HugePages mode: {HugePages::Off, HugePages::Transparent, HugePages::HugeTLB}) {
+            if (PageBuffer(log.size(), mode).kind() != mode) {
+                printf("%-8s %14s\n", huge_pages_name(mode), "unavailable");
+                continue;
+            }
+            double fill = best_mb_per_s(log.size(), [&] {
+                PageBuffer buffer(log.size(), mode);
+                std::memcpy(buffer.data(), log.data(), log.size());
+                sink = static_cast<uint8_t>(buffer.data()[log.size() / 2]);
+            });
+
+            PageBuffer buffer(log.size(), mode);
+            std::memcpy(buffer.data(), log.data(), log.size());
+            const char *begin = buffer.data();
+            const char *end = begin + log.size();
+            double scan = best_mb_per_s(log.size(), [&] {
+                const char *lines[1024];
+                uint64_t total = 0;
+                for (const char *p = begin; p < end;) {
+                    size_t count = 0;
+                    p = kernels().index_newlines(p, end, lines, count, 1024);
+                    total += count;
+                }
+                sink = total;
+            });
+
+            if (mode == HugePages::Off) {
+                base_fill = fill;
+                base_scan = scan;
+                printf("%-8s %14.1f %14.1f\n", huge_pages_name(mode), fill, scan);
+            } else {
+                printf("%-8s %14.1f %14.1f %+9.1f%% %+9.1f%%\n", huge_pages_name(mode), fill, scan,
+                       (fill / base_fill - 1) * 100, (scan / base_scan - 1) * 100);
+            }
+        }
+    }
+}
+
+int run_bench(const std::string &path) {
+    std::vector<char> log;
+    if (path.empty()) {
+        log = synthetic_log(64 * 1024 * 1024);
+    } else {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open " << path << std::endl;
+            return 1;
+        }
+        log.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    printf("input: %s, %.1f MB, active kernels: %s\n\n", path.empty() ? "synthetic" : path.c_str(),
+           log.size() / 1e6, kernels().name);
+    bench_kernels(log);
+    bench_pages(log);
+    return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+
+// Runs every kernel variant the CPU supports over a log (or a synthetic one when path is empty)
+// and prints the throughput of each.
+int run_bench(const std::string &path);
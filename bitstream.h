@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// MSB-first bit packing for the series encoder
+class BitWriter {
+private:
+    std::string &out;
+    uint64_t pending = 0;
+    unsigned pending_bits = 0;
+
+public:
+    explicit BitWriter(std::string &target) : out(target) {
+    }
+
+    // Appends the low `bits` bits of value, bits <= 64
+    void put(uint64_t value, unsigned bits) {
+        while (bits > 0) {
+            unsigned take = std::min(bits, 64 - pending_bits);
+            uint64_t chunk = (bits == 64 && take == 64) ? value : (value >> (bits - take)) & ((uint64_t(1) << take) - 1);
+            pending = take == 64 ? chunk : (pending << take) | chunk;
+            pending_bits += take;
+            bits -= take;
+            while (pending_bits >= 8) {
+                out += static_cast<char>(pending >> (pending_bits - 8));
+                pending_bits -= 8;
+            }
+        }
+    }
+
+    // Pads the last byte with zero bits
+    void finish() {
+        if (pending_bits > 0) {
+            out += static_cast<char>(pending << (8 - pending_bits));
+            pending_bits = 0;
+        }
+    }
+};
+
+class BitReader {
+private:
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t pending = 0;
+    unsigned pending_bits = 0;
+    bool overrun = false;
+
+public:
+    BitReader(const char *begin, const char *stop)
+        : p(reinterpret_cast<const uint8_t *>(begin)), end(reinterpret_cast<const uint8_t *>(stop)) {
+    }
+
+    uint64_t get(unsigned bits) {
+        uint64_t value = 0;
+        while (bits > 0) {
+            if (pending_bits == 0) {
+                if (p == end) {
+                    overrun = true;
+                    return 0;
+                }
+                pending = *p++;
+                pending_bits = 8;
+            }
+            unsigned take = std::min(bits, pending_bits);
+            value = (value << take) | ((pending >> (pending_bits - take)) & ((1u << take) - 1));
+            pending_bits -= take;
+            bits -= take;
+        }
+        return value;
+    }
+
+    bool bit() {
+        return get(1);
+    }
+
+    // True once a read ran past the end of the data
+    bool failed() const {
+        return overrun;
+    }
+};
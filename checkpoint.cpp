@@ -0,0 +1,200 @@
+#include "checkpoint.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "placement.h"
+#include "ue_data.h"
+
+
+namespace {
+    constexpr uint32_t magic = 0x31504347; // "GCP1"
+    constexpr uint32_t version = 2;
+}
+
+CheckpointBuilder::CheckpointBuilder(ColumnMask columns, const std::vector<std::string> &source_names, bool clean) {
+    put_raw(bytes, magic);
+    put_raw(bytes, version);
+    put_raw(bytes, static_cast<uint32_t>(sizeof(UEData)));
+    put_raw(bytes, static_cast<uint32_t>(columns));
+    put_raw(bytes, static_cast<uint8_t>(clean));
+    put_raw(bytes, static_cast<uint16_t>(source_names.size()));
+    for (const std::string &name: source_names) {
+        put_raw(bytes, static_cast<uint16_t>(name.size()));
+        bytes += name;
+    }
+}
+
+bool LoadedCheckpoint::load(const std::string &path, ColumnMask columns, const std::vector<std::string> &source_names,
+                            std::string &error) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            error = path + ": " + std::strerror(errno);
+        }
+        return false;
+    }
+    struct stat info{};
+    fstat(fd, &info);
+    bytes.resize(info.st_size);
+    ssize_t n = read(fd, bytes.data(), bytes.size());
+    close(fd);
+    if (n != static_cast<ssize_t>(bytes.size())) {
+        error = path + ": short read";
+        return false;
+    }
+
+    const char *p = bytes.data();
+    const char *end = p + bytes.size();
+    uint32_t file_magic, file_version, record_size, mask;
+    uint8_t clean_flag;
+    uint16_t count;
+    if (!get_raw(p, end, file_magic) || file_magic != magic || !get_raw(p, end, file_version) ||
+        file_version != version || !get_raw(p, end, record_size) || record_size != sizeof(UEData)) {
+        error = path + " is not a checkpoint of this build";
+        return false;
+    }
+    if (!get_raw(p, end, mask) || !get_raw(p, end, clean_flag) || !get_raw(p, end, count)) {
+        error = path + " is truncated";
+        return false;
+    }
+    // Restored state only fits a run that parses the same columns of the same inputs
+    bool same = mask == columns && count == source_names.size();
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t size;
+        if (!get_raw(p, end, size) || static_cast<size_t>(end - p) < size) {
+            error = path + " is truncated";
+            return false;
+        }
+        same = same && i < source_names.size() && source_names[i] == std::string_view(p, size);
+        p += size;
+    }
+    if (!same) {
+        error = path + " was taken with other --columns or inputs";
+        return false;
+    }
+
+    while (p < end) {
+        uint8_t id;
+        uint32_t size;
+        if (!get_raw(p, end, id) || !get_raw(p, end, size) || static_cast<size_t>(end - p) < size) {
+            error = path + " is truncated";
+            return false;
+        }
+        sections.emplace_back(static_cast<CheckpointSection>(id), std::string_view(p, size));
+        p += size;
+    }
+    is_clean = clean_flag != 0;
+    return true;
+}
+
+std::string_view LoadedCheckpoint::section(CheckpointSection id) const {
+    for (const auto &[section_id, payload]: sections) {
+        if (section_id == id) {
+            return payload;
+        }
+    }
+    return {};
+}
+
+Checkpointer::Checkpointer(std::string checkpoint_path, std::chrono::milliseconds checkpoint_interval)
+    : path(std::move(checkpoint_path)), interval(checkpoint_interval),
+      next_due(std::chrono::steady_clock::now() + checkpoint_interval) {
+    writer = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+void Checkpointer::run() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&] {
+            return has_pending || stopping;
+        });
+        if (!has_pending) {
+            return;
+        }
+        std::string checkpoint = std::move(pending);
+        uint64_t number = submitted;
+        has_pending = false;
+        guard.unlock();
+        store(checkpoint);
+        guard.lock();
+        done = number;
+        stored.notify_all();
+    }
+}
+
+bool Checkpointer::store(const std::string &checkpoint) {
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0;
+    size_t sent = 0;
+    while (ok && sent < checkpoint.size()) {
+        ssize_t n = write(fd, checkpoint.data() + sent, checkpoint.size() - sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = n > 0;
+        sent += ok ? n : 0;
+    }
+    ok = ok && fdatasync(fd) == 0;
+    int code = errno;
+    if (fd >= 0) {
+        close(fd);
+    }
+    ok = ok && rename(temporary.c_str(), path.c_str()) == 0;
+    code = ok ? 0 : errno ? errno : code;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ok) {
+        if (!failing) {
+            std::cerr << "--checkpoint: cannot write " << path << ": " << std::strerror(code) << std::endl;
+        }
+        unlink(temporary.c_str());
+        failing = true;
+        failed++;
+        return false;
+    }
+    failing = false;
+    written++;
+    return true;
+}
+
+void Checkpointer::submit(std::string checkpoint) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending = std::move(checkpoint);
+        has_pending = true;
+        submitted++;
+    }
+    wake.notify_one();
+}
+
+void Checkpointer::write_final(const std::string &checkpoint) {
+    submit(checkpoint);
+    std::unique_lock<std::mutex> guard(lock);
+    stored.wait(guard, [&] {
+        return done == submitted;
+    });
+}
+
+void Checkpointer::print_stats() const {
+    std::cerr << "--checkpoint: " << written << " written to " << path;
+    if (failed) {
+        std::cerr << ", " << failed << " failed";
+    }
+    std::cerr << std::endl;
+}
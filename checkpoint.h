@@ -0,0 +1,146 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "columns.h"
+
+
+/* --checkpoint <file>: parser state across restarts
+ *
+ * A checkpoint is a header (u32 magic "GCP1", u32 version, u32 sizeof(UEData), u32 column mask, u8
+ * clean, u16 input count, per input u16 size and name) and sections of u8 id, u32 size and the
+ * component's own encoding, in host byte order. Parsers keep it on the same host and build. A section
+ * nobody asks for is skipped, so a checkpoint taken with --export still restores without it.
+ *
+ * Checkpoints are built on the parsing thread, which takes microseconds for the small state
+ * involved. A writer thread writes <file>.tmp, fdatasyncs it and renames it over <file>. A crash
+ * therefore leaves the previous checkpoint or the new one, never a torn file. The last checkpoint,
+ * written as the run ends, is clean: no row was written after it. Only a clean one restores the
+ * delta history, since rows written after a periodic one would be missing from it.
+ */
+enum class CheckpointSection : uint8_t {
+    Parser = 1, // partially assembled records and period counters
+    DeltaHistory = 2, // previous row per UE of --format csv-delta / binary-delta
+    Summaries = 3 // the current --export interval
+};
+
+// Fixed-size values for the section encodings
+template<class T>
+void put_raw(std::string &out, const T &value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<class T>
+bool get_raw(const char *&p, const char *end, T &value) {
+    if (static_cast<size_t>(end - p) < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+class CheckpointBuilder {
+private:
+    std::string bytes;
+
+public:
+    CheckpointBuilder(ColumnMask columns, const std::vector<std::string> &source_names, bool clean);
+
+    // The section is whatever fill appends to its string
+    template<class F>
+    void section(CheckpointSection id, F &&fill) {
+        put_raw(bytes, static_cast<uint8_t>(id));
+        size_t size_at = bytes.size();
+        put_raw(bytes, uint32_t(0));
+        fill(bytes);
+        auto size = static_cast<uint32_t>(bytes.size() - size_at - sizeof(uint32_t));
+        std::memcpy(bytes.data() + size_at, &size, sizeof(size));
+    }
+
+    std::string take() {
+        return std::move(bytes);
+    }
+};
+
+// A checkpoint read at startup
+class LoadedCheckpoint {
+private:
+    std::string bytes;
+    bool is_clean = false;
+    std::vector<std::pair<CheckpointSection, std::string_view>> sections;
+
+public:
+    // False without a usable checkpoint; error is empty when there simply is none yet
+    bool load(const std::string &path, ColumnMask columns, const std::vector<std::string> &source_names,
+              std::string &error);
+
+    bool clean() const {
+        return is_clean;
+    }
+
+    // Empty when the checkpoint has no such section
+    std::string_view section(CheckpointSection id) const;
+
+    size_t size() const {
+        return bytes.size();
+    }
+};
+
+class Checkpointer {
+private:
+    std::string path;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point next_due;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable stored;
+    std::string pending; // waiting for the writer thread
+    bool has_pending = false;
+    uint64_t submitted = 0;
+    uint64_t done = 0; // the last one submitted that was written (or failed)
+    bool stopping = false;
+    std::thread writer;
+
+    uint64_t written = 0;
+    uint64_t failed = 0;
+    bool failing = false;
+
+    void run();
+
+    // Writes, syncs and renames; errors are reported once per streak
+    bool store(const std::string &checkpoint);
+
+public:
+    Checkpointer(std::string checkpoint_path, std::chrono::milliseconds checkpoint_interval);
+
+    // Waits for the writer thread
+    ~Checkpointer();
+
+    // Time for the next periodic checkpoint; cheap enough to ask once per read
+    bool due() {
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_due) {
+            return false;
+        }
+        next_due = now + interval;
+        return true;
+    }
+
+    // Hands the checkpoint to the writer thread, replacing one it has not started on
+    void submit(std::string checkpoint);
+
+    // The last one, through the writer thread as well, written before returning
+    void write_final(const std::string &checkpoint);
+
+    void print_stats() const;
+};
@@ -0,0 +1,227 @@
+#include "columns.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+
+namespace {
+    constexpr const char *names[] = {
+        "timestamp", "rnti", "ue_id", "state", "ph", "pcmax", "rsrp", "cqi", "dl_ri", "ul_ri",
+        "dlsch_err", "pucch_dtx", "dl_bler", "dl_mcs", "ulsch_err", "ulsch_dtx",
+        "ul_bler", "ul_mcs", "nprb", "snr", "mac_tx", "mac_rx", "source"
+    };
+    static_assert(std::size(names) == static_cast<size_t>(Column::Count));
+
+    template<class T>
+    char *put(char *out, T value) {
+        return std::to_chars(out, out + 32, value).ptr;
+    }
+
+    // Same text as the default ostream << double (%g, 6 significant digits)
+    char *put(char *out, double value) {
+        return std::to_chars(out, out + 32, value, std::chars_format::general, 6).ptr;
+    }
+}
+
+const char *column_name(Column column) {
+    return names[static_cast<size_t>(column)];
+}
+
+bool parse_columns(std::string_view list, ColumnMask &mask, std::string &error) {
+    mask = 0;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view name = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        size_t i = 0;
+        while (i < std::size(names) && name != names[i]) {
+            i++;
+        }
+        if (i == std::size(names)) {
+            error = std::string(name);
+            return false;
+        }
+        mask |= column_bit(static_cast<Column>(i));
+    }
+    if (mask == 0) {
+        error = "(empty list)";
+        return false;
+    }
+    return true;
+}
+
+std::string csv_header(ColumnMask mask) {
+    std::string header;
+    for (size_t i = 0; i < std::size(names); i++) {
+        if (mask & column_bit(static_cast<Column>(i))) {
+            if (!header.empty()) {
+                header += ',';
+            }
+            header += names[i];
+        }
+    }
+    header += '\n';
+    return header;
+}
+
+ColumnType column_type(Column column) {
+    switch (column) {
+        case Column::Rsrp:
+        case Column::DlBler:
+        case Column::UlBler:
+        case Column::Snr:
+            return ColumnType::Real;
+        default:
+            return ColumnType::Integer;
+    }
+}
+
+int64_t column_integer(const UEData &data, Column column) {
+    switch (column) {
+        case Column::Timestamp: return data.timestamp;
+        case Column::Rnti: return data.rnti;
+        case Column::UeId: return data.ue_id;
+        case Column::State: return static_cast<int64_t>(data.state);
+        case Column::Ph: return data.ph;
+        case Column::Pcmax: return data.pcmax;
+        case Column::Cqi: return data.cqi;
+        case Column::DlRi: return data.dl_ri;
+        case Column::UlRi: return data.ul_ri;
+        case Column::DlschErr: return data.dlsch_err;
+        case Column::PucchDtx: return data.pucch_dtx;
+        case Column::DlMcs: return data.dl_mcs;
+        case Column::UlschErr: return data.ulsch_err;
+        case Column::UlschDtx: return data.ulsch_dtx;
+        case Column::UlMcs: return data.ul_mcs;
+        case Column::Nprb: return data.nprb;
+        case Column::MacTx: return static_cast<int64_t>(data.mac_tx);
+        case Column::MacRx: return static_cast<int64_t>(data.mac_rx);
+        case Column::Source: return data.source;
+        default: return 0;
+    }
+}
+
+double column_real(const UEData &data, Column column) {
+    switch (column) {
+        case Column::Rsrp: return data.rsrp;
+        case Column::DlBler: return data.dl_bler;
+        case Column::UlBler: return data.ul_bler;
+        case Column::Snr: return data.snr;
+        default: return static_cast<double>(column_integer(data, column));
+    }
+}
+
+void set_column_integer(UEData &data, Column column, int64_t value) {
+    switch (column) {
+        case Column::Timestamp: data.timestamp = value; break;
+        case Column::Rnti: data.rnti = value; break;
+        case Column::UeId: data.ue_id = value; break;
+        case Column::State: data.state = static_cast<UEState>(value); break;
+        case Column::Ph: data.ph = value; break;
+        case Column::Pcmax: data.pcmax = value; break;
+        case Column::Cqi: data.cqi = value; break;
+        case Column::DlRi: data.dl_ri = value; break;
+        case Column::UlRi: data.ul_ri = value; break;
+        case Column::DlschErr: data.dlsch_err = value; break;
+        case Column::PucchDtx: data.pucch_dtx = value; break;
+        case Column::DlMcs: data.dl_mcs = value; break;
+        case Column::UlschErr: data.ulsch_err = value; break;
+        case Column::UlschDtx: data.ulsch_dtx = value; break;
+        case Column::UlMcs: data.ul_mcs = value; break;
+        case Column::Nprb: data.nprb = value; break;
+        case Column::MacTx: data.mac_tx = value; break;
+        case Column::MacRx: data.mac_rx = value; break;
+        case Column::Source: data.source = value; break;
+        default: break;
+    }
+}
+
+void set_column_real(UEData &data, Column column, double value) {
+    switch (column) {
+        case Column::Rsrp: data.rsrp = value; break;
+        case Column::DlBler: data.dl_bler = value; break;
+        case Column::UlBler: data.ul_bler = value; break;
+        case Column::Snr: data.snr = value; break;
+        default: set_column_integer(data, column, static_cast<int64_t>(value)); break;
+    }
+}
+
+bool same_column(const UEData &a, const UEData &b, Column column) {
+    if (column_type(column) == ColumnType::Real) {
+        return std::bit_cast<uint64_t>(column_real(a, column)) == std::bit_cast<uint64_t>(column_real(b, column));
+    }
+    return column_integer(a, column) == column_integer(b, column);
+}
+
+size_t RowFormatter::format_row(const UEData &data, ColumnMask mask, char *out, ColumnMask blank) {
+    char *p = out;
+
+    // Walk the set bits in column order; blank columns only get their separator
+    for (ColumnMask left = mask; left; left &= left - 1) {
+        auto column = static_cast<Column>(std::countr_zero(left));
+        if (!(blank & column_bit(column))) {
+            switch (column) {
+                case Column::Timestamp:
+                    if (data.timestamp != cached_time) {
+                        cached_time = data.timestamp;
+                        cached_length = strftime(cached_stamp, sizeof(cached_stamp), "%Y-%m-%d %H:%M:%S",
+                                                 localtime(&data.timestamp));
+                    }
+                    std::memcpy(p, cached_stamp, cached_length);
+                    p += cached_length;
+                    break;
+                case Column::Rnti:
+                    snprintf(p, 5, "%04x", data.rnti);
+                    p += 4;
+                    break;
+                case Column::State: {
+                    const char *state = state_name(data.state);
+                    size_t len = strlen(state);
+                    std::memcpy(p, state, len);
+                    p += len;
+                    break;
+                }
+                case Column::UeId: p = put(p, data.ue_id); break;
+                case Column::Ph: p = put(p, data.ph); break;
+                case Column::Pcmax: p = put(p, data.pcmax); break;
+                case Column::Rsrp: p = put(p, data.rsrp); break;
+                case Column::Cqi: p = put(p, data.cqi); break;
+                case Column::DlRi: p = put(p, data.dl_ri); break;
+                case Column::UlRi: p = put(p, data.ul_ri); break;
+                case Column::DlschErr: p = put(p, data.dlsch_err); break;
+                case Column::PucchDtx: p = put(p, data.pucch_dtx); break;
+                case Column::DlBler: p = put(p, data.dl_bler); break;
+                case Column::DlMcs: p = put(p, data.dl_mcs); break;
+                case Column::UlschErr: p = put(p, data.ulsch_err); break;
+                case Column::UlschDtx: p = put(p, data.ulsch_dtx); break;
+                case Column::UlBler: p = put(p, data.ul_bler); break;
+                case Column::UlMcs: p = put(p, data.ul_mcs); break;
+                case Column::Nprb: p = put(p, data.nprb); break;
+                case Column::Snr: p = put(p, data.snr); break;
+                case Column::MacTx: p = put(p, data.mac_tx); break;
+                case Column::MacRx: p = put(p, data.mac_rx); break;
+                case Column::Source: {
+                    std::string_view name;
+                    if (data.source < source_names.size()) {
+                        name = source_names[data.source];
+                    }
+                    size_t len = std::min(name.size(), size_t(64));
+                    std::memcpy(p, name.data(), len);
+                    p += len;
+                    break;
+                }
+                case Column::Count: break;
+            }
+        }
+        *p++ = ',';
+    }
+
+    // Replace the trailing separator
+    p[-1] = '\n';
+    return p - out;
+}
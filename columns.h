@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ue_data.h"
+
+
+// Output columns in CSV order. A --columns list is compiled into a ColumnMask once at startup;
+// the parser and the writers only test bits afterwards.
+enum class Column : uint8_t {
+    Timestamp,
+    Rnti,
+    UeId,
+    State,
+    Ph,
+    Pcmax,
+    Rsrp,
+    Cqi,
+    DlRi,
+    UlRi,
+    DlschErr,
+    PucchDtx,
+    DlBler,
+    DlMcs,
+    UlschErr,
+    UlschDtx,
+    UlBler,
+    UlMcs,
+    Nprb,
+    Snr,
+    MacTx,
+    MacRx,
+    Source,
+    Count
+};
+
+using ColumnMask = uint32_t;
+
+constexpr ColumnMask column_bit(Column column) {
+    return ColumnMask(1) << static_cast<int>(column);
+}
+
+template<class... Columns>
+constexpr ColumnMask column_bits(Columns... columns) {
+    return (column_bit(columns) | ...);
+}
+
+constexpr ColumnMask all_columns = (ColumnMask(1) << static_cast<int>(Column::Count)) - 1;
+
+// The source column is only added by default when several inputs share one output; the MAC
+// counters came after the original schema and are only written when --columns asks for them
+constexpr ColumnMask default_columns = all_columns & ~column_bits(Column::Source, Column::MacTx, Column::MacRx);
+
+// Columns filled by each kind of stats line; a line type with none selected is not decoded at all
+constexpr ColumnMask basic_line_columns = column_bits(Column::UeId, Column::State, Column::Ph, Column::Pcmax,
+                                                      Column::Rsrp);
+constexpr ColumnMask indicators_line_columns = column_bits(Column::Cqi, Column::DlRi);
+constexpr ColumnMask ul_ri_line_columns = column_bit(Column::UlRi);
+constexpr ColumnMask dl_phy_line_columns = column_bits(Column::DlschErr, Column::PucchDtx, Column::DlBler,
+                                                       Column::DlMcs);
+constexpr ColumnMask ul_phy_line_columns = column_bits(Column::UlschErr, Column::UlschDtx, Column::UlBler,
+                                                       Column::UlMcs, Column::Nprb, Column::Snr);
+constexpr ColumnMask mac_line_columns = column_bits(Column::MacTx, Column::MacRx);
+
+const char *column_name(Column column);
+
+// Parses "rnti,timestamp,dl_bler"; on failure returns false and names the offending entry in error
+bool parse_columns(std::string_view list, ColumnMask &mask, std::string &error);
+
+// Header line (with '\n') for the selected columns, always in canonical order
+std::string csv_header(ColumnMask mask);
+
+// Column values as numbers, for writers that compare or encode fields instead of printing them.
+// Timestamp, Rnti, State and Source are integers (seconds, RNTI, UEState, input index).
+enum class ColumnType : uint8_t {
+    Integer,
+    Real
+};
+
+ColumnType column_type(Column column);
+
+int64_t column_integer(const UEData &data, Column column);
+
+double column_real(const UEData &data, Column column);
+
+void set_column_integer(UEData &data, Column column, int64_t value);
+
+void set_column_real(UEData &data, Column column, double value);
+
+// Same value in both records; reals compare bit for bit
+bool same_column(const UEData &a, const UEData &b, Column column);
+
+// Longest row format_row can produce
+constexpr size_t max_row_size = 512;
+
+// Formats records as CSV rows. The timestamp only changes once a second, so its strftime/localtime
+// result is cached between rows.
+class RowFormatter {
+private:
+    std::vector<std::string> source_names;
+    time_t cached_time = -1;
+    char cached_stamp[32] = {};
+    size_t cached_length = 0;
+
+public:
+    explicit RowFormatter(std::vector<std::string> sources = {}) : source_names(std::move(sources)) {
+    }
+
+    // Writes the selected columns as a row ending in '\n' into out (max_row_size bytes), returns its length.
+    // Columns also set in blank are written empty (not decoded while load shedding).
+    size_t format_row(const UEData &data, ColumnMask mask, char *out, ColumnMask blank = 0);
+};
@@ -0,0 +1,72 @@
+#include "compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#ifdef GNB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+bool zstd_available() {
+#ifdef GNB_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool zstd_frame(const char *data, size_t size) {
+    uint32_t magic = 0;
+    std::memcpy(&magic, data, std::min(size, sizeof(magic)));
+    return size >= sizeof(magic) && magic == 0xfd2fb528;
+}
+
+#ifdef GNB_HAVE_ZSTD
+
+bool zstd_compress(const char *data, size_t size, std::string &out, int level, bool checksum) {
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, checksum);
+    out.resize(ZSTD_compressBound(size));
+    size_t n = ZSTD_compress2(context.get(), out.data(), out.size(), data, size);
+    if (ZSTD_isError(n)) {
+        return false;
+    }
+    out.resize(n);
+    return true;
+}
+
+bool zstd_decompress(const char *data, size_t size, std::string &out) {
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    ZSTD_inBuffer in{data, size, 0};
+    out.clear();
+    size_t result;
+    bool full;
+    do {
+        size_t used = out.size();
+        out.resize(used + ZSTD_DStreamOutSize());
+        ZSTD_outBuffer chunk{out.data() + used, out.size() - used, 0};
+        result = ZSTD_decompressStream(context.get(), &chunk, &in);
+        full = chunk.pos == chunk.size;
+        out.resize(used + chunk.pos);
+        if (ZSTD_isError(result)) {
+            return false;
+        }
+    } while (in.pos < in.size || (full && result != 0)); // a full chunk may leave more, unless it ended the frame
+    return result == 0; // 0 once the last frame is complete
+}
+
+#else
+
+bool zstd_compress(const char *, size_t, std::string &, int, bool) {
+    return false;
+}
+
+bool zstd_decompress(const char *, size_t, std::string &) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// zstd is optional at build time (GNB_HAVE_ZSTD); without it --compress zstd is rejected
+
+bool zstd_available();
+
+// Compresses [data, data + size) into one zstd frame in out (replacing its contents); false without
+// zstd. Each thread reuses its own compression context.
+bool zstd_compress(const char *data, size_t size, std::string &out, int level = 3, bool checksum = false);
+
+// Decompresses one or more concatenated frames into out; false on damaged input or without zstd
+bool zstd_decompress(const char *data, size_t size, std::string &out);
+
+// Whether data starts with a zstd frame
+bool zstd_frame(const char *data, size_t size);
@@ -0,0 +1,115 @@
+#include "csv_output.h"
+
+#include <iomanip>
+#include <iostream>
+
+#include "placement.h"
+
+
+CsvOutput::CsvOutput(const std::string &file_name, bool exportCombined, ColumnMask selected,
+                     const std::vector<std::string> &source_names, const OutputOptions &output_options)
+    : filename(file_name), export_combined(exportCombined), sources(source_names), options(output_options),
+      columns(selected), header(csv_header(selected)), formatter(source_names), batch(output_options.max_delay) {
+    if (export_combined) {
+        open_combined();
+    }
+    if (options.max_delay.count() > 0) {
+        flusher = std::thread(&CsvOutput::run_flusher, this);
+    }
+}
+
+CsvOutput::~CsvOutput() {
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+    guard.unlock();
+    wake.notify_one();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+    guard.lock();
+    write_batch();
+}
+
+void CsvOutput::write_batch() {
+    if (combined_file) {
+        combined_file->flush();
+    }
+    for (auto &[key, file]: ue_file_handler) {
+        file.flush();
+    }
+    batch.written();
+}
+
+void CsvOutput::run_flusher() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        if (!batch.has_pending()) {
+            wake.wait(guard);
+        } else if (AdaptiveBatch::Clock::now() < batch.deadline()) {
+            wake.wait_until(guard, batch.deadline());
+        } else {
+            write_batch();
+        }
+    }
+}
+
+void CsvOutput::print_stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    std::cerr << "csv: " << batch.write_count() << " writes of " << std::fixed << std::setprecision(1)
+            << batch.mean_batch() << std::defaultfloat << " rows on average, batch size now " << batch.target()
+            << " rows (--max-delay " << options.max_delay.count() << " ms)" << std::endl;
+}
+
+void CsvOutput::open_combined() {
+    // Writes the CSV header
+    combined_file = std::make_unique<RotatingFile>(filename, ".csv", header, options);
+}
+
+void CsvOutput::shed(const ShedMode &mode) {
+    std::lock_guard<std::mutex> guard(lock);
+    blank = columns & ~mode.decoded;
+    if (!export_combined && mode.per_ue_to_combined && !combined_file) {
+        open_combined();
+    }
+    sep_to_combined = mode.per_ue_to_combined;
+}
+
+void CsvOutput::write(const UEData &data) {
+    std::lock_guard<std::mutex> guard(lock);
+    char row[max_row_size];
+    size_t length = formatter.format_row(data, columns, row, blank);
+
+    bool first = !batch.has_pending();
+    if (export_combined || sep_to_combined) {
+        combined_file->write(row, length, data.timestamp);
+    } else {
+        write_ue_row(data, row, length);
+    }
+    bool full = batch.add(AdaptiveBatch::Clock::now());
+    current_batch.store(batch.target(), std::memory_order_relaxed);
+    if (full) {
+        write_batch();
+    } else if (first) {
+        // The flusher sleeps until there is a deadline to keep
+        wake.notify_one();
+    }
+}
+
+void CsvOutput::write_ue_row(const UEData &data, const char *row, size_t length) {
+    // If the file handler doesn't exist yet, create it
+    uint32_t key = uint32_t(data.source) << 16 | data.rnti;
+    auto file = ue_file_handler.find(key);
+    if (file == ue_file_handler.end()) {
+        std::string ueFile = filename + "_";
+        if (sources.size() > 1) {
+            ueFile += sources[data.source] + "_";
+        }
+        ueFile += rnti_str(data.rnti);
+        // Writes the header to the new file
+        file = ue_file_handler.try_emplace(key, ueFile, ".csv", header, options).first;
+    }
+
+    // Write the data
+    file->second.write(row, length, data.timestamp);
+}
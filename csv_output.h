@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "adaptive_batch.h"
+#include "columns.h"
+#include "output_file.h"
+#include "overload.h"
+#include "record_sink.h"
+#include "rotation.h"
+
+
+// The CSV files: one combined file, or with --sep one file per UE. With several inputs the per-UE
+// files are named after the input as well, since RNTIs are only unique within one gNB. Every file
+// is a RotatingFile, so rotation and compression apply to the per-UE files as well. Rows reach the
+// kernel in AdaptiveBatch batches; a flusher thread writes a batch whose deadline passed.
+class CsvOutput : public RecordSink {
+private:
+    std::mutex lock;
+    std::string filename;
+    bool export_combined;
+    std::vector<std::string> sources;
+    OutputOptions options;
+
+    ColumnMask columns;
+    ColumnMask blank = 0;
+    std::string header;
+    RowFormatter formatter;
+
+    std::unique_ptr<RotatingFile> combined_file;
+    std::unordered_map<uint32_t, RotatingFile> ue_file_handler; // keyed by source << 16 | rnti
+    bool sep_to_combined = false;
+
+    AdaptiveBatch batch;
+    std::atomic<size_t> current_batch{1}; // batch.target(), readable without the lock
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread flusher;
+
+    void open_combined();
+
+    void write_ue_row(const UEData &data, const char *row, size_t length);
+
+    // Flushes every file; called with lock held
+    void write_batch();
+
+    void run_flusher();
+
+public:
+    CsvOutput(const std::string &file_name, bool exportCombined, ColumnMask selected,
+              const std::vector<std::string> &source_names = {}, const OutputOptions &output_options = {});
+
+    ~CsvOutput() override;
+
+    // Columns no longer decoded are written empty; --sep rows may be redirected to the combined file
+    void shed(const ShedMode &mode);
+
+    void write(const UEData &data) override;
+
+    // Rows per write at the current arrival rate; any thread, never waits for a parser
+    size_t batch_size() const {
+        return current_batch.load(std::memory_order_relaxed);
+    }
+
+    // Rows, writes and the batch size on stderr
+    void print_stats();
+};
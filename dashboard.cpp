@@ -0,0 +1,316 @@
+#include "dashboard.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <tuple>
+#include <unistd.h>
+
+#include "placement.h"
+
+
+namespace {
+    // Rows not updated for this long have left the cell
+    constexpr auto idle_after = std::chrono::seconds(30);
+
+    // Repaints the whole screen now and then, over whatever else was printed to the terminal
+    constexpr auto repaint_every = std::chrono::seconds(5);
+
+    void append_ascii(std::u32string &line, const char *text) {
+        while (*text) {
+            line += static_cast<char32_t>(static_cast<unsigned char>(*text++));
+        }
+    }
+
+    void append_utf8(std::string &out, const char32_t *begin, const char32_t *end) {
+        for (const char32_t *p = begin; p < end; p++) {
+            char32_t c = *p;
+            if (c < 0x80) {
+                out += static_cast<char>(c);
+            } else if (c < 0x800) {
+                out += static_cast<char>(0xc0 | c >> 6);
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            } else {
+                out += static_cast<char>(0xe0 | c >> 12);
+                out += static_cast<char>(0x80 | (c >> 6 & 0x3f));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            }
+        }
+    }
+
+    double seconds(std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+}
+
+Dashboard::Dashboard(RecordSink &next_sink, std::vector<std::string> source_names,
+                     std::chrono::milliseconds refresh_every, std::function<size_t()> csv_batch_size)
+    : next(next_sink), sources(std::move(source_names)), refresh(refresh_every),
+      batch_size(std::move(csv_batch_size)) {
+    if (isatty(STDOUT_FILENO)) {
+        fd = STDOUT_FILENO;
+    } else {
+        fd = open("/dev/tty", O_WRONLY | O_CLOEXEC);
+        own_fd = fd >= 0;
+    }
+    if (fd < 0) {
+        std::cerr << "--tui needs a terminal on stdout or /dev/tty" << std::endl;
+        return;
+    }
+    // Keystrokes would land in the table
+    if (tcgetattr(fd, &saved_mode) == 0) {
+        mode_saved = true;
+        termios quiet = saved_mode;
+        quiet.c_lflag &= ~ECHO;
+        tcsetattr(fd, TCSANOW, &quiet);
+    }
+    send("\x1b[?1049h\x1b[?25l"); // alternate screen, no cursor
+    started = last_frame = std::chrono::steady_clock::now();
+    renderer = std::thread(&Dashboard::run, this);
+}
+
+Dashboard::~Dashboard() {
+    finish();
+}
+
+void Dashboard::write(const UEData &data) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Entry &entry = ues[uint32_t(data.source) << 16 | data.rnti];
+        entry.data = data;
+        entry.updates++;
+        records++;
+        // The renderer is done with the front buffer: refill the other one and hand it over
+        if (wanted.load(std::memory_order_relaxed) && wanted.exchange(false, std::memory_order_acquire)) {
+            unsigned back = front.load(std::memory_order_relaxed) ^ 1;
+            Snapshot &snapshot = snapshots[back];
+            snapshot.ues.clear();
+            for (const auto &[key, ue]: ues) {
+                snapshot.ues.push_back(ue);
+            }
+            snapshot.records = records;
+            front.store(back, std::memory_order_release);
+        }
+    }
+    next.write(data);
+}
+
+void Dashboard::run() {
+    place_thread(ThreadRole::Writer);
+    auto next_repaint = std::chrono::steady_clock::now();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(stop_lock);
+            if (wake.wait_for(guard, refresh, [&] {
+                return stopping;
+            })) {
+                break;
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        winsize size{};
+        ioctl(fd, TIOCGWINSZ, &size);
+        bool repaint = now >= next_repaint || size.ws_row != rows || size.ws_col != cols;
+        rows = size.ws_row;
+        cols = size.ws_col;
+        if (repaint) {
+            next_repaint = now + repaint_every;
+        }
+
+        std::vector<std::u32string> frame = compose(snapshots[front.load(std::memory_order_acquire)], now);
+        wanted.store(true, std::memory_order_release);
+        std::string out;
+        diff(frame, repaint, out);
+        send(out);
+        frames++;
+    }
+
+    timespec cpu{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    cpu_ns = static_cast<int64_t>(cpu.tv_sec) * 1000000000 + cpu.tv_nsec;
+}
+
+std::vector<std::u32string> Dashboard::compose(const Snapshot &snapshot, std::chrono::steady_clock::time_point now) {
+    std::vector<const Entry *> shown;
+    for (const Entry &entry: snapshot.ues) {
+        uint32_t key = uint32_t(entry.data.source) << 16 | entry.data.rnti;
+        Trend &trend = trends[key];
+        if (entry.updates != trend.updates) {
+            double elapsed = seconds(now - trend.changed);
+            if (trend.updates != 0 && elapsed > 0) {
+                // The counters start over when a UE reattaches
+                uint64_t tx = entry.data.mac_tx >= trend.mac_tx ? entry.data.mac_tx - trend.mac_tx : 0;
+                uint64_t rx = entry.data.mac_rx >= trend.mac_rx ? entry.data.mac_rx - trend.mac_rx : 0;
+                trend.dl_mbps = static_cast<double>(tx) * 8 / elapsed / 1e6;
+                trend.ul_mbps = static_cast<double>(rx) * 8 / elapsed / 1e6;
+                trend.history[trend.history_count++ % std::size(trend.history)] = static_cast<float>(trend.dl_mbps);
+            }
+            trend.updates = entry.updates;
+            trend.mac_tx = entry.data.mac_tx;
+            trend.mac_rx = entry.data.mac_rx;
+            trend.changed = now;
+        }
+        if (now - trend.changed < idle_after) {
+            shown.push_back(&entry);
+        }
+    }
+    std::sort(shown.begin(), shown.end(), [](const Entry *a, const Entry *b) {
+        return std::tie(a->data.source, a->data.rnti) < std::tie(b->data.source, b->data.rnti);
+    });
+
+    std::vector<std::u32string> frame;
+    char text[256];
+    double elapsed = seconds(now - last_frame);
+    double rate = elapsed > 0 ? static_cast<double>(snapshot.records - last_records) / elapsed : 0;
+    last_frame = now;
+    last_records = snapshot.records;
+    time_t wall = time(nullptr);
+    tm local{};
+    localtime_r(&wall, &local);
+    char clock[16];
+    strftime(clock, sizeof(clock), "%H:%M:%S", &local);
+    std::snprintf(text, sizeof(text), "gnb_parser  %zu UEs  %.0f records/s  %llu records  %s", shown.size(), rate,
+                  static_cast<unsigned long long>(snapshot.records), clock);
+    frame.emplace_back();
+    append_ascii(frame.back(), text);
+    if (batch_size) {
+        std::snprintf(text, sizeof(text), "  csv batch %zu rows", batch_size());
+        append_ascii(frame.back(), text);
+    }
+
+    // The input column only with several inputs, as wide as their longest name (at most 16)
+    int source_width = 0;
+    if (sources.size() > 1) {
+        for (const std::string &name: sources) {
+            source_width = std::max(source_width, static_cast<int>(std::min<size_t>(name.size(), 16)));
+        }
+    }
+    frame.emplace_back();
+    if (source_width) {
+        std::snprintf(text, sizeof(text), "%-*s ", source_width, "input");
+        append_ascii(frame.back(), text);
+    }
+    append_ascii(frame.back(), "RNTI  UE-ID state         RSRP CQI dMCS uMCS DL-BLER UL-BLER   SNR  DL-Mbps  UL-Mbps "
+                 "DL history");
+
+    size_t room = rows > 3 ? rows - 2 : 1;
+    size_t listed = shown.size() <= room ? shown.size() : room - 1;
+    for (size_t i = 0; i < listed; i++) {
+        const UEData &data = shown[i]->data;
+        const Trend &trend = trends[uint32_t(data.source) << 16 | data.rnti];
+        frame.emplace_back();
+        std::u32string &line = frame.back();
+        if (source_width) {
+            const std::string &name = data.source < sources.size() ? sources[data.source] : std::string();
+            std::snprintf(text, sizeof(text), "%-*.*s ", source_width, source_width, name.c_str());
+            append_ascii(line, text);
+        }
+        std::snprintf(text, sizeof(text), "%04x %6d %-11s %6.1f %3d %4d %4d %7.4f %7.4f %5.1f %8.2f %8.2f ",
+                      data.rnti, data.ue_id, state_name(data.state), data.rsrp, data.cqi, data.dl_mcs, data.ul_mcs,
+                      data.dl_bler, data.ul_bler, data.snr, trend.dl_mbps, trend.ul_mbps);
+        append_ascii(line, text);
+
+        // Sparkline of the last DL throughputs, oldest first, scaled to their maximum
+        unsigned count = std::min<unsigned>(trend.history_count, std::size(trend.history));
+        float peak = 0;
+        for (unsigned j = 0; j < count; j++) {
+            peak = std::max(peak, trend.history[j]);
+        }
+        for (unsigned j = trend.history_count - count; j < trend.history_count; j++) {
+            float value = trend.history[j % std::size(trend.history)];
+            int level = peak > 0 ? static_cast<int>(value / peak * 7 + 0.5f) : 0;
+            line += static_cast<char32_t>(U'▁' + level);
+        }
+    }
+    if (listed < shown.size()) {
+        std::snprintf(text, sizeof(text), "... %zu more UEs", shown.size() - listed);
+        frame.emplace_back();
+        append_ascii(frame.back(), text);
+    }
+
+    if (cols > 0) {
+        for (std::u32string &line: frame) {
+            if (line.size() > cols) {
+                line.resize(cols);
+            }
+        }
+    }
+    return frame;
+}
+
+void Dashboard::diff(const std::vector<std::u32string> &frame, bool repaint, std::string &out) {
+    if (repaint) {
+        out += "\x1b[H\x1b[2J";
+        screen.clear();
+    }
+    static const std::u32string blank;
+    char move[32];
+    for (size_t row = 0; row < std::max(frame.size(), screen.size()); row++) {
+        const std::u32string &now = row < frame.size() ? frame[row] : blank;
+        const std::u32string &was = row < screen.size() ? screen[row] : blank;
+        if (now == was) {
+            continue;
+        }
+        // Only the span between the first and the last changed cell
+        size_t first = std::mismatch(now.begin(), now.end(), was.begin(), was.end()).first - now.begin();
+        size_t last = now.size();
+        if (now.size() == was.size()) {
+            while (last > first && now[last - 1] == was[last - 1]) {
+                last--;
+            }
+        }
+        std::snprintf(move, sizeof(move), "\x1b[%zu;%zuH", row + 1, first + 1);
+        out += move;
+        append_utf8(out, now.data() + first, now.data() + last);
+        if (now.size() < was.size()) {
+            out += "\x1b[K";
+        }
+    }
+    screen = frame;
+}
+
+void Dashboard::send(const std::string &out) {
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = ::write(fd, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        done += n;
+    }
+    bytes_written += done;
+}
+
+void Dashboard::finish() {
+    if (!renderer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(stop_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    renderer.join();
+
+    send("\x1b[?25h\x1b[?1049l");
+    if (mode_saved) {
+        tcsetattr(fd, TCSANOW, &saved_mode);
+    }
+    if (own_fd) {
+        close(fd);
+    }
+    double elapsed = seconds(std::chrono::steady_clock::now() - started);
+    std::cerr << std::fixed << std::setprecision(2) << "--tui: " << frames << " frames, "
+            << static_cast<double>(bytes_written) / 1024 << " KiB written, "
+            << (elapsed > 0 ? static_cast<double>(cpu_ns) / 1e9 / elapsed * 100 : 0) << "% of a CPU to render"
+            << std::endl;
+    std::cerr << std::defaultfloat;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "record_sink.h"
+#include "ue_data.h"
+
+
+/* --tui: live UE table on the terminal
+ *
+ * Parsers keep the latest record of every UE in their own table. The render thread never takes their
+ * lock. Instead it raises wanted once it is done with the snapshot it has; the next record then
+ * copies the table into the other of two snapshot buffers and flips front, so the renderer always
+ * reads a buffer no parser touches. Once per refresh the renderer turns the snapshot into screen
+ * lines, and throughputs from the MAC byte counters. It writes only the cells that differ from the
+ * frame on screen, as cursor moves plus the changed text, and repaints everything every few seconds
+ * or when the terminal is resized.
+ */
+class Dashboard : public RecordSink {
+private:
+    struct Entry {
+        UEData data;
+        uint64_t updates; // records of this UE so far
+    };
+
+    struct Snapshot {
+        std::vector<Entry> ues;
+        uint64_t records = 0;
+    };
+
+    // Render thread only: what a UE looked like when its record last changed
+    struct Trend {
+        uint64_t updates = 0;
+        uint64_t mac_tx = 0;
+        uint64_t mac_rx = 0;
+        std::chrono::steady_clock::time_point changed;
+        double dl_mbps = 0;
+        double ul_mbps = 0;
+        float history[24] = {}; // DL Mbit/s per update, a ring
+        unsigned history_count = 0;
+    };
+
+    RecordSink &next;
+    std::vector<std::string> sources;
+    std::chrono::milliseconds refresh;
+    std::function<size_t()> batch_size; // of the CSV output, shown in the header when set
+
+    // Parsers
+    std::mutex lock;
+    std::unordered_map<uint32_t, Entry> ues; // keyed by source << 16 | rnti
+    uint64_t records = 0;
+    Snapshot snapshots[2];
+    std::atomic<unsigned> front{0};
+    std::atomic<bool> wanted{true};
+
+    // Render thread
+    int fd = -1;
+    bool own_fd = false;
+    termios saved_mode{};
+    bool mode_saved = false;
+    std::unordered_map<uint32_t, Trend> trends;
+    std::vector<std::u32string> screen; // as on the terminal
+    unsigned rows = 0;
+    unsigned cols = 0;
+    uint64_t frames = 0;
+    uint64_t bytes_written = 0;
+    uint64_t last_records = 0;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point last_frame;
+    int64_t cpu_ns = 0; // of the render thread, once it ended
+
+    std::mutex stop_lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread renderer;
+
+    void run();
+
+    std::vector<std::u32string> compose(const Snapshot &snapshot, std::chrono::steady_clock::time_point now);
+
+    // Appends what turns screen into frame
+    void diff(const std::vector<std::u32string> &frame, bool repaint, std::string &out);
+
+    void send(const std::string &out);
+
+public:
+    Dashboard(RecordSink &next_sink, std::vector<std::string> source_names, std::chrono::milliseconds refresh_every,
+              std::function<size_t()> csv_batch_size = {});
+
+    ~Dashboard() override;
+
+    // False when there is no terminal to draw on (reported on stderr)
+    bool is_open() const {
+        return fd >= 0;
+    }
+
+    void write(const UEData &data) override;
+
+    // Stops drawing, gives the terminal back and prints the render cost
+    void finish();
+};
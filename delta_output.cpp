@@ -0,0 +1,517 @@
+#include "delta_output.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string_view>
+
+#include "checkpoint.h"
+#include "compression.h"
+#include "series_output.h"
+#include "swar.h"
+#include "varint.h"
+
+
+namespace {
+    constexpr ColumnMask key_columns = column_bits(Column::Rnti, Column::Source);
+    constexpr uint8_t gap_row = 2;
+
+    // Log values have few decimals: a real is stored as m / 10^k when that gives back the exact
+    // double, as varint(zigzag(m) << 4 | k), else as the tag 15 and the raw 8 bytes
+    constexpr uint64_t raw_real = 15;
+    constexpr double decimal_scale[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8};
+
+    void put_real(std::string &out, double value) {
+        for (size_t k = 0; k < std::size(decimal_scale); k++) {
+            double scaled = value * decimal_scale[k];
+            if (std::abs(scaled) < 1e15) {
+                auto m = static_cast<int64_t>(std::llround(scaled));
+                if (static_cast<double>(m) / decimal_scale[k] == value) {
+                    varint::put(out, varint::zigzag(m) << 4 | k);
+                    return;
+                }
+            }
+        }
+        varint::put(out, raw_real);
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    const char *get_real(const char *p, const char *end, double &value) {
+        uint64_t code;
+        if (!(p = varint::get(p, end, code))) {
+            return nullptr;
+        }
+        uint64_t k = code & 15;
+        if (k == raw_real) {
+            if (end - p < static_cast<ptrdiff_t>(sizeof(value))) {
+                return nullptr;
+            }
+            std::memcpy(&value, p, sizeof(value));
+            return p + sizeof(value);
+        }
+        if (k >= std::size(decimal_scale)) {
+            return nullptr;
+        }
+        value = static_cast<double>(varint::unzigzag(code >> 4)) / decimal_scale[k];
+        return p;
+    }
+
+    // Rebuilds full rows from keyframes and deltas and writes them as CSV to stdout
+    class Decoder {
+    private:
+        ColumnMask columns = 0;
+        std::vector<std::string> sources;
+        RowFormatter formatter;
+        std::unordered_map<uint32_t, UEData> last;
+        std::string out;
+        uint64_t rows = 0;
+        uint64_t orphans = 0;
+        uint64_t gaps = 0; // rows a --subscribe stream dropped
+
+        void flush() {
+            fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+
+        bool set_text(UEData &data, Column column, std::string_view text);
+
+        bool decode_csv(std::string_view input);
+
+        bool decode_binary(std::string_view input);
+
+    public:
+        bool decode(std::string_view input) {
+            uint32_t magic = 0;
+            std::memcpy(&magic, input.data(), std::min(input.size(), sizeof(magic)));
+            bool ok = magic == DeltaOutput::binary_magic ? decode_binary(input) : decode_csv(input);
+            flush();
+            if (orphans) {
+                std::cerr << "--decode: skipped " << orphans << " deltas without a preceding keyframe" << std::endl;
+            }
+            if (gaps) {
+                std::cerr << "--decode: the stream dropped " << gaps << " rows" << std::endl;
+            }
+            return ok;
+        }
+
+        // A keyframe starts from an empty record, a delta from the UE's previous row
+        UEData *begin_row(bool keyframe, uint16_t source, uint16_t rnti) {
+            uint32_t key = uint32_t(source) << 16 | rnti;
+            if (!keyframe) {
+                auto found = last.find(key);
+                orphans += found == last.end();
+                return found == last.end() ? nullptr : &found->second;
+            }
+            UEData &data = last[key];
+            data = UEData{};
+            data.source = source;
+            data.rnti = rnti;
+            return &data;
+        }
+
+        void emit(const UEData &data) {
+            char row[max_row_size];
+            out.append(row, formatter.format_row(data, columns, row));
+            if (out.size() > (1 << 20)) {
+                flush();
+            }
+            rows++;
+        }
+
+        void start(ColumnMask mask, std::vector<std::string> names) {
+            columns = mask;
+            sources = std::move(names);
+            formatter = RowFormatter(sources);
+            out += csv_header(columns);
+        }
+    };
+
+    bool Decoder::set_text(UEData &data, Column column, std::string_view text) {
+        const char *begin = text.data();
+        const char *end = begin + text.size();
+        switch (column) {
+            case Column::Timestamp: {
+                if (text[0] == '+') {
+                    int64_t seconds;
+                    if (std::from_chars(begin + 1, end, seconds).ec != std::errc()) {
+                        return false;
+                    }
+                    data.timestamp += seconds;
+                    return true;
+                }
+                std::tm tm{};
+                std::string copy(text);
+                if (!strptime(copy.c_str(), "%Y-%m-%d %H:%M:%S", &tm)) {
+                    return false;
+                }
+                tm.tm_isdst = -1;
+                data.timestamp = std::mktime(&tm);
+                return true;
+            }
+            case Column::Rnti:
+                return swar::parse_hex16(begin, end, data.rnti) == end;
+            case Column::Source: {
+                size_t index = 0;
+                while (index < sources.size() && sources[index] != text) {
+                    index++;
+                }
+                if (index == sources.size()) {
+                    // csv-delta names its inputs in the rows only
+                    sources.emplace_back(text);
+                    formatter = RowFormatter(sources);
+                }
+                data.source = index;
+                return true;
+            }
+            case Column::State:
+                data.state = text == state_name(UEState::InSync) ? UEState::InSync
+                             : text == state_name(UEState::OutOfSync) ? UEState::OutOfSync : UEState::Unknown;
+                return true;
+            default:
+                break;
+        }
+        if (column_type(column) == ColumnType::Real) {
+            double value;
+            if (std::from_chars(begin, end, value).ec != std::errc()) {
+                return false;
+            }
+            set_column_real(data, column, value);
+        } else {
+            int64_t value;
+            if (std::from_chars(begin, end, value).ec != std::errc()) {
+                return false;
+            }
+            set_column_integer(data, column, value);
+        }
+        return true;
+    }
+
+    bool Decoder::decode_csv(std::string_view input) {
+        size_t newline = input.find('\n');
+        std::string_view header = input.substr(0, newline);
+        std::string error;
+        ColumnMask mask;
+        if (!header.starts_with("kind,") || !parse_columns(header.substr(5), mask, error)) {
+            std::cerr << "--decode: not a csv-delta or binary-delta file" << std::endl;
+            return false;
+        }
+        start(mask, {});
+        input.remove_prefix(newline == std::string_view::npos ? input.size() : newline + 1);
+
+        std::string_view fields[static_cast<size_t>(Column::Count)];
+        while (!input.empty()) {
+            newline = input.find('\n');
+            std::string_view line = input.substr(0, newline);
+            input.remove_prefix(newline == std::string_view::npos ? input.size() : newline + 1);
+            if (line.size() < 2 || (line[0] != 'k' && line[0] != 'd')) {
+                continue;
+            }
+            bool keyframe = line[0] == 'k';
+            line.remove_prefix(2);
+
+            // Split into the selected columns
+            for (ColumnMask left = columns; left; left &= left - 1) {
+                size_t comma = line.find(',');
+                fields[std::countr_zero(left)] = line.substr(0, comma);
+                line.remove_prefix(comma == std::string_view::npos ? line.size() : comma + 1);
+            }
+
+            UEData key{};
+            for (Column column: {Column::Rnti, Column::Source}) {
+                std::string_view text = fields[static_cast<size_t>(column)];
+                if ((columns & column_bit(column)) && !set_text(key, column, text)) {
+                    return false;
+                }
+            }
+            UEData *data = begin_row(keyframe, key.source, key.rnti);
+            if (!data) {
+                continue;
+            }
+            for (ColumnMask left = columns & ~key_columns; left; left &= left - 1) {
+                auto column = static_cast<Column>(std::countr_zero(left));
+                std::string_view text = fields[static_cast<size_t>(column)];
+                if (!text.empty() && !set_text(*data, column, text)) {
+                    std::cerr << "--decode: bad " << column_name(column) << " value '" << text << "'" << std::endl;
+                    return false;
+                }
+            }
+            emit(*data);
+        }
+        return true;
+    }
+
+    bool Decoder::decode_binary(std::string_view input) {
+        const char *p = input.data() + sizeof(uint32_t);
+        const char *end = input.data() + input.size();
+        auto take = [&](void *to, size_t size) {
+            if (static_cast<size_t>(end - p) < size) {
+                return false;
+            }
+            std::memcpy(to, p, size);
+            p += size;
+            return true;
+        };
+
+        ColumnMask mask;
+        uint16_t count;
+        if (!take(&mask, sizeof(mask)) || !take(&count, sizeof(count))) {
+            return false;
+        }
+        std::vector<std::string> names(count);
+        for (std::string &name: names) {
+            uint16_t size;
+            if (!take(&size, sizeof(size)) || end - p < size) {
+                return false;
+            }
+            name.assign(p, size);
+            p += size;
+        }
+        start(mask, std::move(names));
+
+        while (p < end) {
+            uint8_t kind;
+            uint64_t source;
+            uint16_t rnti;
+            if (!take(&kind, 1)) {
+                break;
+            }
+            if (kind == gap_row) {
+                uint64_t count;
+                if (!(p = varint::get(p, end, count))) {
+                    break;
+                }
+                gaps += count;
+                continue;
+            }
+            if (!(p = varint::get(p, end, source)) || !take(&rnti, sizeof(rnti))) {
+                break;
+            }
+            bool keyframe = kind == 0;
+            uint64_t present = columns & ~key_columns;
+            if (!keyframe && !(p = varint::get(p, end, present))) {
+                break;
+            }
+
+            UEData *data = begin_row(keyframe, source, rnti);
+            UEData ignored{};
+            if (!data) {
+                data = &ignored; // still has to be read past
+            }
+            for (uint64_t left = present; left && p; left &= left - 1) {
+                auto column = static_cast<Column>(std::countr_zero(left));
+                uint64_t value;
+                if (column_type(column) == ColumnType::Real) {
+                    double real;
+                    if ((p = get_real(p, end, real))) {
+                        set_column_real(*data, column, real);
+                    }
+                } else if ((p = varint::get(p, end, value))) {
+                    if (column == Column::Timestamp) {
+                        data->timestamp = keyframe ? value : data->timestamp + varint::unzigzag(value);
+                    } else {
+                        set_column_integer(*data, column, varint::unzigzag(value));
+                    }
+                }
+            }
+            if (!p) {
+                break;
+            }
+            if (data != &ignored) {
+                emit(*data);
+            }
+        }
+        if (p != end) {
+            std::cerr << "--decode: truncated or damaged row after " << rows << " rows" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+void DeltaHistory::save(std::string &out) const {
+    put_raw(out, static_cast<uint32_t>(previous.size()));
+    for (const auto &[key, row]: previous) {
+        put_raw(out, key);
+        put_raw(out, row.rows_since_keyframe);
+        put_raw(out, row.data);
+    }
+}
+
+bool DeltaHistory::restore(std::string_view state) {
+    const char *p = state.data();
+    const char *end = p + state.size();
+    uint32_t count;
+    constexpr size_t entry_size = sizeof(uint32_t) + sizeof(unsigned) + sizeof(UEData);
+    if (!get_raw(p, end, count) || static_cast<size_t>(end - p) != count * entry_size) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t key;
+        Previous row{};
+        if (!get_raw(p, end, key) || !get_raw(p, end, row.rows_since_keyframe) || !get_raw(p, end, row.data)) {
+            return false;
+        }
+        previous[key] = row;
+    }
+    return true;
+}
+
+void put_binary_delta_header(std::string &out, ColumnMask columns, const std::vector<std::string> &source_names) {
+    out.append(reinterpret_cast<const char *>(&DeltaOutput::binary_magic), sizeof(DeltaOutput::binary_magic));
+    out.append(reinterpret_cast<const char *>(&columns), sizeof(columns));
+    auto count = static_cast<uint16_t>(source_names.size());
+    out.append(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const std::string &name: source_names) {
+        auto size = static_cast<uint16_t>(name.size());
+        out.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        out += name;
+    }
+}
+
+void put_binary_delta_row(std::string &out, const UEData &data, ColumnMask columns, const UEData *last) {
+    out += static_cast<char>(last ? 1 : 0);
+    varint::put(out, data.source);
+    out.append(reinterpret_cast<const char *>(&data.rnti), sizeof(data.rnti));
+
+    ColumnMask present = columns & ~key_columns;
+    if (last) {
+        for (ColumnMask left = present; left; left &= left - 1) {
+            auto column = static_cast<Column>(std::countr_zero(left));
+            if (same_column(data, *last, column)) {
+                present &= ~column_bit(column);
+            }
+        }
+        varint::put(out, present);
+    }
+
+    for (ColumnMask left = present; left; left &= left - 1) {
+        auto column = static_cast<Column>(std::countr_zero(left));
+        if (column_type(column) == ColumnType::Real) {
+            put_real(out, column_real(data, column));
+        } else if (column == Column::Timestamp) {
+            varint::put(out, last ? varint::zigzag(data.timestamp - last->timestamp) : data.timestamp);
+        } else {
+            varint::put(out, varint::zigzag(column_integer(data, column)));
+        }
+    }
+}
+
+void put_binary_delta_gap(std::string &out, uint64_t count) {
+    out += static_cast<char>(gap_row);
+    varint::put(out, count);
+}
+
+DeltaOutput::DeltaOutput(const std::string &path, DeltaFormat delta_format, ColumnMask selected,
+                         const std::vector<std::string> &source_names, unsigned keyframe_every,
+                         const OutputOptions &options)
+    : format(delta_format), columns(selected | column_bit(Column::Rnti)), formatter(source_names),
+      history(keyframe_every) {
+    if (source_names.size() > 1) {
+        columns |= column_bit(Column::Source);
+    }
+    // A resumed run appends its rows after the ones of the run before, under the same header
+    continued = options.resume && existing_size(path, options) > 0;
+    if (!file.open(path, options, continued) || continued) {
+        return;
+    }
+
+    if (format == DeltaFormat::Csv) {
+        file.write("kind," + csv_header(columns));
+        return;
+    }
+    put_binary_delta_header(row, columns, source_names);
+    file.write(row.data(), row.size());
+}
+
+void DeltaOutput::write(const UEData &data) {
+    std::lock_guard<std::mutex> guard(lock);
+    history.next(data, [&](const UEData *last) {
+        if (format == DeltaFormat::Csv) {
+            write_csv(data, last);
+            return;
+        }
+        row.clear();
+        put_binary_delta_row(row, data, columns, last);
+        file.write(row.data(), row.size());
+    });
+}
+
+void DeltaOutput::save_state(std::string &out) {
+    std::lock_guard<std::mutex> guard(lock);
+    history.save(out);
+}
+
+bool DeltaOutput::restore_state(std::string_view state) {
+    std::lock_guard<std::mutex> guard(lock);
+    return continued && history.restore(state);
+}
+
+void DeltaOutput::write_csv(const UEData &data, const UEData *last) {
+    // An unknown state is written empty, which a delta cannot tell from unchanged: a keyframe then
+    if (last && data.state == UEState::Unknown && last->state != UEState::Unknown &&
+        (columns & column_bit(Column::State))) {
+        last = nullptr;
+    }
+    char out[max_row_size + 32];
+    char *p = out;
+    *p++ = last ? 'd' : 'k';
+    *p++ = ',';
+
+    ColumnMask unchanged = 0;
+    if (last) {
+        for (ColumnMask left = columns & ~key_columns; left; left &= left - 1) {
+            auto column = static_cast<Column>(std::countr_zero(left));
+            if (same_column(data, *last, column)) {
+                unchanged |= column_bit(column);
+            }
+        }
+        // The timestamp is the first column, so its offset goes right before the row
+        if (columns & column_bit(Column::Timestamp)) {
+            unchanged |= column_bit(Column::Timestamp);
+            if (data.timestamp != last->timestamp) {
+                *p++ = '+';
+                p = std::to_chars(p, p + 24, data.timestamp - last->timestamp).ptr;
+            }
+        }
+    }
+    p += formatter.format_row(data, columns, p, unchanged);
+    file.write(out, p - out);
+}
+
+int run_decode(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return 1;
+    }
+    std::string input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (zstd_frame(input.data(), input.size())) {
+        // A crash can leave the last frame cut short; the complete frames before it still decode
+        std::string plain;
+        if (!zstd_decompress(input.data(), input.size(), plain)) {
+            std::cerr << "--decode: " << (zstd_available() ? "damaged zstd file, decoding what was complete"
+                                                           : "built without zstd") << std::endl;
+            if (!zstd_available()) {
+                return 1;
+            }
+        }
+        input = std::move(plain);
+    }
+    uint32_t magic = 0;
+    std::memcpy(&magic, input.data(), std::min(input.size(), sizeof(magic)));
+    if (magic == SeriesOutput::magic) {
+        if (!decode_series(input, stdout)) {
+            std::cerr << "--decode: truncated or damaged series file" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    Decoder decoder;
+    return decoder.decode(input) ? 0 : 1;
+}
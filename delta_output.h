@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "columns.h"
+#include "output_file.h"
+#include "record_sink.h"
+
+
+/* Change-only output (--format csv-delta / binary-delta)
+ *
+ * Per UE, a row only carries the fields that changed since that UE's previous row; every
+ * keyframe_interval-th row of a UE (and its first) is a full keyframe, so a reader can start at any
+ * keyframe and a damaged row only affects one UE until its next keyframe. RNTI and source are
+ * always written, since they identify the UE.
+ *
+ * csv-delta: the CSV header prefixed with a "kind" column, "k" for keyframes and "d" for deltas.
+ * An empty field in a delta is unchanged; the timestamp of a delta is "+<seconds>" since the
+ * previous row of that UE. A row whose state turns unknown (an empty field) is a keyframe.
+ *
+ * binary-delta: header u32 magic "GDL1", u32 column mask, u16 input count, per input u16 size and
+ * name. Per row: u8 kind (0 keyframe, 1 delta), varint input, u16 RNTI, for deltas a varint mask of
+ * the columns present, then each present column in CSV order: the timestamp as a varint (zigzag
+ * difference in deltas), other integers zigzag varints, reals as exact scaled decimals (see
+ * put_real) or raw doubles. Host byte order. Streams that drop rows (--subscribe) mark the spot
+ * with u8 kind 2 and a varint count.
+ *
+ * --decode turns either form back into the full CSV.
+ */
+enum class DeltaFormat {
+    Csv,
+    Binary
+};
+
+// Previous row per UE and the keyframe spacing of one delta stream
+class DeltaHistory {
+private:
+    struct Previous {
+        UEData data;
+        unsigned rows_since_keyframe;
+    };
+
+    unsigned keyframe_interval;
+    std::unordered_map<uint32_t, Previous> previous; // keyed by source << 16 | rnti
+
+public:
+    explicit DeltaHistory(unsigned keyframe_every) : keyframe_interval(std::max(1u, keyframe_every)) {
+    }
+
+    // Calls write(last) with the UE's previous row for a delta, or nullptr for a keyframe; then
+    // data becomes the previous row
+    template<class F>
+    void next(const UEData &data, F &&write) {
+        uint32_t key = uint32_t(data.source) << 16 | data.rnti;
+        auto it = previous.find(key);
+        const UEData *last = nullptr;
+        if (it != previous.end() && it->second.rows_since_keyframe + 1 < keyframe_interval) {
+            last = &it->second.data;
+        }
+        write(last);
+        if (it == previous.end()) {
+            previous.emplace(key, Previous{data, 0});
+        } else {
+            it->second.rows_since_keyframe = last ? it->second.rows_since_keyframe + 1 : 0;
+            it->second.data = data;
+        }
+    }
+
+    // --checkpoint: every UE's previous row and its place in the keyframe cycle
+    void save(std::string &out) const;
+
+    // False, restoring nothing, when the state is damaged
+    bool restore(std::string_view state);
+};
+
+// The binary-delta layout, also used by the --subscribe streams: the header, a keyframe (last is
+// nullptr) or a delta against last, and a gap row (kind 2, varint count) saying that count rows
+// were dropped from the stream at this point
+void put_binary_delta_header(std::string &out, ColumnMask columns, const std::vector<std::string> &source_names);
+
+void put_binary_delta_row(std::string &out, const UEData &data, ColumnMask columns, const UEData *last);
+
+void put_binary_delta_gap(std::string &out, uint64_t count);
+
+class DeltaOutput : public RecordSink {
+private:
+    std::mutex lock;
+    OutputFile file;
+    DeltaFormat format;
+    ColumnMask columns;
+    RowFormatter formatter;
+    DeltaHistory history;
+    bool continued = false; // appended to the rows of an earlier run
+    std::string row;
+
+    void write_csv(const UEData &data, const UEData *last);
+
+public:
+    static constexpr uint32_t binary_magic = 0x314c4447;
+
+    DeltaOutput(const std::string &path, DeltaFormat delta_format, ColumnMask selected,
+                const std::vector<std::string> &source_names, unsigned keyframe_every,
+                const OutputOptions &options = {});
+
+    bool is_open() const {
+        return file.is_open();
+    }
+
+    void write(const UEData &data) override;
+
+    void save_state(std::string &out);
+
+    // Only when this run continues the file (OutputOptions::resume) the history was taken for
+    bool restore_state(std::string_view state);
+};
+
+// --decode: writes the full CSV of a csv-delta, binary-delta or series file (or its .zst) to stdout
+int run_decode(const std::string &path);
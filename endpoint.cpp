@@ -0,0 +1,147 @@
+#include "endpoint.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace {
+    bool unix_address(const std::string &spec, sockaddr_un &addr, std::string &error) {
+        std::string path = spec.substr(5);
+        addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            error = spec + ": invalid socket path";
+            return false;
+        }
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return true;
+    }
+
+    // Calls use(fd, address) for each resolved TCP address until it returns true
+    template<class F>
+    int tcp_socket(const std::string &spec, int flags, bool passive, std::string &error, F &&use) {
+        std::string address = spec.substr(4);
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            error = spec + ": expected tcp:host:port";
+            return -1;
+        }
+        std::string host = address.substr(0, colon);
+        std::string port = address.substr(colon + 1);
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo *found = nullptr;
+        int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+        if (status != 0) {
+            error = spec + ": " + gai_strerror(status);
+            return -1;
+        }
+        int fd = -1;
+        for (addrinfo *ai = found; ai; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | flags, ai->ai_protocol);
+            if (fd >= 0 && use(fd, ai->ai_addr, ai->ai_addrlen)) {
+                break;
+            }
+            error = spec + ": " + std::strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        return fd;
+    }
+
+    // connect() without blocking for longer than timeout_ms, then the same limit for sends
+    bool connect_within(int fd, const sockaddr *addr, socklen_t length, int timeout_ms) {
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        bool ok = connect(fd, addr, length) == 0;
+        if (!ok && errno == EINPROGRESS) {
+            pollfd writable{fd, POLLOUT, 0};
+            int ready = poll(&writable, 1, timeout_ms);
+            int code = ETIMEDOUT;
+            socklen_t size = sizeof(code);
+            if (ready > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &code, &size) != 0) {
+                code = errno;
+            }
+            ok = ready > 0 && code == 0;
+            errno = ok ? 0 : ready < 0 ? errno : code;
+        }
+        fcntl(fd, F_SETFL, flags);
+        if (ok) {
+            timeval limit{timeout_ms / 1000, timeout_ms % 1000 * 1000};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+        }
+        return ok;
+    }
+}
+
+int listen_endpoint(const std::string &spec, std::string &error) {
+    if (spec.starts_with("unix:")) {
+        sockaddr_un addr;
+        if (!unix_address(spec, addr, error)) {
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(addr.sun_path);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+            error = spec + ": " + std::strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+    if (spec.starts_with("tcp:")) {
+        return tcp_socket(spec, SOCK_NONBLOCK | SOCK_CLOEXEC, true, error,
+                          [](int fd, const sockaddr *addr, socklen_t length) {
+                              int on = 1;
+                              setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+                              return bind(fd, addr, length) == 0 && listen(fd, 64) == 0;
+                          });
+    }
+    error = spec + ": expected unix:path or tcp:host:port";
+    return -1;
+}
+
+int connect_endpoint(const std::string &spec, std::string &error, int timeout_ms) {
+    if (spec.starts_with("unix:")) {
+        sockaddr_un addr;
+        if (!unix_address(spec, addr, error)) {
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || !connect_within(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr), timeout_ms)) {
+            error = spec + ": " + std::strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+    if (spec.starts_with("tcp:")) {
+        return tcp_socket(spec, SOCK_CLOEXEC, false, error, [&](int fd, const sockaddr *addr, socklen_t length) {
+            return connect_within(fd, addr, length, timeout_ms);
+        });
+    }
+    error = spec + ": expected unix:path or tcp:host:port";
+    return -1;
+}
+
+void unlink_endpoint(const std::string &spec) {
+    if (spec.starts_with("unix:")) {
+        unlink(spec.substr(5).c_str());
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+
+// Socket addresses for --export and gnb_aggregator: "unix:/path/to.sock" or "tcp:host:port"
+
+// Listening socket, non-blocking; a stale Unix socket file is replaced. -1 with error on failure.
+int listen_endpoint(const std::string &spec, std::string &error);
+
+// Connected blocking stream socket, -1 with error on failure. Connecting gives up after timeout_ms, and
+// so does a send() the peer does not take in (SO_SNDTIMEO, failing with EAGAIN).
+int connect_endpoint(const std::string &spec, std::string &error, int timeout_ms);
+
+// Removes the socket file of a Unix endpoint
+void unlink_endpoint(const std::string &spec);
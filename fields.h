@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "swar.h"
+
+
+// Walks a log line left to right. Every step returns false instead of throwing, so a line that
+// does not have the expected shape is simply ignored, like a regex that does not match.
+struct FieldCursor {
+    const char *p;
+    const char *end;
+
+    explicit FieldCursor(std::string_view line) : p(line.data()), end(line.data() + line.size()) {
+    }
+
+    bool literal(std::string_view text) {
+        if (static_cast<size_t>(end - p) < text.size() || std::memcmp(p, text.data(), text.size()) != 0) {
+            return false;
+        }
+        p += text.size();
+        return true;
+    }
+
+    // Moves just past the next occurrence of text
+    bool skip_past(std::string_view text) {
+        size_t at = std::string_view(p, end - p).find(text);
+        if (at == std::string_view::npos) {
+            return false;
+        }
+        p += at + text.size();
+        return true;
+    }
+
+    bool spaces() {
+        p = swar::skip_spaces(p, end);
+        return true;
+    }
+
+    // Skips "(...)" and the spaces after it, as in "MCS (1) 22"
+    bool parenthesised() {
+        if (p < end && *p == '(') {
+            const void *close = std::memchr(p, ')', end - p);
+            if (!close) {
+                return false;
+            }
+            p = static_cast<const char *>(close) + 1;
+            spaces();
+        }
+        return true;
+    }
+
+    // Everything up to the next space
+    bool token(std::string_view &out) {
+        const void *space = std::memchr(p, ' ', end - p);
+        const char *stop = space ? static_cast<const char *>(space) : end;
+        out = std::string_view(p, stop - p);
+        p = stop;
+        return !out.empty();
+    }
+
+    template<class T>
+    bool uint(T &out) {
+        uint64_t v;
+        const char *next = swar::parse_uint(p, end, v);
+        if (!next) {
+            return false;
+        }
+        out = static_cast<T>(v);
+        p = next;
+        return true;
+    }
+
+    template<class T>
+    bool integer(T &out) {
+        int64_t v;
+        const char *next = swar::parse_int(p, end, v);
+        if (!next) {
+            return false;
+        }
+        out = static_cast<T>(v);
+        p = next;
+        return true;
+    }
+
+    bool real(double &out) {
+        const char *next = swar::parse_real(p, end, out);
+        if (!next) {
+            return false;
+        }
+        p = next;
+        return true;
+    }
+
+    bool hex16(uint16_t &out) {
+        const char *next = swar::parse_hex16(p, end, out);
+        if (!next) {
+            return false;
+        }
+        p = next;
+        return true;
+    }
+};
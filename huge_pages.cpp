@@ -0,0 +1,193 @@
+#include "huge_pages.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+
+namespace {
+    constexpr size_t huge_page = 2 << 20;
+
+    HugePages configured = HugePages::Off;
+
+    size_t round_up(size_t size, size_t unit) {
+        return (size + unit - 1) / unit * unit;
+    }
+
+    // madvise(MADV_HUGEPAGE) succeeds even when THP is switched off, so ask sysfs
+    bool transparent_available() {
+        static const bool available = [] {
+            std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+            std::string modes;
+            return std::getline(in, modes) && modes.find("[never]") == std::string::npos;
+        }();
+        return available;
+    }
+
+    void note_fallback(HugePages wanted) {
+        static std::once_flag hugetlb_note;
+        static std::once_flag transparent_note;
+        if (wanted == HugePages::HugeTLB) {
+            std::call_once(hugetlb_note, [] {
+                std::cerr << "--huge-pages: no free hugetlb pages (see vm.nr_hugepages), "
+                          << "trying transparent huge pages" << std::endl;
+            });
+        } else {
+            std::call_once(transparent_note, [] {
+                std::cerr << "--huge-pages: transparent huge pages are not available, using 4 KiB pages"
+                          << std::endl;
+            });
+        }
+    }
+
+    // size bytes of anonymous memory aligned to alignment, or nullptr
+    char *map_aligned(size_t size, size_t alignment) {
+        size_t extra = alignment - static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        void *raw = mmap(nullptr, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        auto start = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = round_up(start, alignment);
+        // Give back the slack on both sides
+        if (aligned > start) {
+            munmap(raw, aligned - start);
+        }
+        if (start + size + extra > aligned + size) {
+            munmap(reinterpret_cast<void *>(aligned + size), start + size + extra - (aligned + size));
+        }
+        return reinterpret_cast<char *>(aligned);
+    }
+}
+
+void set_huge_pages(HugePages mode) {
+    configured = mode;
+}
+
+HugePages huge_pages() {
+    return configured;
+}
+
+bool parse_huge_pages(const char *text, HugePages &mode) {
+    if (std::strcmp(text, "thp") == 0) {
+        mode = HugePages::Transparent;
+    } else if (std::strcmp(text, "hugetlb") == 0) {
+        mode = HugePages::HugeTLB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *huge_pages_name(HugePages mode) {
+    switch (mode) {
+        case HugePages::Transparent:
+            return "thp";
+        case HugePages::HugeTLB:
+            return "hugetlb";
+        default:
+            return "4 KiB";
+    }
+}
+
+void advise_huge_pages(void *address, size_t size) {
+    if (configured != HugePages::Off && transparent_available()) {
+        madvise(address, size, MADV_HUGEPAGE);
+    }
+}
+
+void PageBuffer::allocate(size_t size, HugePages mode) {
+    if (size == 0) {
+        return;
+    }
+    if (mode == HugePages::HugeTLB) {
+        size_t bytes = round_up(size, huge_page);
+        void *address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                             -1, 0);
+        if (address != MAP_FAILED) {
+            base = static_cast<char *>(address);
+            length = size;
+            mapped = bytes;
+            backing = HugePages::HugeTLB;
+            return;
+        }
+        note_fallback(HugePages::HugeTLB);
+        mode = HugePages::Transparent;
+    }
+    if (mode == HugePages::Transparent) {
+        if (transparent_available()) {
+            size_t bytes = round_up(size, huge_page);
+            base = map_aligned(bytes, huge_page);
+            if (base && madvise(base, bytes, MADV_HUGEPAGE) == 0) {
+                length = size;
+                mapped = bytes;
+                backing = HugePages::Transparent;
+                return;
+            }
+            if (base) {
+                munmap(base, bytes);
+                base = nullptr;
+            }
+        }
+        note_fallback(HugePages::Transparent);
+    }
+    size_t bytes = round_up(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    void *address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (address == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    base = static_cast<char *>(address);
+    length = size;
+    mapped = bytes;
+    backing = HugePages::Off;
+}
+
+PageBuffer::PageBuffer(PageBuffer &&other) noexcept
+    : base(std::exchange(other.base, nullptr)), length(std::exchange(other.length, 0)),
+      mapped(std::exchange(other.mapped, 0)), backing(other.backing) {
+}
+
+PageBuffer &PageBuffer::operator=(PageBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        base = std::exchange(other.base, nullptr);
+        length = std::exchange(other.length, 0);
+        mapped = std::exchange(other.mapped, 0);
+        backing = other.backing;
+    }
+    return *this;
+}
+
+PageBuffer::~PageBuffer() {
+    release();
+}
+
+void PageBuffer::resize(size_t size) {
+    if (size <= length) {
+        return;
+    }
+    if (size <= mapped) {
+        length = size;
+        return;
+    }
+    // Keep asking for the kind that was configured, not the one this buffer fell back to
+    PageBuffer larger(size, backing == HugePages::Off ? configured : backing);
+    std::memcpy(larger.base, base, length);
+    *this = std::move(larger);
+}
+
+void PageBuffer::release() {
+    if (base) {
+        munmap(base, mapped);
+    }
+    base = nullptr;
+    length = 0;
+    mapped = 0;
+}
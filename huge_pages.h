@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+
+
+/* --huge-pages: 2 MiB pages for the large buffers
+ *
+ * The read buffers, the O_DIRECT output buffer and a mapped stdin are walked end to end over and
+ * over; with 4 KiB pages that is a TLB miss every 4 KiB and a page fault for every page touched
+ * first. PageBuffer maps its memory directly: with hugetlb from the reserved pool (vm.nr_hugepages),
+ * with thp as 2 MiB aligned anonymous memory marked MADV_HUGEPAGE for transparent huge pages.
+ * Whatever is not available falls back to the next kind down, hugetlb to thp to 4 KiB pages, with
+ * one note on stderr.
+ */
+enum class HugePages {
+    Off,
+    Transparent,
+    HugeTLB
+};
+
+// Before any buffer is allocated; the default is Off
+void set_huge_pages(HugePages mode);
+
+HugePages huge_pages();
+
+// "thp" or "hugetlb"; false for anything else
+bool parse_huge_pages(const char *text, HugePages &mode);
+
+// "4 KiB", "thp", "hugetlb"
+const char *huge_pages_name(HugePages mode);
+
+// MADV_HUGEPAGE on a file mapping (page cache THP where the filesystem supports it); best effort
+void advise_huge_pages(void *address, size_t size);
+
+// A page-aligned byte buffer backed by the configured (or given) kind of pages
+class PageBuffer {
+private:
+    char *base = nullptr;
+    size_t length = 0; // usable bytes
+    size_t mapped = 0; // bytes mapped, length rounded up to the page size
+    HugePages backing = HugePages::Off;
+
+    void allocate(size_t size, HugePages mode);
+
+public:
+    PageBuffer() = default;
+
+    explicit PageBuffer(size_t size) : PageBuffer(size, huge_pages()) {
+    }
+
+    PageBuffer(size_t size, HugePages mode) {
+        allocate(size, mode);
+    }
+
+    PageBuffer(PageBuffer &&other) noexcept;
+
+    PageBuffer &operator=(PageBuffer &&other) noexcept;
+
+    PageBuffer(const PageBuffer &) = delete;
+
+    ~PageBuffer();
+
+    char *data() const {
+        return base;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    // What the buffer actually got
+    HugePages kind() const {
+        return backing;
+    }
+
+    // Grows the buffer to size, keeping its contents
+    void resize(size_t size);
+
+    void release();
+};
@@ -0,0 +1,272 @@
+#include "input.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "huge_pages.h"
+#include "placement.h"
+#include "publisher.h"
+
+
+namespace {
+    std::atomic<bool> stopping{false};
+    pthread_t reading_thread;
+
+    void on_stop_signal(int signal) {
+        stopping = true;
+        // Only the reading thread's read() has to be interrupted
+        if (!pthread_equal(pthread_self(), reading_thread)) {
+            pthread_kill(reading_thread, signal);
+        }
+    }
+}
+
+void block_stop_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+void install_stop_handler() {
+    reading_thread = pthread_self();
+    struct sigaction action{};
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0; // no SA_RESTART: a blocked read() has to return EINTR
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+}
+
+bool stop_requested() {
+    return stopping;
+}
+
+ssize_t FdInput::read(char *buffer, size_t size) {
+    if (stop_requested()) {
+        return 0;
+    }
+    ssize_t n = ::read(fd, buffer, size);
+    return n < 0 && errno == EINTR && stop_requested() ? 0 : n;
+}
+
+BusyPollInput::BusyPollInput(int input_fd) : fd(input_fd), flags(fcntl(input_fd, F_GETFL)) {
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+BusyPollInput::~BusyPollInput() {
+    fcntl(fd, F_SETFL, flags);
+}
+
+ssize_t BusyPollInput::read(char *buffer, size_t size) {
+    while (!stop_requested()) {
+        ssize_t n = ::read(fd, buffer, size);
+        if (n > 0) {
+            last_read = monotonic_ns();
+            return n;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            return n;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    return 0;
+}
+
+MappedInput::MappedInput(int fd) {
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return;
+    }
+    void *address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        return;
+    }
+    base = static_cast<char *>(address);
+    length = st.st_size;
+    madvise(base, length, MADV_SEQUENTIAL);
+    advise_huge_pages(base, length);
+}
+
+MappedInput::~MappedInput() {
+    if (base) {
+        munmap(base, length);
+    }
+}
+
+ssize_t MappedInput::read(char *buffer, size_t size) {
+    if (stop_requested()) {
+        return 0;
+    }
+    size_t n = std::min(size, length - position);
+    std::memcpy(buffer, base + position, n);
+    position += n;
+    return static_cast<ssize_t>(n);
+}
+
+TeeInput::TeeInput(int input_fd, const std::string &path) : fd(input_fd) {
+    file_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file_fd < 0) {
+        return;
+    }
+    if (pipe2(archive_pipe, O_CLOEXEC) != 0) {
+        ::close(file_fd);
+        file_fd = -1;
+        return;
+    }
+    // Only the parser side is non-blocking; the writer thread blocks in splice
+    fcntl(archive_pipe[1], F_SETFL, O_NONBLOCK);
+
+    // The archive pipe is the only slack between the parser and a slow disk
+    std::ifstream max_size("/proc/sys/fs/pipe-max-size");
+    int wanted = 0;
+    if (max_size >> wanted && wanted > 0) {
+        fcntl(archive_pipe[1], F_SETPIPE_SZ, wanted);
+    }
+
+    struct stat st{};
+    input_is_pipe = fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    writer = std::thread(&TeeInput::drain, this);
+}
+
+TeeInput::~TeeInput() {
+    close();
+}
+
+void TeeInput::drain() {
+    place_thread(ThreadRole::Writer);
+    while (true) {
+        ssize_t n = splice(archive_pipe[0], nullptr, file_fd, nullptr, 1 << 20, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EINVAL) {
+            // The target does not support splice (some devices and FUSE mounts)
+            break;
+        }
+        if (n < 0) {
+            write_error = errno;
+        }
+        if (n <= 0) {
+            return;
+        }
+    }
+
+    std::vector<char> buffer(1 << 20);
+    while (true) {
+        ssize_t n = ::read(archive_pipe[0], buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        for (ssize_t done = 0; done < n;) {
+            ssize_t written = write(file_fd, buffer.data() + done, n - done);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0) {
+                write_error = errno;
+                return;
+            }
+            done += written;
+        }
+    }
+}
+
+void TeeInput::close() {
+    if (archive_pipe[1] >= 0) {
+        ::close(archive_pipe[1]);
+        archive_pipe[1] = -1;
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (archive_pipe[0] >= 0) {
+        ::close(archive_pipe[0]);
+        archive_pipe[0] = -1;
+    }
+    if (file_fd >= 0) {
+        ::close(file_fd);
+        file_fd = -1;
+    }
+}
+
+ssize_t TeeInput::read(char *buffer, size_t size) {
+    if (stop_requested()) {
+        return 0;
+    }
+    if (!input_is_pipe) {
+        ssize_t n = ::read(fd, buffer, size);
+        if (n > 0) {
+            ssize_t written = write(archive_pipe[1], buffer, n);
+            written = written < 0 ? 0 : written;
+            archived += written;
+            dropped += n - written;
+        }
+        return n;
+    }
+
+    while (true) {
+        // Wait for data so that EAGAIN from tee can only mean a full archive pipe
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                if (stop_requested()) {
+                    return 0;
+                }
+                continue;
+            }
+            return -1;
+        }
+
+        ssize_t duplicated = tee(fd, archive_pipe[1], size, SPLICE_F_NONBLOCK);
+        if (duplicated < 0 && errno == EINTR) {
+            continue;
+        }
+        if (duplicated <= 0) {
+            // EOF, or the archive is full and this block goes unarchived
+            ssize_t n = ::read(fd, buffer, size);
+            if (n > 0) {
+                dropped += n;
+            }
+            return n;
+        }
+
+        // Read exactly what was archived so both copies stay aligned
+        size_t got = 0;
+        while (got < static_cast<size_t>(duplicated)) {
+            ssize_t n = ::read(fd, buffer + got, duplicated - got);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+        archived += got;
+        return static_cast<ssize_t>(got);
+    }
+}
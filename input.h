@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <sys/types.h>
+
+
+// Where LineReader gets its bytes from
+class InputSource {
+public:
+    virtual ~InputSource() = default;
+
+    // Same contract as read(2): bytes read, 0 at EOF, -1 with errno set
+    virtual ssize_t read(char *buffer, size_t size) = 0;
+
+    // The whole input, when it is mapped into memory; LineReader then splits it in place
+    virtual std::string_view mapped() const {
+        return {};
+    }
+};
+
+// SIGINT/SIGTERM are for the reading thread: call before starting any thread, so that every helper
+// thread inherits them blocked
+void block_stop_signals();
+
+// Stdin mode: SIGINT/SIGTERM end the input as if it hit EOF, so the sinks still close their files
+// properly. The reads below return 0 once a stop was requested. Unblocks them on the calling thread,
+// the reading one; a stop requested since block_stop_signals() is taken now.
+void install_stop_handler();
+
+bool stop_requested();
+
+class FdInput : public InputSource {
+private:
+    int fd;
+
+public:
+    explicit FdInput(int input_fd) : fd(input_fd) {
+    }
+
+    ssize_t read(char *buffer, size_t size) override;
+};
+
+// --latency: the fd is made non-blocking and read() spins on EAGAIN instead of sleeping in the
+// kernel, so a line is picked up as soon as it is written, at the cost of one busy CPU (pin it
+// with --cpu parser=<n>). Remembers when the last bytes arrived. The flags are restored at the
+// end, since the open file description is shared with whoever started the parser.
+class BusyPollInput : public InputSource {
+private:
+    int fd;
+    int flags;
+    int64_t last_read = 0;
+
+public:
+    explicit BusyPollInput(int input_fd);
+
+    ~BusyPollInput() override;
+
+    ssize_t read(char *buffer, size_t size) override;
+
+    // CLOCK_MONOTONIC nanoseconds of the last read that returned data
+    int64_t last_read_ns() const {
+        return last_read;
+    }
+};
+
+// Stdin as a regular file with --huge-pages: mapped read-only (MADV_HUGEPAGE, so the page cache
+// can back it with huge pages), and parsed without copying. Covers the file as it was when opened;
+// truncating it while it is parsed raises SIGBUS, so a log still being written should be piped in.
+class MappedInput : public InputSource {
+private:
+    char *base = nullptr;
+    size_t length = 0;
+    size_t position = 0; // for read()
+
+public:
+    // is_mapped() tells whether it worked; fd is not a regular file, empty, or mmap failed otherwise
+    explicit MappedInput(int fd);
+
+    ~MappedInput() override;
+
+    bool is_mapped() const {
+        return base != nullptr;
+    }
+
+    ssize_t read(char *buffer, size_t size) override;
+
+    std::string_view mapped() const override {
+        return {base, length};
+    }
+};
+
+/* --tee: archive the raw input while parsing it
+ *
+ * With a pipe on stdin, tee(2) duplicates the queued bytes into a private archive pipe without
+ * consuming them, then the parser read(2)s exactly the duplicated amount. A writer thread
+ * splice(2)s the archive pipe into the file, so the log never passes through user space for the
+ * archive. Both tee and the archive pipe are non-blocking: when the disk falls behind and the
+ * archive pipe is full, the parser keeps reading and the skipped bytes are counted instead.
+ * Input that is not a pipe is copied into the archive pipe with write(2), with the same rule.
+ */
+class TeeInput : public InputSource {
+private:
+    int fd;
+    int file_fd = -1;
+    int archive_pipe[2] = {-1, -1};
+    bool input_is_pipe = false;
+    std::thread writer;
+    uint64_t archived = 0;
+    uint64_t dropped = 0;
+    int write_error = 0; // errno of a failed splice, read after the writer is joined
+
+    void drain();
+
+public:
+    TeeInput(int input_fd, const std::string &path);
+
+    ~TeeInput() override;
+
+    bool is_open() const {
+        return file_fd >= 0;
+    }
+
+    ssize_t read(char *buffer, size_t size) override;
+
+    // Stops the writer thread once everything queued is on disk
+    void close();
+
+    uint64_t archived_bytes() const {
+        return archived;
+    }
+
+    uint64_t dropped_bytes() const {
+        return dropped;
+    }
+
+    int error() const {
+        return write_error;
+    }
+};
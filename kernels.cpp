@@ -0,0 +1,211 @@
+#include "kernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GNB_X86 1
+#endif
+
+
+namespace {
+    inline bool is_digit(char c) {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    const char *index_newlines_scalar(const char *p, const char *end, const char **lines, size_t &count,
+                                      size_t capacity) {
+        while (p < end && count < capacity) {
+            const void *hit = std::memchr(p, '\n', end - p);
+            if (!hit) {
+                return end;
+            }
+            lines[count++] = static_cast<const char *>(hit);
+            p = lines[count - 1] + 1;
+        }
+        return p;
+    }
+
+    // Turns a block's match mask into line positions, one iteration per newline
+    inline void emit_newlines(const char *block, uint64_t mask, const char **lines, size_t &count) {
+        while (mask) {
+            lines[count++] = block + std::countr_zero(mask);
+            mask &= mask - 1;
+        }
+    }
+
+    size_t digit_run_scalar(const char *begin, const char *end) {
+        const char *p = begin;
+        while (p < end && is_digit(*p)) {
+            p++;
+        }
+        return p - begin;
+    }
+
+#ifdef GNB_X86
+    // Full vectors only; the tail of the buffer is finished by the scalar code so nothing is read past end
+
+    __attribute__((target("sse2")))
+    const char *index_newlines_sse2(const char *p, const char *end, const char **lines, size_t &count,
+                                    size_t capacity) {
+        const __m128i nl = _mm_set1_epi8('\n');
+        for (; end - p >= 16 && capacity - count >= newline_batch; p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            emit_newlines(p, static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))), lines, count);
+        }
+        return index_newlines_scalar(p, end, lines, count, capacity);
+    }
+
+    __attribute__((target("sse2")))
+    size_t digit_run_sse2(const char *begin, const char *end) {
+        if (begin == end || !is_digit(*begin)) {
+            return 0;
+        }
+        const __m128i lo = _mm_set1_epi8('0' - 1);
+        const __m128i hi = _mm_set1_epi8('9' + 1);
+        const char *p = begin;
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+            unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(digits)) & 0xffff;
+            if (other) {
+                return p - begin + std::countr_zero(other);
+            }
+        }
+        return p - begin + digit_run_scalar(p, end);
+    }
+
+    __attribute__((target("avx2")))
+    const char *index_newlines_avx2(const char *p, const char *end, const char **lines, size_t &count,
+                                    size_t capacity) {
+        const __m256i nl = _mm256_set1_epi8('\n');
+        for (; end - p >= 64 && capacity - count >= newline_batch; p += 64) {
+            __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), nl);
+            __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32)), nl);
+            uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(a)) |
+                            static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(b))) << 32;
+            emit_newlines(p, mask, lines, count);
+        }
+        return index_newlines_scalar(p, end, lines, count, capacity);
+    }
+
+    __attribute__((target("avx2")))
+    size_t digit_run_avx2(const char *begin, const char *end) {
+        if (begin == end || !is_digit(*begin)) {
+            return 0;
+        }
+        const __m256i lo = _mm256_set1_epi8('0' - 1);
+        const __m256i hi = _mm256_set1_epi8('9' + 1);
+        const char *p = begin;
+        for (; end - p >= 32; p += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i digits = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+            uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(digits));
+            if (other) {
+                return p - begin + std::countr_zero(other);
+            }
+        }
+        return p - begin + digit_run_sse2(p, end);
+    }
+
+    // AVX-512BW masked loads suppress faults on masked-off lanes, so the tail needs no scalar loop
+
+    __attribute__((target("avx512f,avx512bw")))
+    const char *index_newlines_avx512(const char *p, const char *end, const char **lines, size_t &count,
+                                      size_t capacity) {
+        const __m512i nl = _mm512_set1_epi8('\n');
+        for (; end - p >= 64 && capacity - count >= newline_batch; p += 64) {
+            emit_newlines(p, _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), nl), lines, count);
+        }
+        if (p < end && end - p < 64 && capacity - count >= newline_batch) {
+            __mmask64 valid = (uint64_t(1) << (end - p)) - 1;
+            __m512i v = _mm512_maskz_loadu_epi8(valid, p);
+            emit_newlines(p, _mm512_mask_cmpeq_epi8_mask(valid, v, nl), lines, count);
+            p = end;
+        }
+        return p;
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    size_t digit_run_avx512(const char *begin, const char *end) {
+        if (begin == end || !is_digit(*begin)) {
+            return 0;
+        }
+        const __m512i zero = _mm512_set1_epi8('0');
+        const __m512i ten = _mm512_set1_epi8(10);
+        const char *p = begin;
+        while (p < end) {
+            size_t left = end - p;
+            __mmask64 valid = left >= 64 ? ~uint64_t(0) : (uint64_t(1) << left) - 1;
+            __m512i v = _mm512_sub_epi8(_mm512_maskz_loadu_epi8(valid, p), zero);
+            uint64_t other = ~_mm512_mask_cmplt_epu8_mask(valid, v, ten);
+            if (other) {
+                return p - begin + std::countr_zero(other);
+            }
+            p += 64;
+        }
+        return end - begin;
+    }
+#endif
+
+    constexpr Kernels scalar_kernels{Isa::Scalar, "scalar", index_newlines_scalar, digit_run_scalar};
+#ifdef GNB_X86
+    constexpr Kernels sse2_kernels{Isa::SSE2, "sse2", index_newlines_sse2, digit_run_sse2};
+    constexpr Kernels avx2_kernels{Isa::AVX2, "avx2", index_newlines_avx2, digit_run_avx2};
+    constexpr Kernels avx512_kernels{Isa::AVX512, "avx512", index_newlines_avx512, digit_run_avx512};
+
+    // The default on AVX2/AVX-512 hosts: digit runs in the log are short (RNTIs, counters), so one
+    // 16-byte step answers nearly every call and wider loads only add latency; --bench measures the
+    // SSE2 digit kernel ahead of the AVX2 and AVX-512 ones. Newline scanning streams whole buffers
+    // and keeps the widest variant.
+    constexpr Kernels avx2_mixed_kernels{Isa::AVX2, "avx2+sse2", index_newlines_avx2, digit_run_sse2};
+    constexpr Kernels avx512_mixed_kernels{Isa::AVX512, "avx512+sse2", index_newlines_avx512, digit_run_sse2};
+#endif
+
+    const Kernels *detect_kernels() {
+        std::vector<const Kernels *> usable = supported_kernels();
+        const Kernels *widest = usable.back();
+#ifdef GNB_X86
+        if (widest == &avx512_kernels) {
+            return &avx512_mixed_kernels;
+        }
+        if (widest == &avx2_kernels) {
+            return &avx2_mixed_kernels;
+        }
+#endif
+        return widest;
+    }
+}
+
+namespace detail {
+    const Kernels *active_kernels = detect_kernels();
+}
+
+std::vector<const Kernels *> supported_kernels() {
+    std::vector<const Kernels *> usable{&scalar_kernels};
+#ifdef GNB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        usable.push_back(&sse2_kernels);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        usable.push_back(&avx2_kernels);
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        usable.push_back(&avx512_kernels);
+    }
+#endif
+    return usable;
+}
+
+bool select_kernels(std::string_view name) {
+    for (const Kernels *k: supported_kernels()) {
+        if (name == k->name) {
+            detail::active_kernels = k;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+/* Hot scanning kernels
+ *
+ * Every kernel is built for several instruction sets inside the same binary (no -march flags),
+ * and the variants are picked once at startup via cpuid: the widest one the CPU supports for the
+ * newline scan, SSE2 for the short digit runs (see detect_kernels). --isa forces one instruction
+ * set for both. The scalar variant is portable and is the only one compiled on non-x86 targets.
+ */
+
+enum class Isa {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// Newline positions one vector step can produce at most
+constexpr size_t newline_batch = 64;
+
+struct Kernels {
+    Isa isa;
+    const char *name;
+
+    // Appends the position of every '\n' in [begin, end) to lines until capacity is reached (vector
+    // variants may stop up to newline_batch slots early). Returns where scanning stopped.
+    const char *(*index_newlines)(const char *begin, const char *end, const char **lines, size_t &count,
+                                  size_t capacity);
+
+    // Length of the run of ASCII digits starting at begin
+    size_t (*digit_run)(const char *begin, const char *end);
+};
+
+namespace detail {
+    extern const Kernels *active_kernels;
+}
+
+// Variant selected at startup
+inline const Kernels &kernels() {
+    return *detail::active_kernels;
+}
+
+// Variants usable on this CPU, slowest first
+std::vector<const Kernels *> supported_kernels();
+
+// Force a variant by name ("scalar", "sse2", "avx2", "avx512"); fails if the CPU lacks it
+bool select_kernels(std::string_view name);
+
+// Parse an unsigned decimal at p, returns the first byte past the digits (p itself if there are none)
+inline const char *parse_digits(const char *p, const char *end, uint64_t &value) {
+    size_t len = kernels().digit_run(p, end);
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; i++) {
+        v = v * 10 + static_cast<uint64_t>(p[i] - '0');
+    }
+    value = v;
+    return p + len;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+
+#include "huge_pages.h"
+#include "input.h"
+#include "kernels.h"
+
+
+// Calls on_line(std::string_view) for every complete line in [begin, end), without the '\n'. The
+// bytes before scan_from are known to hold no newline. Returns the start of the trailing partial line.
+template<class F>
+const char *split_lines(const char *begin, const char *scan_from, const char *end, F &&on_line) {
+    constexpr size_t line_batch = 1024;
+    const char *lines[line_batch];
+    const char *start = begin;
+    const char *p = scan_from;
+    while (p < end) {
+        size_t count = 0;
+        p = kernels().index_newlines(p, end, lines, count, line_batch);
+        for (size_t i = 0; i < count; i++) {
+            on_line(std::string_view(start, lines[i] - start));
+            start = lines[i] + 1;
+        }
+    }
+    return start;
+}
+
+// Reads an input in large blocks and hands out complete lines without copying them.
+// A line that does not fit into the buffer grows it. A mapped input is split in place, one
+// block at a time.
+class LineReader {
+private:
+    InputSource &input;
+    size_t block;
+    PageBuffer buffer;
+
+    template<class F, class G>
+    void split_mapped(std::string_view mapped, F &&on_line, G &&after_read) {
+        const char *start = mapped.data();
+        const char *scanned = start;
+        const char *end = start + mapped.size();
+        while (scanned < end && !stop_requested()) {
+            const char *block_end = std::min(end, scanned + block);
+            start = split_lines(start, scanned, block_end, on_line);
+            scanned = block_end;
+            after_read();
+        }
+        if (scanned == end && start < end) {
+            on_line(std::string_view(start, end - start));
+        }
+    }
+
+public:
+    explicit LineReader(InputSource &source, size_t buffer_size = 1024 * 1024) : input(source), block(buffer_size) {
+    }
+
+    // Calls on_line(std::string_view) for every line (without the '\n') until EOF
+    template<class F>
+    void for_each_line(F &&on_line) {
+        for_each_line(on_line, [] {
+        });
+    }
+
+    // Same, and calls after_read() once the lines of each block read from the input are handled
+    template<class F, class G>
+    void for_each_line(F &&on_line, G &&after_read) {
+        if (std::string_view mapped = input.mapped(); !mapped.empty()) {
+            split_mapped(mapped, on_line, after_read);
+            return;
+        }
+
+        buffer.resize(block);
+        size_t filled = 0;
+        size_t scanned = 0;
+
+        while (true) {
+            if (filled == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+
+            ssize_t n = input.read(buffer.data() + filled, buffer.size() - filled);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            filled += n;
+
+            const char *end = buffer.data() + filled;
+            const char *start = split_lines(buffer.data(), buffer.data() + scanned, end, on_line);
+
+            // Keep the partial line for the next read
+            size_t rest = end - start;
+            std::memmove(buffer.data(), start, rest);
+            filled = rest;
+            scanned = rest;
+
+            after_read();
+        }
+
+        if (filled > 0) {
+            on_line(std::string_view(buffer.data(), filled));
+        }
+    }
+};
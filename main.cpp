@@ -1,234 +1,677 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <regex>
-#include <map>
-
-
-/* Example Frame Slot format
- *
- *   [NR_MAC]   Frame.Slot 128.0
- *   UE RNTI 928c CU-UE-ID 1 in-sync PH 45 dB PCMAX 21 dBm, average RSRP -83 (17 meas)
- *   UE 928c: CQI 13, RI 2, PMI (0,0)
- *   UE 928c: UL-RI 1, TPMI 0
- *   UE 928c: dlsch_rounds 681/10/1/0, dlsch_errors 0, pucch0_DTX 9, BLER 0.02678 MCS (1) 22
- *   UE 928c: ulsch_rounds 1136/77/0/0, ulsch_errors 0, ulsch_DTX 0, BLER 0.07390 MCS (1) 6 (Qm 4 deltaMCS 0 dB) NPRB 106  SNR 17.5 dB
- *   UE 928c: MAC:    TX         344885 RX        2627890 bytes
- *   UE 928c: LCID 1: TX            369 RX           1074 bytes
- *   UE 928c: LCID 2: TX              3 RX             25 bytes
- *   UE 928c: LCID 4: TX          43621 RX        2616709 bytes
- *   UE RNTI 6542 CU-UE-ID 1 in-sync PH 45 dB PCMAX 21 dBm, average RSRP -83 (17 meas)
- */
-
-
-struct UEData {
-    std::string rnti; // UE ID
-    std::string state; // In-sync or Out-of-sync
-    double rsrp; // Reference Signals Received Power (DOWNLINK)
-    int pcmax; // Maximum UL Channel Transmit Power (dBm)
-    int ue_id; // User Equipment ID
-    int ph; // Power Headroom
-    int cqi; // Channel Quality Index
-    int dl_ri; // Downlink Rank Indicator
-    int ul_ri; // Uplink Rank Indicator
-    int dlsch_err; // Downlink Scheduling Errors
-    int pucch_dtx; // PUCCH Discontinuous Transmission
-    double dl_bler; // Downlink Block Error Rate
-    int dl_mcs; // Downlink MCS
-    int ulsch_err; // Uplink Scheduling Errors
-    int ulsch_dtx; // Uplink Scheduling Discontinuous Transmissions
-    double ul_bler; // Uplink Block Error Rate
-    int ul_mcs; // Uplink MCS
-    int nprb; // Number of PRB
-    double snr; // Signal to Noise
-    time_t timestamp; // Timestamp
-};
-
-class Parser {
-private:
-    std::map<std::string, std::ofstream> ue_file_handler;
-    std::ofstream combined_file;
-    bool export_combined;
-    std::string filename;
-
-    std::map<std::string, UEData> temp_ue_data;
-
-
-    // Define regex patterns as class members to compile them once
-    std::regex ue_basic_pattern;
-    std::regex ue_indicators_1;
-    std::regex ue_indicators_2;
-    std::regex dl_phy;
-    std::regex ul_phy;
-
-public:
-    explicit Parser(const std::string &file_name, bool exportCombined = true) : filename(file_name),
-        export_combined(exportCombined),
-
-        ue_basic_pattern(R"(UE RNTI (\w+) CU-UE-ID (\d+) (\w+-\w+) PH (\d+) dB PCMAX (\d+) dBm, average RSRP (-?\d+))"),
-        ue_indicators_1(R"(UE (\w+): CQI (\d+), RI (\d+))"),
-        ue_indicators_2(R"(UE (\w+): UL-RI (\d+))"),
-        dl_phy(R"(UE (\w+):.+ dlsch_errors (\d+), pucch0_DTX (\d+), BLER ([0-9.]+) MCS .+ (\d+))"),
-        ul_phy(
-            R"(UE (\w+):.+ ulsch_errors (\d+), ulsch_DTX (\d+), BLER ([0-9.]+) MCS \(1\) (\d+) .+ NPRB (\d+)  SNR ([0-9.]+))") {
-        if (export_combined) {
-            combined_file.open(filename + ".csv", std::ios::binary);
-            std::vector<char> buffer(1024 * 1024);
-            combined_file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
-
-            // Write CSV header
-            combined_file << "timestamp,rnti,ue_id,state,ph,pcmax,rsrp,cqi,dl_ri,ul_ri,"
-                    << "dlsch_err,pucch_dtx,dl_bler,dl_mcs,ulsch_err,ulsch_dtx,"
-                    << "ul_bler,ul_mcs,nprb,snr" << std::endl;
-        }
-    }
-
-    ~Parser() {
-        if (export_combined) {
-            combined_file.close();
-        }
-
-        for (auto &[rnti, file]: ue_file_handler) {
-            file.close();
-        }
-    }
-
-    void store_data(const std::string &rnti) {
-        UEData &data = temp_ue_data[rnti];
-
-        if (export_combined) {
-            char timeBuffer[300];
-            strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", localtime(&data.timestamp));
-            combined_file << timeBuffer << ","
-                    << data.rnti << ","
-                    << data.ue_id << ","
-                    << data.state << ","
-                    << data.ph << ","
-                    << data.pcmax << ","
-                    << data.rsrp << ","
-                    << data.cqi << ","
-                    << data.dl_ri << ","
-                    << data.ul_ri << ","
-                    << data.dlsch_err << ","
-                    << data.pucch_dtx << ","
-                    << data.dl_bler << ","
-                    << data.dl_mcs << ","
-                    << data.ulsch_err << ","
-                    << data.ulsch_dtx << ","
-                    << data.ul_bler << ","
-                    << data.ul_mcs << ","
-                    << data.nprb << ","
-                    << data.snr << std::endl;
-        }
-
-        if (!export_combined) {
-            // If the file handler doesn't exist yet, create it
-            if (ue_file_handler.find(rnti) == ue_file_handler.end()) {
-                std::string ueFile = filename + "_" + rnti + ".csv";
-                ue_file_handler[rnti].open(ueFile, std::ios::binary);
-                std::vector<char> buffer(1024 * 1024);
-                ue_file_handler[rnti].rdbuf()->pubsetbuf(buffer.data(), buffer.size());
-
-                // Write header to the new file
-                ue_file_handler[rnti] << "timestamp,rnti,ue_id,state,ph,pcmax,rsrp,cqi,dl_ri,ul_ri,"
-                        << "dlsch_err,pucch_dtx,dl_bler,dl_mcs,ulsch_err,ulsch_dtx,"
-                        << "ul_bler,ul_mcs,nprb,snr" << std::endl;
-            }
-
-            // Write the data
-            char timeBuffer[30];
-            strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", localtime(&data.timestamp));
-
-            ue_file_handler[rnti] << timeBuffer << ","
-                    << data.rnti << ","
-                    << data.ue_id << ","
-                    << data.state << ","
-                    << data.ph << ","
-                    << data.pcmax << ","
-                    << data.rsrp << ","
-                    << data.cqi << ","
-                    << data.dl_ri << ","
-                    << data.ul_ri << ","
-                    << data.dlsch_err << ","
-                    << data.pucch_dtx << ","
-                    << data.dl_bler << ","
-                    << data.dl_mcs << ","
-                    << data.ulsch_err << ","
-                    << data.ulsch_dtx << ","
-                    << data.ul_bler << ","
-                    << data.ul_mcs << ","
-                    << data.nprb << ","
-                    << data.snr << std::endl;
-        }
-
-        // Only clear this RNTI's data
-        temp_ue_data.erase(rnti);
-    }
-
-    void create_ue_data(const std::string &rnti) {
-        if (temp_ue_data.find(rnti) == temp_ue_data.end()) {
-            temp_ue_data[rnti] = UEData();
-            temp_ue_data[rnti].rnti = rnti;
-            temp_ue_data[rnti].timestamp = std::time(nullptr);
-        }
-    }
-
-    void parse_line(const std::string &line) {
-        std::smatch matches;
-        std::string rnti;
-
-        if (std::regex_search(line, matches, ue_basic_pattern)) {
-            rnti = matches[1];
-            create_ue_data(rnti);
-            temp_ue_data[rnti].timestamp = std::time(nullptr);
-            temp_ue_data[rnti].ue_id = std::stoi(matches[2]);
-            temp_ue_data[rnti].state = matches[3];
-            temp_ue_data[rnti].ph = std::stoi(matches[4]);
-            temp_ue_data[rnti].pcmax = std::stoi(matches[5]);
-            temp_ue_data[rnti].rsrp = std::stoi(matches[6]);
-        } else if (std::regex_search(line, matches, ue_indicators_1)) {
-            rnti = matches[1];
-            temp_ue_data[rnti].cqi = std::stoi(matches[2]);
-            temp_ue_data[rnti].dl_ri = std::stoi(matches[3]);
-        } else if (std::regex_search(line, matches, ue_indicators_2)) {
-            rnti = matches[1];
-            temp_ue_data[rnti].ul_ri = std::stoi(matches[2]);
-        } else if (std::regex_search(line, matches, dl_phy)) {
-            rnti = matches[1];
-            temp_ue_data[rnti].dlsch_err = std::stoi(matches[2]);
-            temp_ue_data[rnti].pucch_dtx = std::stoi(matches[3]);
-            temp_ue_data[rnti].dl_bler = std::stod(matches[4]);
-            temp_ue_data[rnti].dl_mcs = std::stoi(matches[5]);
-        } else if (std::regex_search(line, matches, ul_phy)) {
-            rnti = matches[1];
-            temp_ue_data[rnti].ulsch_err = std::stoi(matches[2]);
-            temp_ue_data[rnti].ulsch_dtx = std::stoi(matches[3]);
-            temp_ue_data[rnti].ul_bler = std::stod(matches[4]);
-            temp_ue_data[rnti].ul_mcs = std::stoi(matches[5]);
-
-            temp_ue_data[rnti].nprb = std::stoi(matches[6]);
-            temp_ue_data[rnti].snr = std::stod(matches[7]);
-            store_data(rnti);
-        } else { ; }
-    }
-};
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <unistd.h>
 
+#include "async_writer.h"
+#include "bench.h"
+#include "checkpoint.h"
+#include "columns.h"
+#include "compression.h"
+#include "csv_output.h"
+#include "dashboard.h"
+#include "delta_output.h"
+#include "huge_pages.h"
+#include "input.h"
+#include "kernels.h"
+#include "line_reader.h"
+#include "multi_input.h"
+#include "output_file.h"
+#include "overload.h"
+#include "parquet_output.h"
+#include "parser.h"
+#include "placement.h"
+#include "publisher.h"
+#include "rotation.h"
+#include "series_output.h"
+#include "snapshot_export.h"
+#include "sqlite_output.h"
+#include "subscribers.h"
+#include "summary_exporter.h"
+#include "ue_history.h"
+#include "ue_filter.h"
+
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] < gnb.log\n"
+            << "       " << program << " [options] --input <spec> [--input <spec> ...]\n"
+            << "  --input <spec>      read a gNB log from [name=][follow:|unix:]path instead of stdin; repeat\n"
+            << "                      for several gNBs (a FIFO path is detected, follow: tails a file,\n"
+            << "                      unix: listens on a socket); rows get a source column\n"
+            << "  --workers <n>       parser threads for --input (default: one per input, at most 4)\n"
+            << "  --sep               write one CSV per UE instead of a combined file\n"
+            << "  --columns <list>    only extract and write these columns, e.g. rnti,timestamp,dl_bler\n"
+            << "                      (mac_tx and mac_rx, the MAC byte counters, are only written when listed)\n"
+            << "  --rnti <list>       only keep UEs with these RNTIs, e.g. 928c,6542\n"
+            << "  --ue-id <list>      only keep UEs with these CU-UE-IDs (combined with --rnti: either matches)\n"
+            << "  --shed              when reading a pipe, shed load instead of blocking the gNB (see *.shed.log);\n"
+            << "                      --format csv only, without --export, --subscribe, --history, --snapshot*,\n"
+            << "                      --tui or --latency\n"
+            << "  --tee <file>        archive the raw input to file (zero-copy from a pipe, never blocks parsing)\n"
+            << "  --export <endpoint> send per-cell summaries to gnb_aggregator at unix:/path or tcp:host:port\n"
+            << "  --export-name <n>   cell name in the summaries (default: host name; inputs are appended)\n"
+            << "  --export-interval <s> seconds between summaries (default 10)\n"
+            << "  --isa <name>        force the scan kernels (scalar, sse2, avx2, avx512)\n"
+            << "  --format <name>     csv (default), csv-delta or binary-delta: per UE only the fields that\n"
+            << "                      changed, with a full keyframe row every --keyframe rows; series:\n"
+            << "                      per-UE blocks with delta-of-delta integers and XOR-compressed reals;\n"
+            << "                      parquet: row groups with dictionary/RLE encoded columns;\n"
+            << "                      sqlite: table ue_metrics, indexed on (source, rnti, timestamp) at exit\n"
+            << "  --compress <codec>  none (default) or zstd: write *.zst files, compressed on a writer thread\n"
+            << "                      (parquet: the pages are compressed instead; not for sqlite)\n"
+            << "  --compress-level <n> zstd level, 1-19 (default 3)\n"
+            << "  --frame-interval <ms> seal a zstd frame at least this often, the most a crash loses (default 1000)\n"
+            << "  --writer <mode>     sync (default); async: write the uncompressed files through io_uring (a\n"
+            << "                      thread pool where io_uring is unavailable); threads: always the pool\n"
+            << "  --max-delay <ms>    CSV rows wait at most this long to be written, in batches sized to the\n"
+            << "                      arrival rate: each row at once when UEs are few, large writes under\n"
+            << "                      replay (default 50; 0 writes every row at once); --tui shows the size\n"
+            << "  --direct            keep the output out of the page cache: O_DIRECT with aligned blocks, or\n"
+            << "                      written ranges dropped with fadvise where O_DIRECT is not supported\n"
+            << "  --cpu [role=]<cpus> pin threads to CPUs, e.g. 6-7 or parser=6 (roles: reader, parser, writer);\n"
+            << "                      repeat per role\n"
+            << "  --nice <n>          run every thread at this nice value\n"
+            << "  --idle              SCHED_IDLE: only use CPU time nothing else wants\n"
+            << "  --mlock             lock all memory, pre-faulting buffers, so parsing never waits on a page fault\n"
+            << "  --huge-pages <kind> thp or hugetlb: put the read, O_DIRECT and --history buffers on 2 MiB pages\n"
+            << "                      (falling back to thp, then 4 KiB pages); a regular file on stdin is mapped\n"
+            << "  --latency <target>  publish every record as it completes to shm:<name> (a seqlock ring in\n"
+            << "                      /dev/shm, see publisher.h) or unix:<path> (one datagram each); stdin is\n"
+            << "                      busy-polled, and the read-to-publish latency is printed at the end\n"
+            << "  --subscribe <endpoint> serve records to local tools at unix:<path>: each sends a line such as\n"
+            << "                      \"rnti=928c columns=rnti,dl_bler sample=10\" and reads a binary-delta stream\n"
+            << "                      (see subscribers.h); a slow one loses records, never the parser\n"
+            << "  --tui               show a live UE table on the terminal (stdout, or /dev/tty when stdout is not one)\n"
+            << "  --tui-refresh <ms>  milliseconds between --tui frames (default 250)\n"
+            << "  --history <endpoint> keep recent records per UE in memory and answer queries at unix:<path>,\n"
+            << "                      e.g. \"rnti=928c last=60 step=5 columns=snr\" (see ue_history.h)\n"
+            << "  --history-budget <n> memory for --history, oldest records evicted first (default 64M)\n"
+            << "  --snapshot <file>   on SIGUSR2, write every UE's latest record plus per-input aggregates to\n"
+            << "                      file, without pausing the parsers (see snapshot_export.h)\n"
+            << "  --snapshot-socket <endpoint> send the same snapshot to every client connecting to unix:<path>\n"
+            << "  --checkpoint <file> keep the parser state in file (every --checkpoint-interval seconds, default\n"
+            << "                      10, and at the end) and continue from it at startup, appending to the\n"
+            << "                      CSV, delta, series and sqlite output; stdin only, not with parquet\n"
+            << "  --checkpoint-interval <s> seconds between checkpoints (default 10)\n"
+            << "  --rotate-size <n>   start a new CSV segment (<name>.0001.csv, ...) after n bytes; K, M, G suffixes\n"
+            << "  --rotate-every <s>  start a new CSV segment on every multiple of s seconds (of the timestamps)\n"
+            << "  --keyframe <n>      rows per UE between keyframes for the delta formats (default 32)\n"
+            << "  --decode <file>     write the full CSV of a csv-delta, binary-delta or series file (.zst too) to stdout\n"
+            << "  --bench [file]      benchmark every kernel variant on a log (synthetic if omitted)\n";
+}
+
+// A whole-string number within [low, high] for a numeric flag, or a usage error naming the flag
+template<class T>
+bool parse_number(const char *flag, const std::string &text, T low, T high, T &value) {
+    T parsed{};
+    auto [end, code] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (code != std::errc() || end != text.data() + text.size() || !(parsed >= low && parsed <= high)) {
+        std::cerr << "Invalid " << flag << ": " << text << " (" << low << " to " << high << ")" << std::endl;
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// "512M" and the like
+bool parse_size(const std::string &text, uint64_t &bytes) {
+    auto [end, code] = std::from_chars(text.data(), text.data() + text.size(), bytes);
+    if (code != std::errc()) {
+        return false;
+    }
+    std::string_view suffix(end, text.data() + text.size() - end);
+    unsigned shift = suffix.empty() ? 0 : suffix == "K" ? 10 : suffix == "M" ? 20 : suffix == "G" ? 30 : 64;
+    if (shift == 64 || bytes > UINT64_MAX >> shift) {
+        return false;
+    }
+    bytes <<= shift;
+    return bytes > 0;
+}
 
 int main(int argc, char *argv[]) {
-    std::string line;
     std::string outputFile = "ue_metrics";
     bool exportCombined = true;
+    ColumnMask columns = default_columns;
+    bool columnsGiven = false;
+    UEFilter filter;
+    bool shed = false;
+    std::string teeFile;
+    std::string format = "csv";
+    unsigned keyframeInterval = 32;
+    std::string decodeFile;
+    std::string compress = "none";
+    int compressLevel = 3;
+    long frameInterval = 1000;
+    RotationPolicy rotationPolicy;
+    std::string writerMode = "sync";
+    bool direct = false;
+    int niceValue = 0;
+    bool idle = false;
+    bool lockMemory = false;
+    HugePages hugePages = HugePages::Off;
+    std::string latencyTarget;
+    std::string subscribeEndpoint;
+    bool tui = false;
+    long tuiRefresh = 250;
+    std::string historyEndpoint;
+    uint64_t historyBudget = 64 << 20;
+    std::string snapshotFile;
+    std::string snapshotEndpoint;
+    std::string checkpointFile;
+    double checkpointInterval = 10;
+    long maxDelay = 50;
+    bool maxDelayGiven = false;
+    bool bench = false;
+    std::string benchFile;
+    std::vector<SourceSpec> inputs;
+    unsigned workers = 0;
+    std::string exportEndpoint;
+    std::string exportName;
+    double exportInterval = 10;
 
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--sep") {
             exportCombined = false;
+        } else if (arg == "--columns" && i + 1 < argc) {
+            std::string unknown;
+            if (!parse_columns(argv[++i], columns, unknown)) {
+                std::cerr << "Unknown column in --columns: " << unknown << std::endl;
+                return 1;
+            }
+            columnsGiven = true;
+        } else if (arg == "--input" && i + 1 < argc) {
+            SourceSpec spec;
+            std::string error;
+            if (!parse_source_spec(argv[++i], spec, error)) {
+                std::cerr << "Invalid --input: " << error << std::endl;
+                return 1;
+            }
+            inputs.push_back(spec);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            if (!parse_number("--workers", argv[++i], 1u, 256u, workers)) {
+                return 1;
+            }
+        } else if ((arg == "--rnti" || arg == "--ue-id") && i + 1 < argc) {
+            std::string invalid;
+            bool ok = arg == "--rnti" ? filter.add_rntis(argv[++i], invalid) : filter.add_ue_ids(argv[++i], invalid);
+            if (!ok) {
+                std::cerr << "Invalid entry in " << arg << ": " << invalid << std::endl;
+                return 1;
+            }
+        } else if (arg == "--export" && i + 1 < argc) {
+            exportEndpoint = argv[++i];
+        } else if (arg == "--export-name" && i + 1 < argc) {
+            exportName = argv[++i];
+        } else if (arg == "--export-interval" && i + 1 < argc) {
+            if (!parse_number("--export-interval", argv[++i], 0.001, 86400.0, exportInterval)) {
+                return 1;
+            }
+        } else if (arg == "--tee" && i + 1 < argc) {
+            teeFile = argv[++i];
+        } else if (arg == "--shed") {
+            shed = true;
+        } else if (arg == "--isa" && i + 1 < argc) {
+            // Downgrade the kernels picked via cpuid, e.g. to compare variants on one host
+            if (!select_kernels(argv[++i])) {
+                std::cerr << "Kernels '" << argv[i] << "' not supported on this CPU, using "
+                        << kernels().name << std::endl;
+            }
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+            if (format != "csv" && format != "csv-delta" && format != "binary-delta" &&
+                format != "series" && format != "parquet" && format != "sqlite") {
+                std::cerr << "Unknown --format: " << format << std::endl;
+                return 1;
+            }
+            if (format == "sqlite" && !sqlite_available()) {
+                std::cerr << "--format sqlite: built without SQLite" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--compress" && i + 1 < argc) {
+            compress = argv[++i];
+            if (compress != "none" && compress != "zstd") {
+                std::cerr << "Unknown --compress codec: " << compress << std::endl;
+                return 1;
+            }
+            if (compress == "zstd" && !zstd_available()) {
+                std::cerr << "--compress zstd: built without zstd" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--compress-level" && i + 1 < argc) {
+            if (!parse_number("--compress-level", argv[++i], 1, 19, compressLevel)) {
+                return 1;
+            }
+        } else if (arg == "--frame-interval" && i + 1 < argc) {
+            if (!parse_number("--frame-interval", argv[++i], 1l, 3600000l, frameInterval)) {
+                return 1;
+            }
+        } else if (arg == "--writer" && i + 1 < argc) {
+            writerMode = argv[++i];
+            if (writerMode != "sync" && writerMode != "async" && writerMode != "threads") {
+                std::cerr << "Unknown --writer: " << writerMode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--cpu" && i + 1 < argc) {
+            std::string error;
+            if (!add_cpu_spec(argv[++i], error)) {
+                std::cerr << "Invalid --cpu: " << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--nice" && i + 1 < argc) {
+            if (!parse_number("--nice", argv[++i], -20, 19, niceValue)) {
+                return 1;
+            }
+        } else if (arg == "--idle") {
+            idle = true;
+        } else if (arg == "--mlock") {
+            lockMemory = true;
+        } else if (arg == "--huge-pages" && i + 1 < argc) {
+            if (!parse_huge_pages(argv[++i], hugePages)) {
+                std::cerr << "Unknown --huge-pages: " << argv[i] << " (thp, hugetlb)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--max-delay" && i + 1 < argc) {
+            if (!parse_number("--max-delay", argv[++i], 0l, 60000l, maxDelay)) {
+                return 1;
+            }
+            maxDelayGiven = true;
+        } else if (arg == "--latency" && i + 1 < argc) {
+            latencyTarget = argv[++i];
+        } else if (arg == "--subscribe" && i + 1 < argc) {
+            subscribeEndpoint = argv[++i];
+        } else if (arg == "--tui") {
+            tui = true;
+        } else if (arg == "--tui-refresh" && i + 1 < argc) {
+            if (!parse_number("--tui-refresh", argv[++i], 10l, 60000l, tuiRefresh)) {
+                return 1;
+            }
+        } else if (arg == "--history" && i + 1 < argc) {
+            historyEndpoint = argv[++i];
+        } else if (arg == "--history-budget" && i + 1 < argc) {
+            if (!parse_size(argv[++i], historyBudget)) {
+                std::cerr << "Invalid --history-budget: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshotFile = argv[++i];
+        } else if (arg == "--snapshot-socket" && i + 1 < argc) {
+            snapshotEndpoint = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointFile = argv[++i];
+        } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            if (!parse_number("--checkpoint-interval", argv[++i], 0.1, 86400.0, checkpointInterval)) {
+                return 1;
+            }
+        } else if (arg == "--direct") {
+            direct = true;
+        } else if (arg == "--rotate-size" && i + 1 < argc) {
+            if (!parse_size(argv[++i], rotationPolicy.max_bytes)) {
+                std::cerr << "Invalid --rotate-size: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rotate-every" && i + 1 < argc) {
+            if (!parse_number("--rotate-every", argv[++i], 1l, 31622400l, rotationPolicy.every_seconds)) {
+                return 1;
+            }
+        } else if (arg == "--keyframe" && i + 1 < argc) {
+            if (!parse_number("--keyframe", argv[++i], 1u, 1000000u, keyframeInterval)) {
+                return 1;
+            }
+        } else if (arg == "--decode" && i + 1 < argc) {
+            decodeFile = argv[++i];
+        } else if (arg == "--bench") {
+            bench = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                benchFile = argv[++i];
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (bench) {
+        return run_bench(benchFile);
+    }
+    if (!decodeFile.empty()) {
+        return run_decode(decodeFile);
+    }
+    // Only the CSV output writes the columns shed empty: any other sink would pass on stale or zero
+    // values as if they had been parsed
+    bool recordsCopied = !exportEndpoint.empty() || !subscribeEndpoint.empty() || !historyEndpoint.empty() ||
+                         !snapshotFile.empty() || !snapshotEndpoint.empty() || tui || !latencyTarget.empty();
+    if (shed && inputs.empty() && (format != "csv" || recordsCopied)) {
+        std::cerr << "--shed only applies to --format csv without --export, --subscribe, --history, --snapshot, "
+                "--tui or --latency" << std::endl;
+        return 1;
+    }
+
+    // Before any thread starts; each thread places itself by role
+    set_thread_priority(niceValue, idle);
+    set_huge_pages(hugePages);
+    place_thread(inputs.empty() ? ThreadRole::Parser : ThreadRole::Reader);
+    block_stop_signals();
+    if (!snapshotFile.empty()) {
+        block_snapshot_signal();
+    }
+    if (lockMemory) {
+        std::string error;
+        if (!lock_memory(error)) {
+            std::cerr << "--mlock: " << error << ", continuing unlocked" << std::endl;
+        }
+    }
+
+    std::vector<std::string> sourceNames;
+    for (const SourceSpec &spec: inputs) {
+        sourceNames.push_back(spec.name);
+    }
+    if (sourceNames.empty()) {
+        sourceNames.push_back("stdin");
+    }
+    if (inputs.size() > 1 && !columnsGiven) {
+        columns |= column_bit(Column::Source);
+    }
+    // The MAC counters stay out of the default files, but --tui throughputs, --history and the
+    // --export top UEs are built from them
+    ColumnMask parsedColumns = columns;
+    if (!columnsGiven && (tui || !historyEndpoint.empty() || !exportEndpoint.empty())) {
+        parsedColumns |= mac_line_columns;
+    }
+
+    // Read before the outputs are opened: a restored run continues their files
+    LoadedCheckpoint restored;
+    bool restoring = false;
+    auto restoreStart = std::chrono::steady_clock::now();
+    if (!checkpointFile.empty()) {
+        if (!inputs.empty()) {
+            std::cerr << "--checkpoint applies to stdin, not --input" << std::endl;
+            return 1;
+        }
+        // A parquet file ends in its footer: a resumed run could only start it over
+        if (format == "parquet") {
+            std::cerr << "--checkpoint does not apply to --format parquet" << std::endl;
+            return 1;
+        }
+        std::string error;
+        restoring = restored.load(checkpointFile, parsedColumns, sourceNames, error);
+        if (!error.empty()) {
+            std::cerr << "--checkpoint: " << error << ", starting over" << std::endl;
+        }
+    }
+
+    // The writer threads outlive everything that writes files
+    std::unique_ptr<AsyncWriter> writer;
+    if (writerMode != "sync" && direct) {
+        std::cerr << "--writer does not apply with --direct, which writes whole blocks itself" << std::endl;
+    } else if (writerMode != "sync") {
+        writer = AsyncWriter::create(writerMode == "threads");
+        if (writerMode == "async" && writer->name() != std::string_view("io_uring")) {
+            std::cerr << "--writer async: io_uring is not available, using a thread pool" << std::endl;
+        }
+    }
+
+    // Declared before the sinks, so their files are closed before it writes its last frames
+    std::unique_ptr<CompressionThread> compressor;
+    if (compress == "zstd" && format == "sqlite") {
+        std::cerr << "--compress does not apply to --format sqlite, ignoring it" << std::endl;
+    } else if (compress == "zstd" && format != "parquet") {
+        compressor = std::make_unique<CompressionThread>(compressLevel, std::chrono::milliseconds(frameInterval));
+    }
+    std::string zst = compressor ? ".zst" : "";
+    OutputOptions outputOptions{compressor.get(), nullptr, writer.get(), direct, std::chrono::milliseconds(maxDelay)};
+    outputOptions.resume = restoring;
+
+    // Likewise: finished segments are handed to it until the sinks are gone
+    std::unique_ptr<RotationThread> rotation;
+    if (rotationPolicy.enabled() && format != "csv") {
+        std::cerr << "--rotate-* only applies to --format csv, ignoring it" << std::endl;
+    } else if (rotationPolicy.enabled()) {
+        rotation = std::make_unique<RotationThread>(rotationPolicy);
+        outputOptions.rotation = rotation.get();
+    }
+
+    std::unique_ptr<RecordSink> output;
+    CsvOutput *csv = nullptr;
+    DeltaOutput *delta = nullptr;
+    if (format == "csv") {
+        auto csvOutput = std::make_unique<CsvOutput>(outputFile, exportCombined, columns, sourceNames,
+                                                     outputOptions);
+        csv = csvOutput.get();
+        output = std::move(csvOutput);
+    } else if (format == "parquet") {
+        if (!exportCombined) {
+            std::cerr << "--sep does not apply to --format parquet, writing one file" << std::endl;
+        }
+        auto parquetOutput = std::make_unique<ParquetOutput>(outputFile + ".parquet", columns, sourceNames,
+                                                             compress == "zstd" ? compressLevel : 0);
+        if (!parquetOutput->is_open()) {
+            std::cerr << "Cannot open " << outputFile << ".parquet" << std::endl;
+            return 1;
+        }
+        output = std::move(parquetOutput);
+    } else if (format == "sqlite") {
+        if (!exportCombined) {
+            std::cerr << "--sep does not apply to --format sqlite, writing one database" << std::endl;
+        }
+        auto sqliteOutput = std::make_unique<SqliteOutput>(outputFile + ".sqlite", columns, sourceNames, restoring);
+        if (!sqliteOutput->is_open()) {
+            return 1;
+        }
+        output = std::move(sqliteOutput);
+    } else if (format == "series") {
+        if (!exportCombined) {
+            std::cerr << "--sep does not apply to --format series, writing one file" << std::endl;
+        }
+        auto seriesOutput = std::make_unique<SeriesOutput>(outputFile + ".series", columns, sourceNames,
+                                                           outputOptions);
+        if (!seriesOutput->is_open()) {
+            std::cerr << "Cannot open " << outputFile << ".series" << zst << std::endl;
+            return 1;
+        }
+        output = std::move(seriesOutput);
+    } else {
+        if (!exportCombined) {
+            std::cerr << "--sep does not apply to --format " << format << ", writing one file" << std::endl;
+        }
+        bool binary = format == "binary-delta";
+        std::string path = outputFile + (binary ? ".bin" : ".delta.csv");
+        auto deltaOutput = std::make_unique<DeltaOutput>(path, binary ? DeltaFormat::Binary : DeltaFormat::Csv,
+                                                         columns, sourceNames, keyframeInterval, outputOptions);
+        if (!deltaOutput->is_open()) {
+            std::cerr << "Cannot open " << path << zst << std::endl;
+            return 1;
+        }
+        delta = deltaOutput.get();
+        output = std::move(deltaOutput);
+    }
+    RecordSink *sink = output.get();
+    std::unique_ptr<SummaryExporter> exporter;
+    if (!exportEndpoint.empty()) {
+        if (exportName.empty()) {
+            char host[256] = "gnb";
+            gethostname(host, sizeof(host) - 1);
+            exportName = host;
+        }
+        // One cell per input
+        std::vector<std::string> cells;
+        for (const std::string &name: sourceNames) {
+            cells.push_back(sourceNames.size() > 1 ? exportName + "/" + name : exportName);
+        }
+        auto interval = std::chrono::milliseconds(static_cast<long>(exportInterval * 1000));
+        exporter = std::make_unique<SummaryExporter>(*output, exportEndpoint, cells, parsedColumns, interval);
+        sink = exporter.get();
+    }
+    std::unique_ptr<SubscriberHub> subscribers;
+    if (!subscribeEndpoint.empty()) {
+        if (!subscribeEndpoint.starts_with("unix:")) {
+            std::cerr << "--subscribe takes a unix:<path> endpoint" << std::endl;
+            return 1;
         }
+        subscribers = std::make_unique<SubscriberHub>(*sink, subscribeEndpoint, columns, sourceNames,
+                                                      keyframeInterval);
+        if (!subscribers->is_open()) {
+            return 1;
+        }
+        sink = subscribers.get();
+    }
+    std::unique_ptr<UEHistory> history;
+    if (!historyEndpoint.empty()) {
+        if (!historyEndpoint.starts_with("unix:")) {
+            std::cerr << "--history takes a unix:<path> endpoint" << std::endl;
+            return 1;
+        }
+        history = std::make_unique<UEHistory>(*sink, historyEndpoint, sourceNames, historyBudget);
+        if (!history->is_open()) {
+            return 1;
+        }
+        sink = history.get();
+    }
+    std::unique_ptr<SnapshotExport> snapshot;
+    if (!snapshotFile.empty() || !snapshotEndpoint.empty()) {
+        if (!snapshotEndpoint.empty() && !snapshotEndpoint.starts_with("unix:")) {
+            std::cerr << "--snapshot-socket takes a unix:<path> endpoint" << std::endl;
+            return 1;
+        }
+        snapshot = std::make_unique<SnapshotExport>(*sink, snapshotFile, snapshotEndpoint, columns, sourceNames);
+        if (!snapshot->is_open()) {
+            return 1;
+        }
+        sink = snapshot.get();
+    }
+    std::unique_ptr<Dashboard> dashboard;
+    if (tui) {
+        std::function<size_t()> batchSize;
+        if (csv) {
+            batchSize = [csv] { return csv->batch_size(); };
+        }
+        dashboard = std::make_unique<Dashboard>(*sink, sourceNames, std::chrono::milliseconds(tuiRefresh),
+                                                std::move(batchSize));
+        if (!dashboard->is_open()) {
+            return 1;
+        }
+        sink = dashboard.get();
+    }
+    // In front of everything else, so nothing delays a record on its way out
+    std::unique_ptr<RecordPublisher> publisher;
+    if (!latencyTarget.empty()) {
+        if (!inputs.empty()) {
+            std::cerr << "--latency reads stdin (redirect a FIFO: < /path/to.fifo), not --input" << std::endl;
+            return 1;
+        }
+        publisher = std::make_unique<RecordPublisher>(*sink, latencyTarget);
+        if (!publisher->is_open()) {
+            return 1;
+        }
+        sink = publisher.get();
+    }
+
+    if (!inputs.empty()) {
+        if (shed || !teeFile.empty()) {
+            std::cerr << "--shed and --tee only apply to stdin, ignoring them" << std::endl;
+        }
+        MultiInput multi(inputs, *sink, parsedColumns, filter, workers);
+        std::string error;
+        bool ok = multi.run(error);
+        if (!ok) {
+            std::cerr << "--input: " << error << std::endl;
+        }
+        multi.print_stats();
+        if (csv) {
+            csv->print_stats();
+        }
+        return ok ? 0 : 1;
     }
 
     //freopen("gnb_fed3.log", "r", stdin); // FOR TESTING
-    Parser parser(outputFile, exportCombined);
-    while (std::getline(std::cin, line)) {
+    Parser parser(*sink, parsedColumns, filter);
+    std::unique_ptr<OverloadController> overload;
+    if (shed) {
+        overload = std::make_unique<OverloadController>(STDIN_FILENO, parsedColumns, !exportCombined,
+                                                        outputFile + ".shed.log");
+        if (!overload->enabled()) {
+            std::cerr << "--shed needs a pipe or FIFO on stdin, ignoring it" << std::endl;
+        }
+    }
+
+    auto takeCheckpoint = [&](bool clean) {
+        CheckpointBuilder builder(parsedColumns, sourceNames, clean);
+        builder.section(CheckpointSection::Parser, [&](std::string &out) {
+            parser.save_state(out);
+        });
+        if (delta) {
+            builder.section(CheckpointSection::DeltaHistory, [&](std::string &out) {
+                delta->save_state(out);
+            });
+        }
+        if (exporter) {
+            builder.section(CheckpointSection::Summaries, [&](std::string &out) {
+                exporter->save_state(out, clean);
+            });
+        }
+        return builder.take();
+    };
+    std::unique_ptr<Checkpointer> checkpointer;
+    if (!checkpointFile.empty()) {
+        if (restoring) {
+            bool parserOk = parser.restore_state(restored.section(CheckpointSection::Parser));
+            // Rows written after a periodic checkpoint are not in its delta history: keyframes first
+            bool deltaOk = delta && restored.clean() &&
+                           delta->restore_state(restored.section(CheckpointSection::DeltaHistory));
+            bool exportOk = exporter && exporter->restore_state(restored.section(CheckpointSection::Summaries));
+            auto took = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - restoreStart);
+            std::cerr << "--checkpoint: restored " << restored.size() << " bytes from " << checkpointFile << " in "
+                    << took.count() << " ms (UE table " << (parserOk ? "yes" : "no") << ", delta history "
+                    << (deltaOk ? "yes" : "no") << ", export interval " << (exportOk ? "yes" : "no") << ")"
+                    << std::endl;
+        }
+        auto interval = std::chrono::milliseconds(static_cast<long>(checkpointInterval * 1000));
+        checkpointer = std::make_unique<Checkpointer>(checkpointFile, interval);
+        if (restoring) {
+            // The clean one is used up: the outputs move on from here
+            checkpointer->submit(takeCheckpoint(false));
+        }
+    }
+
+    std::unique_ptr<InputSource> input;
+    TeeInput *tee = nullptr;
+    if (publisher) {
+        if (!teeFile.empty() || hugePages != HugePages::Off) {
+            std::cerr << "--tee and --huge-pages input mapping do not apply with --latency" << std::endl;
+        }
+        auto busyPoll = std::make_unique<BusyPollInput>(STDIN_FILENO);
+        publisher->measure_from(*busyPoll);
+        input = std::move(busyPoll);
+    } else if (!teeFile.empty()) {
+        auto teeInput = std::make_unique<TeeInput>(STDIN_FILENO, teeFile);
+        if (!teeInput->is_open()) {
+            std::cerr << "Cannot open --tee file " << teeFile << std::endl;
+            return 1;
+        }
+        tee = teeInput.get();
+        input = std::move(teeInput);
+    } else if (hugePages != HugePages::Off) {
+        auto mapped = std::make_unique<MappedInput>(STDIN_FILENO);
+        if (mapped->is_mapped()) {
+            input = std::move(mapped);
+        }
+    }
+    if (!input) {
+        input = std::make_unique<FdInput>(STDIN_FILENO);
+    }
+
+    // Every thread is running by now, with SIGINT/SIGTERM blocked
+    install_stop_handler();
+    LineReader reader(*input);
+    reader.for_each_line([&](std::string_view line) {
         if (!line.empty()) {
             try {
                 parser.parse_line(line);
@@ -237,5 +680,43 @@ int main(int argc, char *argv[]) {
                 std::cerr << "Exception: " << e.what() << std::endl;
             }
         }
+    }, [&] {
+        if (overload && overload->sample()) {
+            parser.shed(overload->mode());
+            if (csv) {
+                csv->shed(overload->mode());
+            }
+        }
+        if (checkpointer && checkpointer->due()) {
+            checkpointer->submit(takeCheckpoint(false));
+        }
+    });
+
+    // A checkpoint carries the records waiting for their MAC line over to the next run instead
+    if (checkpointer) {
+        checkpointer->write_final(takeCheckpoint(true));
+        checkpointer->print_stats();
+    } else {
+        parser.finish();
+    }
+
+    if (publisher) {
+        publisher->print_stats();
+    }
+    if (csv && maxDelayGiven) {
+        csv->print_stats();
+    }
+    if (overload) {
+        overload->finish(parser.stats_periods(), parser.stats_periods_kept());
+    }
+    if (tee) {
+        tee->close();
+        if (tee->error()) {
+            std::cerr << "--tee: writing " << teeFile << " failed: " << std::strerror(tee->error()) << std::endl;
+        }
+        if (tee->dropped_bytes() > 0) {
+            std::cerr << "--tee: archive fell behind, " << tee->dropped_bytes() << " of "
+                    << tee->archived_bytes() + tee->dropped_bytes() << " bytes were not archived" << std::endl;
+        }
     }
 }
@@ -0,0 +1,424 @@
+#include "multi_input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "line_reader.h"
+#include "placement.h"
+
+
+namespace {
+    constexpr uint64_t signal_id = ~uint64_t(0);
+    constexpr uint64_t inotify_id = ~uint64_t(0) - 1;
+    constexpr size_t read_block = 1024 * 1024;
+
+    bool has_prefix(std::string_view text, std::string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+}
+
+bool parse_source_spec(std::string_view text, SourceSpec &spec, std::string &error) {
+    size_t eq = text.find('=');
+    std::string_view name;
+    if (eq != std::string_view::npos && text.substr(0, eq).find_first_of("/:") == std::string_view::npos) {
+        name = text.substr(0, eq);
+        text.remove_prefix(eq + 1);
+    }
+
+    struct stat st{};
+    if (has_prefix(text, "follow:")) {
+        spec.kind = SourceSpec::Kind::Follow;
+        text.remove_prefix(7);
+    } else if (has_prefix(text, "unix:")) {
+        spec.kind = SourceSpec::Kind::Unix;
+        text.remove_prefix(5);
+    } else if (stat(std::string(text).c_str(), &st) != 0) {
+        error = std::string(text) + ": " + std::strerror(errno);
+        return false;
+    } else {
+        spec.kind = S_ISFIFO(st.st_mode) ? SourceSpec::Kind::Fifo : SourceSpec::Kind::File;
+    }
+
+    if (text.empty()) {
+        error = "missing path";
+        return false;
+    }
+    spec.path = std::string(text);
+    if (name.empty()) {
+        size_t slash = text.rfind('/');
+        name = slash == std::string_view::npos ? text : text.substr(slash + 1);
+    }
+    spec.name = std::string(name);
+    return true;
+}
+
+MultiInput::MultiInput(std::vector<SourceSpec> sources, RecordSink &sink, ColumnMask columns,
+                       const UEFilter &filter, unsigned worker_count) : specs(std::move(sources)) {
+    for (size_t i = 0; i < specs.size(); i++) {
+        parsers.push_back(std::make_unique<Parser>(sink, columns, filter, static_cast<uint16_t>(i)));
+    }
+    stats.resize(specs.size());
+
+    if (worker_count == 0) {
+        worker_count = std::min<unsigned>(specs.size(), std::max(1u, std::thread::hardware_concurrency() / 2));
+        worker_count = std::min(worker_count, 4u);
+    }
+    for (unsigned i = 0; i < std::max(1u, worker_count); i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+MultiInput::~MultiInput() {
+    while (!streams.empty()) {
+        close_stream(streams.begin()->first);
+    }
+    for (int fd: {epoll_fd, inotify_fd, signal_fd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+uint64_t MultiInput::add_stream(Stream stream, bool poll) {
+    uint64_t id = next_stream_id++;
+    if (poll) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream.fd, &event);
+    }
+    streams.emplace(id, std::move(stream));
+    return id;
+}
+
+void MultiInput::close_stream(uint64_t id) {
+    auto it = streams.find(id);
+    if (it == streams.end()) {
+        return;
+    }
+    Stream &stream = it->second;
+    if (stream.watch >= 0) {
+        inotify_rm_watch(inotify_fd, stream.watch);
+        stream_of_watch.erase(stream.watch);
+    }
+    if (stream.fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, stream.fd, nullptr);
+        close(stream.fd);
+    }
+    if (stream.listening) {
+        unlink(specs[stream.source].path.c_str());
+    }
+    plain_files.erase(std::remove(plain_files.begin(), plain_files.end(), id), plain_files.end());
+    streams.erase(it);
+}
+
+bool MultiInput::open_source(uint16_t source, std::string &error) {
+    const SourceSpec &spec = specs[source];
+    Stream stream;
+    stream.source = source;
+    stream.kind = spec.kind;
+
+    switch (spec.kind) {
+        case SourceSpec::Kind::File:
+            stream.fd = open(spec.path.c_str(), O_RDONLY | O_CLOEXEC);
+            break;
+        case SourceSpec::Kind::Fifo:
+            // Holding a write end ourselves means a restarting writer never produces EOF
+            stream.fd = open(spec.path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            break;
+        case SourceSpec::Kind::Follow:
+            stream.fd = open(spec.path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (stream.fd >= 0) {
+                stream.watch = inotify_add_watch(inotify_fd, spec.path.c_str(),
+                                                 IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+            }
+            break;
+        case SourceSpec::Kind::Unix: {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (spec.path.size() >= sizeof(addr.sun_path)) {
+                error = spec.path + ": socket path too long";
+                return false;
+            }
+            std::strncpy(addr.sun_path, spec.path.c_str(), sizeof(addr.sun_path) - 1);
+            stream.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            unlink(spec.path.c_str());
+            if (stream.fd >= 0 && (bind(stream.fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+                                   listen(stream.fd, 16) != 0)) {
+                close(stream.fd);
+                stream.fd = -1;
+            }
+            stream.listening = true;
+            break;
+        }
+    }
+
+    if (stream.fd < 0) {
+        error = spec.path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    int watch = stream.watch;
+    bool poll = spec.kind == SourceSpec::Kind::Fifo || spec.kind == SourceSpec::Kind::Unix;
+    uint64_t id = add_stream(std::move(stream), poll);
+    if (spec.kind == SourceSpec::Kind::File) {
+        plain_files.push_back(id);
+    } else if (spec.kind == SourceSpec::Kind::Follow) {
+        stream_of_watch[watch] = id;
+        pump(streams[id], false);
+    }
+    return true;
+}
+
+void MultiInput::dispatch(uint16_t source, std::vector<char> &&bytes) {
+    Worker &worker = *workers[source % workers.size()];
+    std::unique_lock<std::mutex> guard(worker.lock);
+    worker.changed.wait(guard, [&] {
+        return worker.queue.size() < max_queued_chunks;
+    });
+    worker.queue.push_back({source, std::move(bytes)});
+    worker.changed.notify_all();
+}
+
+bool MultiInput::pump(Stream &stream, bool once) {
+    static thread_local PageBuffer buffer(read_block);
+
+    while (true) {
+        ssize_t n = read(stream.fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            return true;
+        }
+        if (n == 0 && stream.kind == SourceSpec::Kind::Follow) {
+            // At the current end; start over if the file was truncated (copytruncate rotation)
+            struct stat st{};
+            if (fstat(stream.fd, &st) == 0 && st.st_size < lseek(stream.fd, 0, SEEK_CUR)) {
+                lseek(stream.fd, 0, SEEK_SET);
+                stream.pending.clear();
+                continue;
+            }
+            return true;
+        }
+        if (n <= 0) {
+            // EOF or error: the last line may lack its newline
+            if (!stream.pending.empty()) {
+                stream.pending.push_back('\n');
+                dispatch(stream.source, std::move(stream.pending));
+                stream.pending.clear();
+            }
+            return false;
+        }
+
+        stats[stream.source].bytes += n;
+        const void *last = memrchr(buffer.data(), '\n', n);
+        if (!last) {
+            stream.pending.insert(stream.pending.end(), buffer.data(), buffer.data() + n);
+        } else {
+            const char *begin = buffer.data();
+            const char *cut = static_cast<const char *>(last) + 1;
+            std::vector<char> chunk;
+            chunk.reserve(stream.pending.size() + (cut - begin));
+            chunk.insert(chunk.end(), stream.pending.begin(), stream.pending.end());
+            chunk.insert(chunk.end(), begin, cut);
+            stream.pending.assign(cut, begin + n);
+            dispatch(stream.source, std::move(chunk));
+        }
+        if (once) {
+            return true;
+        }
+    }
+}
+
+void MultiInput::accept_connections(Stream &listener) {
+    while (true) {
+        int fd = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        Stream connection;
+        connection.fd = fd;
+        connection.source = listener.source;
+        connection.kind = SourceSpec::Kind::Unix;
+        add_stream(std::move(connection), true);
+    }
+}
+
+void MultiInput::handle_inotify() {
+    alignas(inotify_event) char events[4096];
+    while (true) {
+        ssize_t n = read(inotify_fd, events, sizeof(events));
+        if (n <= 0) {
+            return;
+        }
+        for (char *p = events; p < events + n;) {
+            auto *event = reinterpret_cast<inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            auto watched = stream_of_watch.find(event->wd);
+            if (watched == stream_of_watch.end()) {
+                continue;
+            }
+            Stream &stream = streams[watched->second];
+            pump(stream, false);
+            if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) {
+                // Rotated away: what was written before the move has just been read
+                inotify_rm_watch(inotify_fd, stream.watch);
+                stream_of_watch.erase(watched);
+                close(stream.fd);
+                stream.fd = -1;
+                stream.watch = -1;
+                stream.rotated = true;
+            }
+        }
+    }
+}
+
+void MultiInput::reopen_rotated() {
+    for (auto &[id, stream]: streams) {
+        if (!stream.rotated) {
+            continue;
+        }
+        const std::string &path = specs[stream.source].path;
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        stream.fd = fd;
+        stream.watch = inotify_add_watch(inotify_fd, path.c_str(), IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+        stream.rotated = false;
+        stream.pending.clear();
+        stream_of_watch[stream.watch] = id;
+        pump(stream, false);
+    }
+}
+
+void MultiInput::work(Worker &worker) {
+    place_thread(ThreadRole::Parser);
+    while (true) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> guard(worker.lock);
+            worker.changed.wait(guard, [&] {
+                return worker.stopping || !worker.queue.empty();
+            });
+            if (worker.queue.empty()) {
+                return;
+            }
+            chunk = std::move(worker.queue.front());
+            worker.queue.pop_front();
+        }
+        worker.changed.notify_all();
+
+        Parser &parser = *parsers[chunk.source];
+        SourceStats &source_stats = stats[chunk.source];
+        const char *begin = chunk.bytes.data();
+        split_lines(begin, begin, begin + chunk.bytes.size(), [&](std::string_view line) {
+            source_stats.lines++;
+            if (!line.empty()) {
+                parser.parse_line(line);
+            }
+        });
+    }
+}
+
+bool MultiInput::run(std::string &error) {
+    // Signals arrive through a signalfd; blocking them first makes the workers inherit the mask
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd < 0 || inotify_fd < 0 || signal_fd < 0) {
+        error = std::string("epoll setup: ") + std::strerror(errno);
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        return false;
+    }
+    for (auto [fd, id]: {std::pair{signal_fd, signal_id}, std::pair{inotify_fd, inotify_id}}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    for (auto &worker: workers) {
+        worker->thread = std::thread(&MultiInput::work, this, std::ref(*worker));
+    }
+
+    bool ok = true;
+    for (uint16_t source = 0; source < specs.size() && ok; source++) {
+        ok = open_source(source, error);
+    }
+
+    bool finite = std::all_of(specs.begin(), specs.end(), [](const SourceSpec &spec) {
+        return spec.kind == SourceSpec::Kind::File;
+    });
+    bool stopping = !ok;
+    epoll_event events[64];
+    while (!stopping && !(finite && streams.empty())) {
+        int n = epoll_wait(epoll_fd, events, 64, plain_files.empty() ? 1000 : 0);
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == signal_id) {
+                // Consume it, or it would be delivered once the mask is restored
+                signalfd_siginfo info;
+                stopping = read(signal_fd, &info, sizeof(info)) == sizeof(info);
+            } else if (id == inotify_id) {
+                handle_inotify();
+            } else if (auto it = streams.find(id); it != streams.end()) {
+                if (it->second.listening) {
+                    accept_connections(it->second);
+                } else if (!pump(it->second, false)) {
+                    close_stream(id);
+                }
+            }
+        }
+
+        // Regular files are always "readable": one block each per round keeps them fair to the rest
+        for (uint64_t id: std::vector<uint64_t>(plain_files)) {
+            if (!pump(streams[id], true)) {
+                close_stream(id);
+            }
+        }
+        reopen_rotated();
+    }
+
+    for (auto &worker: workers) {
+        {
+            std::lock_guard<std::mutex> guard(worker->lock);
+            worker->stopping = true;
+        }
+        worker->changed.notify_all();
+    }
+    for (auto &worker: workers) {
+        worker->thread.join();
+    }
+    for (auto &parser: parsers) {
+        parser->finish();
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    return ok;
+}
+
+void MultiInput::print_stats() const {
+    for (size_t i = 0; i < specs.size(); i++) {
+        std::cerr << "input " << specs[i].name << ": " << stats[i].bytes << " bytes, " << stats[i].lines
+                << " lines, " << parsers[i]->records_written() << " records" << std::endl;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "columns.h"
+#include "parser.h"
+#include "record_sink.h"
+#include "ue_filter.h"
+
+
+// One --input: "[name=][follow:|unix:]path"
+struct SourceSpec {
+    enum class Kind {
+        File, // read once to EOF
+        Fifo, // kept open read-write, so the gNB can restart without ending the input
+        Follow, // regular file followed like tail -f (inotify), across truncation and rotation
+        Unix // listening Unix stream socket, every connection feeds this source
+    };
+
+    std::string name;
+    Kind kind;
+    std::string path;
+};
+
+// A path that is a FIFO is detected here, so "name=/tmp/du1.fifo" needs no prefix
+bool parse_source_spec(std::string_view text, SourceSpec &spec, std::string &error);
+
+/* Multi-gNB ingestion (--input)
+ *
+ * One epoll thread reads every input without blocking and cuts what it read at the last newline.
+ * The complete lines go, as one chunk, to the worker that owns the input (input index modulo the
+ * pool size), so each input is parsed in order by a single thread and keeps its own Parser and UE
+ * table without locking. All parsers share one sink. SIGINT/SIGTERM end the run cleanly.
+ */
+class MultiInput {
+private:
+    struct Chunk {
+        uint16_t source;
+        std::vector<char> bytes; // whole lines only
+    };
+
+    struct Worker {
+        std::thread thread;
+        std::mutex lock;
+        std::condition_variable changed;
+        std::deque<Chunk> queue;
+        bool stopping = false;
+    };
+
+    struct Stream {
+        int fd = -1;
+        uint16_t source = 0;
+        SourceSpec::Kind kind = SourceSpec::Kind::File;
+        bool listening = false;
+        bool rotated = false; // followed file was moved away, reopen the path once it exists again
+        int watch = -1;
+        std::vector<char> pending; // partial line carried over to the next read
+    };
+
+    // Per-input counters, printed when the run ends
+    struct SourceStats {
+        uint64_t bytes = 0;
+        uint64_t lines = 0;
+    };
+
+    static constexpr size_t max_queued_chunks = 64;
+
+    std::vector<SourceSpec> specs;
+    std::vector<std::unique_ptr<Parser>> parsers;
+    std::vector<SourceStats> stats;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    int epoll_fd = -1;
+    int inotify_fd = -1;
+    int signal_fd = -1;
+    uint64_t next_stream_id = 0;
+    std::unordered_map<uint64_t, Stream> streams;
+    std::unordered_map<int, uint64_t> stream_of_watch;
+    std::vector<uint64_t> plain_files; // always readable, so read round-robin instead of via epoll
+
+    bool open_source(uint16_t source, std::string &error);
+    uint64_t add_stream(Stream stream, bool poll);
+    void close_stream(uint64_t id);
+
+    // Reads what is available; returns false once the stream hit EOF or an error
+    bool pump(Stream &stream, bool once);
+    void dispatch(uint16_t source, std::vector<char> &&bytes);
+    void accept_connections(Stream &listener);
+    void handle_inotify();
+    void reopen_rotated();
+
+    void work(Worker &worker);
+
+public:
+    MultiInput(std::vector<SourceSpec> sources, RecordSink &sink, ColumnMask columns, const UEFilter &filter,
+               unsigned worker_count);
+
+    ~MultiInput();
+
+    // Runs until every finite input hit EOF, or SIGINT/SIGTERM
+    bool run(std::string &error);
+
+    void print_stats() const;
+};
@@ -0,0 +1,321 @@
+#include "output_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "async_writer.h"
+#include "compression.h"
+#include "placement.h"
+
+
+void CacheDropper::written(int fd, uint64_t end) {
+    if (end - started < window) {
+        return;
+    }
+    sync_file_range(fd, static_cast<off_t>(started), static_cast<off_t>(end - started), SYNC_FILE_RANGE_WRITE);
+    if (started > dropped) {
+        sync_file_range(fd, static_cast<off_t>(dropped), static_cast<off_t>(started - dropped),
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, static_cast<off_t>(dropped), static_cast<off_t>(started - dropped), POSIX_FADV_DONTNEED);
+        dropped = started;
+    }
+    started = end;
+}
+
+void CacheDropper::finish(int fd) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+CompressionThread::CompressionThread(int zstd_level, std::chrono::milliseconds frame_interval)
+    : level(zstd_level), interval(std::max(frame_interval, std::chrono::milliseconds(1))) {
+    worker = std::thread(&CompressionThread::run, this);
+}
+
+CompressionThread::~CompressionThread() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+    if (write_error) {
+        std::cerr << "Compressed output: " << std::strerror(write_error) << std::endl;
+    }
+}
+
+std::shared_ptr<CompressionThread::Stream> CompressionThread::open(int fd, bool drop_cache) {
+    auto stream = std::make_shared<Stream>();
+    stream->fd = fd;
+    if (drop_cache) {
+        stream->dropper = std::make_unique<CacheDropper>();
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    streams.push_back(stream);
+    return stream;
+}
+
+void CompressionThread::seal(const std::shared_ptr<Stream> &stream, bool last) {
+    std::unique_lock<std::mutex> guard(lock);
+    // The thread itself seals idle buffers and must not wait for its own queue
+    if (std::this_thread::get_id() != worker.get_id()) {
+        space.wait(guard, [&] { return queue.size() < max_queued; });
+    }
+    queue.push_back(Frame{stream, std::move(stream->buffer), last});
+    stream->buffer.clear();
+    if (last) {
+        std::erase(streams, stream);
+    }
+    guard.unlock();
+    wake.notify_one();
+}
+
+void CompressionThread::seal_idle() {
+    std::vector<std::shared_ptr<Stream>> current;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = streams;
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &stream: current) {
+        // A stream that is busy being written is sealed by its writer soon enough
+        std::unique_lock<std::mutex> guard(stream->lock, std::try_to_lock);
+        if (guard && !stream->closing && !stream->buffer.empty() && now - stream->first_byte >= interval) {
+            seal(stream, false);
+        }
+    }
+}
+
+void CompressionThread::run() {
+    place_thread(ThreadRole::Writer);
+    std::string compressed;
+    auto next_sweep = std::chrono::steady_clock::now() + interval / 4;
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait_until(guard, next_sweep, [&] { return !queue.empty() || stopping; });
+            if (queue.empty() && stopping) {
+                return;
+            }
+            if (!queue.empty()) {
+                frame = std::move(queue.front());
+                queue.pop_front();
+                space.notify_all();
+            }
+        }
+        if (std::chrono::steady_clock::now() >= next_sweep) {
+            seal_idle();
+            next_sweep = std::chrono::steady_clock::now() + interval / 4;
+        }
+        if (!frame.stream) {
+            continue;
+        }
+
+        Stream &stream = *frame.stream;
+        if (!frame.data.empty() && zstd_compress(frame.data.data(), frame.data.size(), compressed, level, true)) {
+            for (size_t done = 0; done < compressed.size();) {
+                ssize_t n = ::write(stream.fd, compressed.data() + done, compressed.size() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    write_error = n < 0 ? errno : EIO;
+                    break;
+                }
+                done += n;
+                stream.size += n;
+            }
+            if (stream.dropper) {
+                stream.dropper->written(stream.fd, stream.size);
+            }
+        }
+        if (frame.last) {
+            if (stream.sync) {
+                fsync(stream.fd);
+            }
+            if (stream.dropper) {
+                stream.dropper->finish(stream.fd);
+            }
+            ::close(stream.fd);
+        }
+    }
+}
+
+uint64_t existing_size(const std::string &path, const OutputOptions &options) {
+    struct stat info{};
+    std::string name = options.compressor ? path + ".zst" : path;
+    return stat(name.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+OutputFile::~OutputFile() {
+    close();
+}
+
+bool OutputFile::open(const std::string &path, const OutputOptions &options, bool append) {
+    compressor = options.compressor;
+    name = compressor ? path + ".zst" : path;
+    // No O_APPEND when appending: it would make pwrite(2) ignore the offsets of the async writes, which
+    // may complete out of order. Every write goes at an offset from the end of the file instead.
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC);
+    // Appending leaves the offset unaligned, so such files only get their cache dropped
+    bool direct = options.direct && !compressor && !append;
+    int file = ::open(name.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+    if (file < 0 && direct && errno == EINVAL) {
+        static std::once_flag warned;
+        std::call_once(warned, [&] {
+            std::cerr << "--direct: O_DIRECT is not supported for " << name
+                    << ", dropping written data from the page cache instead" << std::endl;
+        });
+        direct = false;
+        file = ::open(name.c_str(), flags, 0644);
+    }
+    if (file < 0) {
+        return false;
+    }
+    off_t end = append ? lseek(file, 0, SEEK_END) : 0;
+    if (end < 0) {
+        ::close(file);
+        return false;
+    }
+    if (compressor) {
+        stream = compressor->open(file, options.direct);
+        return true;
+    }
+    fd = file;
+    offset = static_cast<uint64_t>(end);
+    if (direct) {
+        aligned = PageBuffer(direct_buffer);
+    } else if (options.direct) {
+        dropper = std::make_unique<CacheDropper>();
+    } else {
+        writer = options.writer;
+    }
+    return true;
+}
+
+void OutputFile::write(const char *data, size_t size) {
+    written += size;
+    if (!aligned.empty()) {
+        while (size > 0) {
+            size_t part = std::min(size, direct_buffer - aligned_used);
+            std::memcpy(aligned.data() + aligned_used, data, part);
+            aligned_used += part;
+            data += part;
+            size -= part;
+            if (aligned_used == direct_buffer) {
+                write_aligned(direct_buffer);
+            }
+        }
+        return;
+    }
+    if (!stream) {
+        pending.append(data, size);
+        if (pending.size() >= plain_buffer) {
+            write_pending();
+        }
+        return;
+    }
+    std::lock_guard<std::mutex> guard(stream->lock);
+    if (stream->buffer.empty()) {
+        stream->first_byte = std::chrono::steady_clock::now();
+    }
+    stream->buffer.append(data, size);
+    if (stream->buffer.size() >= CompressionThread::frame_bytes) {
+        compressor->seal(stream, false);
+    }
+}
+
+bool OutputFile::write_at(const char *data, size_t size) {
+    while (size > 0 && !write_error) {
+        ssize_t n = pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            write_error = n < 0 ? errno : EIO;
+            std::cerr << "Cannot write " << name << ": " << std::strerror(write_error) << std::endl;
+            break;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return !write_error;
+}
+
+void OutputFile::write_pending() {
+    if (pending.empty()) {
+        return;
+    }
+    if (writer) {
+        size_t size = pending.size();
+        writer->write(fd, offset, std::move(pending));
+        offset += size;
+        pending = writer->buffer();
+        return;
+    }
+    write_at(pending.data(), pending.size());
+    pending.clear();
+    if (dropper) {
+        dropper->written(fd, offset);
+    }
+}
+
+void OutputFile::write_aligned(size_t size) {
+    write_at(aligned.data(), size);
+    aligned_used -= size;
+    std::memmove(aligned.data(), aligned.data() + size, aligned_used);
+}
+
+void OutputFile::flush() {
+    if (fd >= 0 && aligned.empty()) {
+        write_pending();
+    }
+}
+
+void OutputFile::close(bool sync) {
+    if (fd >= 0) {
+        if (!aligned.empty()) {
+            // Pad to whole blocks for O_DIRECT, then cut the padding off again
+            size_t tail = aligned_used;
+            size_t padded = (tail + direct_block - 1) / direct_block * direct_block;
+            std::memset(aligned.data() + tail, 0, padded - tail);
+            aligned_used = padded;
+            write_aligned(padded);
+            if (padded > tail && ftruncate(fd, static_cast<off_t>(offset - (padded - tail))) != 0) {
+                write_error = errno;
+            }
+            aligned.release();
+        }
+        write_pending();
+        if (writer) {
+            writer->wait(fd);
+        }
+        if (sync) {
+            fsync(fd);
+        }
+        if (dropper) {
+            dropper->finish(fd);
+        }
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    if (!stream) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(stream->lock);
+        stream->closing = true;
+        stream->sync = sync;
+        compressor->seal(stream, true);
+    }
+    stream.reset();
+}
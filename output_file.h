@@ -0,0 +1,188 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "huge_pages.h"
+
+
+/* --direct where O_DIRECT is not available, and for compressed files
+ *
+ * Keeps what was written from piling up in the page cache: every window bytes, writeback of the
+ * newest window is started and the window before it, written back by then, is dropped with
+ * posix_fadvise(DONTNEED). finish() writes back and drops the rest.
+ */
+class CacheDropper {
+private:
+    static constexpr uint64_t window = 8 << 20;
+
+    uint64_t dropped = 0; // dropped up to here
+    uint64_t started = 0; // writeback started up to here
+
+public:
+    // end: the file size written so far
+    void written(int fd, uint64_t end);
+
+    void finish(int fd);
+};
+
+/* --compress zstd for the file sinks
+ *
+ * A compressed OutputFile collects its bytes in a buffer. The buffer is handed to the one shared
+ * CompressionThread when it holds frame_bytes, or by the thread itself once its oldest byte is
+ * older than the frame interval. Every buffer becomes one complete zstd frame (with checksum)
+ * appended to the file; concatenated frames are an ordinary .zst file, and a crash loses at most
+ * the frame being filled. Parsing only copies bytes: compression and the write(2)s happen on the
+ * thread, which blocks writers only when max_queued frames are waiting.
+ */
+class CompressionThread {
+public:
+    struct Stream {
+        std::mutex lock;
+        int fd = -1;
+        std::string buffer;
+        std::chrono::steady_clock::time_point first_byte; // of the buffer
+        bool closing = false;
+        bool sync = false; // fsync before closing
+        // Only used by the thread
+        uint64_t size = 0;
+        std::unique_ptr<CacheDropper> dropper; // --direct
+    };
+
+private:
+    static constexpr size_t max_queued = 32;
+
+    struct Frame {
+        std::shared_ptr<Stream> stream;
+        std::string data;
+        bool last; // close the file after this frame
+    };
+
+    int level;
+    std::chrono::milliseconds interval;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable space;
+    std::deque<Frame> queue;
+    std::vector<std::shared_ptr<Stream>> streams;
+    bool stopping = false;
+    int write_error = 0;
+    std::thread worker;
+
+    void run();
+
+    void seal_idle();
+
+public:
+    static constexpr size_t frame_bytes = 1 << 20;
+
+    CompressionThread(int zstd_level, std::chrono::milliseconds frame_interval);
+
+    // Writes every queued frame; the files must be closed before
+    ~CompressionThread();
+
+    std::shared_ptr<Stream> open(int fd, bool drop_cache);
+
+    // Queues the buffer of stream as a frame. Called with stream.lock held.
+    void seal(const std::shared_ptr<Stream> &stream, bool last);
+
+    int error() const {
+        return write_error;
+    }
+};
+
+class AsyncWriter;
+class RotationThread;
+
+// How the sinks write their files, set up once in main
+struct OutputOptions {
+    CompressionThread *compressor = nullptr; // --compress zstd
+    RotationThread *rotation = nullptr; // --rotate-size / --rotate-every, CSV only
+    AsyncWriter *writer = nullptr; // --writer async / threads, uncompressed files
+    bool direct = false; // --direct: keep out of the page cache
+    std::chrono::milliseconds max_delay{0}; // --max-delay: CSV rows are batched up to this long, 0 flushes each
+    bool resume = false; // a --checkpoint was restored: CSV, delta and series files continue where the last run stopped
+};
+
+// Bytes in the file OutputFile::open(path, options) would open (".zst" included), 0 when missing
+uint64_t existing_size(const std::string &path, const OutputOptions &options);
+
+// A file written directly, through an AsyncWriter, or through a CompressionThread (which adds ".zst"
+// to the name). With --direct an uncompressed file is opened O_DIRECT and written from an aligned
+// buffer in whole blocks, synchronously; flush() then writes nothing, and close() pads the last
+// block and truncates the file back to its size.
+class OutputFile {
+private:
+    static constexpr size_t plain_buffer = 1 << 16;
+    static constexpr size_t direct_block = 4096;
+    static constexpr size_t direct_buffer = 1 << 20;
+
+    std::string name;
+    int fd = -1; // uncompressed
+    std::string pending; // uncompressed bytes not yet written
+    AsyncWriter *writer = nullptr; // writes pending when set
+    uint64_t offset = 0; // where pending goes
+    PageBuffer aligned; // O_DIRECT, instead of pending; page-aligned, on huge pages with --huge-pages
+    size_t aligned_used = 0;
+    std::unique_ptr<CacheDropper> dropper; // --direct without O_DIRECT
+    int write_error = 0;
+    uint64_t written = 0;
+    std::shared_ptr<CompressionThread::Stream> stream;
+    CompressionThread *compressor = nullptr;
+
+    void write_pending();
+
+    // Writes the first size bytes of aligned, a multiple of direct_block
+    void write_aligned(size_t size);
+
+    bool write_at(const char *data, size_t size);
+
+public:
+    OutputFile() = default;
+
+    OutputFile(const OutputFile &) = delete;
+
+    ~OutputFile();
+
+    bool open(const std::string &path, const OutputOptions &options, bool append = false);
+
+    bool is_open() const {
+        return stream || fd >= 0;
+    }
+
+    // The name on disk, with ".zst" when compressed
+    const std::string &path() const {
+        return name;
+    }
+
+    // Bytes written so far, before compression
+    uint64_t bytes() const {
+        return written;
+    }
+
+    int error() const {
+        return write_error;
+    }
+
+    void write(const char *data, size_t size);
+
+    void write(std::string_view text) {
+        write(text.data(), text.size());
+    }
+
+    // Uncompressed files are flushed to the kernel; compressed ones are bounded by the frame interval
+    void flush();
+
+    // With sync the data is fsynced first (by the CompressionThread for compressed files)
+    void close(bool sync = false);
+};
@@ -0,0 +1,114 @@
+#include "overload.h"
+
+#include <ctime>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+
+std::string ShedMode::describe() const {
+    std::string text;
+    if (decoded != all_columns) {
+        text += "core-columns ";
+    }
+    if (per_ue_to_combined) {
+        text += "combined-only ";
+    }
+    if (period_stride > 1) {
+        text += "1/" + std::to_string(period_stride) + "-periods ";
+    }
+    if (text.empty()) {
+        return "full";
+    }
+    text.pop_back();
+    return text;
+}
+
+OverloadController::OverloadController(int input_fd, ColumnMask columns, bool per_ue_files,
+                                       const std::string &meta_path) : fd(input_fd) {
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return;
+    }
+
+    // A bigger pipe absorbs bursts before anything has to be shed (capped by fs.pipe-max-size)
+    std::ifstream max_size("/proc/sys/fs/pipe-max-size");
+    int wanted = 0;
+    if (max_size >> wanted && wanted > 0) {
+        fcntl(fd, F_SETPIPE_SZ, wanted);
+    }
+    pipe_bytes = fcntl(fd, F_GETPIPE_SZ);
+    if (pipe_bytes <= 0) {
+        pipe_bytes = 0;
+        return;
+    }
+
+    ladder.push_back({all_columns, false, 1});
+    if ((columns & core_columns) != columns) {
+        ladder.push_back({core_columns, false, 1});
+    }
+    if (per_ue_files) {
+        ladder.push_back({ladder.back().decoded, true, 1});
+    }
+    for (unsigned stride = 2; stride <= 16; stride *= 2) {
+        ladder.push_back({ladder.back().decoded, per_ue_files, stride});
+    }
+
+    meta.open(meta_path, std::ios::app);
+    last_sample = std::chrono::steady_clock::now();
+    log_event("start pipe=" + std::to_string(pipe_bytes) + " mode=" + mode().describe());
+}
+
+void OverloadController::log_event(const std::string &event) {
+    char stamp[32];
+    time_t now = std::time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    meta << stamp << " " << event << std::endl;
+}
+
+bool OverloadController::sample() {
+    if (!enabled()) {
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sample < sample_interval) {
+        return false;
+    }
+    last_sample = now;
+
+    int queued = 0;
+    if (ioctl(fd, FIONREAD, &queued) != 0) {
+        return false;
+    }
+
+    size_t previous = level;
+    if (queued * 2 > pipe_bytes) {
+        calm_samples = 0;
+        if (level + 1 < ladder.size()) {
+            level++;
+        }
+    } else if (queued * 10 < pipe_bytes) {
+        if (++calm_samples >= calm_samples_to_recover && level > 0) {
+            level--;
+            calm_samples = 0;
+        }
+    } else {
+        calm_samples = 0;
+    }
+
+    if (level == previous) {
+        return false;
+    }
+    std::string event = "level=" + std::to_string(level) + " backlog=" + std::to_string(queued) + "/" +
+                        std::to_string(pipe_bytes) + " mode=" + mode().describe();
+    log_event(event);
+    std::cerr << "Load shedding: " << event << std::endl;
+    return true;
+}
+
+void OverloadController::finish(uint64_t periods_seen, uint64_t periods_kept) {
+    if (enabled()) {
+        log_event("exit periods_kept=" + std::to_string(periods_kept) + "/" + std::to_string(periods_seen));
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "columns.h"
+
+
+// One rung of the shedding ladder; every rung keeps the savings of the rungs below it
+struct ShedMode {
+    ColumnMask decoded; // columns still decoded, the rest are written empty
+    bool per_ue_to_combined; // --sep rows go to the combined file instead of one file per UE
+    unsigned period_stride; // keep every Nth stats period
+
+    std::string describe() const;
+};
+
+// Columns kept under overload
+constexpr ColumnMask core_columns = column_bits(Column::Timestamp, Column::Rnti, Column::Rsrp, Column::Cqi,
+                                                Column::DlBler, Column::DlMcs, Column::UlBler, Column::UlMcs,
+                                                Column::Snr);
+
+/* Overload controller for --shed
+ *
+ * The gNB writes its log into a pipe; once the pipe is full, nr-softmodem blocks in write(). After
+ * every block read, the controller samples how much is still queued in the pipe (FIONREAD) and
+ * steps up the ladder while the pipe is more than half full, then steps back down after it has
+ * stayed nearly empty for a while. Every change is appended to the metadata log next to the CSV.
+ */
+class OverloadController {
+private:
+    static constexpr auto sample_interval = std::chrono::milliseconds(100);
+    static constexpr int calm_samples_to_recover = 20;
+
+    int fd;
+    int pipe_bytes = 0;
+    std::vector<ShedMode> ladder;
+    size_t level = 0;
+    int calm_samples = 0;
+    std::chrono::steady_clock::time_point last_sample;
+    std::ofstream meta;
+
+    void log_event(const std::string &event);
+
+public:
+    // Only pipes and FIFOs can be watched; for anything else enabled() is false
+    OverloadController(int input_fd, ColumnMask columns, bool per_ue_files, const std::string &meta_path);
+
+    bool enabled() const {
+        return pipe_bytes > 0;
+    }
+
+    const ShedMode &mode() const {
+        return ladder[level];
+    }
+
+    // Call after every read; returns true when mode() changed
+    bool sample();
+
+    void finish(uint64_t periods_seen, uint64_t periods_kept);
+};
@@ -0,0 +1,468 @@
+#include "parquet_output.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "compression.h"
+#include "varint.h"
+
+
+namespace {
+    // parquet.thrift enums
+    enum Type { Int32 = 1, Int64 = 2, Double = 5, ByteArray = 6 };
+    enum Encoding { Plain = 0, Rle = 3, RleDictionary = 8 };
+    enum PageType { DataPage = 0, DictionaryPage = 2 };
+    enum ConvertedType { Utf8 = 0, TimestampMillis = 9 };
+    enum Codec { Uncompressed = 0, Zstd = 6 };
+
+    // A row group's INT32 column is dictionary encoded while it has at most this many values
+    constexpr size_t max_int_dictionary = 4096;
+
+    Type physical_type(Column column) {
+        switch (column) {
+            case Column::Rnti:
+            case Column::State:
+            case Column::Source:
+                return ByteArray;
+            case Column::Timestamp:
+            case Column::MacTx:
+            case Column::MacRx:
+                return Int64;
+            default:
+                return column_type(column) == ColumnType::Real ? Double : Int32;
+        }
+    }
+
+    template<class T>
+    void put(std::string &out, T value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // Thrift compact protocol, only what the Parquet metadata needs
+    class CompactWriter {
+    private:
+        enum { I32 = 5, I64 = 6, Binary = 8, List = 9, Struct = 12 };
+
+        std::string &out;
+        int16_t last_id = 0;
+        std::vector<int16_t> outer_ids;
+
+        void field(int16_t id, uint8_t type) {
+            int delta = id - last_id;
+            if (delta > 0 && delta <= 15) {
+                out += static_cast<char>(delta << 4 | type);
+            } else {
+                out += static_cast<char>(type);
+                varint::put(out, varint::zigzag(id));
+            }
+            last_id = id;
+        }
+
+        void list_header(uint8_t type, size_t size) {
+            if (size < 15) {
+                out += static_cast<char>(size << 4 | type);
+            } else {
+                out += static_cast<char>(0xf0 | type);
+                varint::put(out, size);
+            }
+        }
+
+    public:
+        explicit CompactWriter(std::string &target) : out(target) {
+        }
+
+        void i32(int16_t id, int32_t value) {
+            field(id, I32);
+            varint::put(out, varint::zigzag(value));
+        }
+
+        void i64(int16_t id, int64_t value) {
+            field(id, I64);
+            varint::put(out, varint::zigzag(value));
+        }
+
+        void binary(int16_t id, std::string_view value) {
+            field(id, Binary);
+            varint::put(out, value.size());
+            out += value;
+        }
+
+        void begin_struct(int16_t id) {
+            field(id, Struct);
+            begin_element();
+        }
+
+        void i32_list(int16_t id, const std::vector<int> &values) {
+            field(id, List);
+            list_header(I32, values.size());
+            for (int value: values) {
+                varint::put(out, varint::zigzag(value));
+            }
+        }
+
+        void binary_list(int16_t id, std::string_view value) {
+            field(id, List);
+            list_header(Binary, 1);
+            varint::put(out, value.size());
+            out += value;
+        }
+
+        void struct_list(int16_t id, size_t size) {
+            field(id, List);
+            list_header(Struct, size);
+        }
+
+        // Each struct of a struct_list
+        void begin_element() {
+            outer_ids.push_back(last_id);
+            last_id = 0;
+        }
+
+        void end_struct() {
+            out += '\0';
+            if (!outer_ids.empty()) {
+                last_id = outer_ids.back();
+                outer_ids.pop_back();
+            }
+        }
+    };
+
+    // RLE / bit-packing hybrid of values below 2^width: runs of 8+ equal values become RLE runs,
+    // everything else is bit-packed in groups of 8
+    void encode_hybrid(const std::vector<uint32_t> &values, unsigned width, std::string &out) {
+        std::vector<uint32_t> literals;
+        auto flush_literals = [&] {
+            if (literals.empty()) {
+                return;
+            }
+            size_t groups = (literals.size() + 7) / 8;
+            varint::put(out, groups << 1 | 1);
+            uint64_t bits = 0;
+            unsigned count = 0;
+            for (size_t i = 0; i < groups * 8; i++) {
+                bits |= uint64_t(i < literals.size() ? literals[i] : 0) << count;
+                count += width;
+                while (count >= 8) {
+                    out += static_cast<char>(bits);
+                    bits >>= 8;
+                    count -= 8;
+                }
+            }
+            literals.clear();
+        };
+
+        size_t i = 0;
+        while (i < values.size()) {
+            size_t run = 1;
+            while (i + run < values.size() && values[i + run] == values[i]) {
+                run++;
+            }
+            // A bit-packed run has to stay a multiple of 8 unless it ends the data: top it up first
+            while (run > 0 && literals.size() % 8 != 0) {
+                literals.push_back(values[i++]);
+                run--;
+            }
+            if (run >= 8) {
+                flush_literals();
+                varint::put(out, run << 1);
+                for (unsigned byte = 0; byte < (width + 7) / 8; byte++) {
+                    out += static_cast<char>(values[i] >> (8 * byte));
+                }
+                i += run;
+            } else {
+                literals.insert(literals.end(), values.begin() + i, values.begin() + i + run);
+                i += run;
+            }
+        }
+        flush_literals();
+    }
+
+    std::string_view string_value(Column column, int64_t value, const std::vector<std::string> &sources,
+                                  char *scratch) {
+        switch (column) {
+            case Column::Rnti:
+                snprintf(scratch, 5, "%04x", static_cast<unsigned>(value));
+                return {scratch, 4};
+            case Column::State:
+                return state_name(static_cast<UEState>(value));
+            default:
+                return static_cast<size_t>(value) < sources.size() ? sources[value] : std::string_view();
+        }
+    }
+}
+
+ParquetOutput::ParquetOutput(const std::string &path, ColumnMask selected,
+                             const std::vector<std::string> &source_names, int page_level)
+    : zstd_level(page_level), sources(source_names) {
+    for (ColumnMask left = selected; left; left &= left - 1) {
+        buffers.push_back({static_cast<Column>(std::countr_zero(left)), {}, {}});
+    }
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    write_bytes("PAR1");
+    data_end = 4;
+    write_footer();
+}
+
+ParquetOutput::~ParquetOutput() {
+    if (fd < 0) {
+        return;
+    }
+    if (buffered_rows > 0) {
+        flush_row_group();
+    }
+    close(fd);
+    if (write_error) {
+        std::cerr << "Writing the Parquet file failed: " << std::strerror(write_error) << std::endl;
+    }
+}
+
+void ParquetOutput::write(const UEData &data) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (ColumnBuffer &buffer: buffers) {
+        if (column_type(buffer.column) == ColumnType::Real) {
+            buffer.reals.push_back(column_real(data, buffer.column));
+        } else {
+            buffer.integers.push_back(column_integer(data, buffer.column));
+        }
+    }
+    if (++buffered_rows == row_group_rows) {
+        flush_row_group();
+    }
+}
+
+void ParquetOutput::write_bytes(const std::string &bytes) {
+    for (size_t done = 0; done < bytes.size() && !write_error;) {
+        ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            write_error = errno;
+            return;
+        }
+        done += n;
+    }
+}
+
+std::pair<size_t, size_t> ParquetOutput::write_page(int page_type, const std::string &body, size_t values,
+                                                    int encoding) {
+    std::string compressed;
+    bool packed = zstd_level && zstd_compress(body.data(), body.size(), compressed, zstd_level);
+    const std::string &stored = packed ? compressed : body;
+
+    std::string header;
+    CompactWriter thrift(header);
+    thrift.i32(1, page_type);
+    thrift.i32(2, body.size());
+    thrift.i32(3, stored.size());
+    thrift.begin_struct(page_type == DictionaryPage ? 7 : 5);
+    thrift.i32(1, values);
+    thrift.i32(2, encoding);
+    if (page_type == DataPage) {
+        // No levels are stored for required columns, but the fields are mandatory
+        thrift.i32(3, Rle);
+        thrift.i32(4, Rle);
+    }
+    thrift.end_struct();
+    thrift.end_struct();
+
+    write_bytes(header);
+    write_bytes(stored);
+    return {header.size() + body.size(), header.size() + stored.size()};
+}
+
+void ParquetOutput::flush_row_group() {
+    // Overwrites the footer of the previous row group
+    lseek(fd, data_end, SEEK_SET);
+    uint64_t offset = data_end;
+
+    std::string group;
+    CompactWriter meta(group);
+    meta.struct_list(1, buffers.size());
+    int64_t group_bytes = 0;
+
+    for (ColumnBuffer &buffer: buffers) {
+        Type type = physical_type(buffer.column);
+        std::string body;
+        std::vector<int> encodings = {Plain, Rle};
+        int64_t dictionary_offset = -1;
+        size_t uncompressed = 0;
+        size_t stored = 0;
+
+        // Dictionary: string columns always, INT32 columns while they have few distinct values
+        std::vector<int64_t> dictionary;
+        std::vector<uint32_t> indices;
+        if (type == ByteArray || type == Int32) {
+            std::unordered_map<int64_t, uint32_t> ids;
+            indices.reserve(buffer.integers.size());
+            for (int64_t value: buffer.integers) {
+                auto [it, added] = ids.emplace(value, dictionary.size());
+                if (added) {
+                    dictionary.push_back(value);
+                    if (type == Int32 && dictionary.size() > max_int_dictionary) {
+                        break;
+                    }
+                }
+                indices.push_back(it->second);
+            }
+            if (type == Int32 && dictionary.size() > max_int_dictionary) {
+                dictionary.clear();
+                indices.clear();
+            }
+        }
+
+        if (!dictionary.empty()) {
+            char scratch[8];
+            for (int64_t value: dictionary) {
+                if (type == ByteArray) {
+                    std::string_view text = string_value(buffer.column, value, sources, scratch);
+                    put(body, static_cast<uint32_t>(text.size()));
+                    body += text;
+                } else {
+                    put(body, static_cast<int32_t>(value));
+                }
+            }
+            dictionary_offset = offset;
+            auto [raw, disk] = write_page(DictionaryPage, body, dictionary.size(), Plain);
+            uncompressed += raw;
+            stored += disk;
+
+            unsigned width = std::max(1, static_cast<int>(std::bit_width(dictionary.size() - 1)));
+            body.assign(1, static_cast<char>(width));
+            encode_hybrid(indices, width, body);
+            encodings.push_back(RleDictionary);
+        } else {
+            body.clear();
+            for (size_t i = 0; i < buffered_rows; i++) {
+                if (type == Double) {
+                    put(body, buffer.reals[i]);
+                } else if (type == Int64) {
+                    int64_t value = buffer.integers[i];
+                    put(body, buffer.column == Column::Timestamp ? value * 1000 : value);
+                } else {
+                    put(body, static_cast<int32_t>(buffer.integers[i]));
+                }
+            }
+        }
+        int64_t data_offset = offset + stored;
+        auto [raw, disk] = write_page(DataPage, body, buffered_rows, dictionary.empty() ? Plain : RleDictionary);
+        uncompressed += raw;
+        stored += disk;
+
+        meta.begin_element();
+        meta.i64(2, dictionary_offset >= 0 ? dictionary_offset : data_offset);
+        meta.begin_struct(3);
+        meta.i32(1, type);
+        meta.i32_list(2, encodings);
+        meta.binary_list(3, column_name(buffer.column));
+        meta.i32(4, zstd_level ? Zstd : Uncompressed);
+        meta.i64(5, buffered_rows);
+        meta.i64(6, uncompressed);
+        meta.i64(7, stored);
+        meta.i64(9, data_offset);
+        if (dictionary_offset >= 0) {
+            meta.i64(11, dictionary_offset);
+        }
+        if (type != ByteArray) {
+            // Min/max statistics let readers skip row groups
+            std::string min, max;
+            if (type == Double) {
+                auto [low, high] = std::minmax_element(buffer.reals.begin(), buffer.reals.end());
+                put(min, *low);
+                put(max, *high);
+            } else {
+                auto [low, high] = std::minmax_element(buffer.integers.begin(), buffer.integers.end());
+                int64_t scale = buffer.column == Column::Timestamp ? 1000 : 1;
+                if (type == Int64) {
+                    put(min, *low * scale);
+                    put(max, *high * scale);
+                } else {
+                    put(min, static_cast<int32_t>(*low));
+                    put(max, static_cast<int32_t>(*high));
+                }
+            }
+            meta.begin_struct(12);
+            meta.i64(3, 0);
+            meta.binary(5, max);
+            meta.binary(6, min);
+            meta.end_struct();
+        }
+        meta.end_struct();
+        meta.end_struct();
+
+        offset += stored;
+        group_bytes += uncompressed;
+        buffer.integers.clear();
+        buffer.reals.clear();
+    }
+    meta.i64(2, group_bytes);
+    meta.i64(3, buffered_rows);
+    meta.end_struct();
+
+    row_groups.push_back(std::move(group));
+    total_rows += buffered_rows;
+    buffered_rows = 0;
+    data_end = offset;
+    write_footer();
+}
+
+void ParquetOutput::write_footer() {
+    std::string footer;
+    CompactWriter meta(footer);
+    meta.i32(1, 1);
+
+    meta.struct_list(2, buffers.size() + 1);
+    meta.begin_element();
+    meta.binary(4, "schema");
+    meta.i32(5, buffers.size());
+    meta.end_struct();
+    for (const ColumnBuffer &buffer: buffers) {
+        Type type = physical_type(buffer.column);
+        meta.begin_element();
+        meta.i32(1, type);
+        meta.i32(3, 0); // REQUIRED
+        meta.binary(4, column_name(buffer.column));
+        if (type == ByteArray) {
+            meta.i32(6, Utf8);
+        } else if (buffer.column == Column::Timestamp) {
+            meta.i32(6, TimestampMillis);
+        }
+        meta.end_struct();
+    }
+
+    meta.i64(3, total_rows);
+    meta.struct_list(4, row_groups.size());
+    for (const std::string &group: row_groups) {
+        footer += group;
+    }
+    meta.binary(6, "gnb_parser");
+
+    // Type-defined sort order, without it readers ignore min_value / max_value
+    meta.struct_list(7, buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        meta.begin_element();
+        meta.begin_struct(1);
+        meta.end_struct();
+        meta.end_struct();
+    }
+    meta.end_struct();
+
+    put(footer, static_cast<uint32_t>(footer.size()));
+    footer += "PAR1";
+
+    lseek(fd, data_end, SEEK_SET);
+    write_bytes(footer);
+    if (ftruncate(fd, data_end + footer.size()) != 0 && !write_error) {
+        write_error = errno;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "columns.h"
+#include "record_sink.h"
+
+
+/* Apache Parquet output (--format parquet)
+ *
+ * Records are buffered column by column and written as one row group per row_group_rows rows, one
+ * page per column chunk:
+ *   - rnti, state and source are strings, dictionary encoded (RLE/bit-packed dictionary indices)
+ *   - 32-bit integers (cqi, ri, mcs, ...) are dictionary encoded the same way while a row group
+ *     has few distinct values, which bit-packs them to a few bits each and run-length encodes
+ *     repeats; otherwise PLAIN
+ *   - timestamp (milliseconds, TIMESTAMP_MILLIS), mac_tx/mac_rx and the reals are PLAIN
+ * With --compress zstd every page is zstd compressed (at --compress-level) instead of the whole file.
+ *
+ * After every row group the footer is written behind it, and the next row group overwrites that
+ * footer. The file therefore stays a readable Parquet file up to the last complete row group even
+ * if the process is killed, and SIGINT/SIGTERM close it with every buffered row.
+ */
+class ParquetOutput : public RecordSink {
+private:
+    static constexpr size_t row_group_rows = 65536;
+
+    struct ColumnBuffer {
+        Column column;
+        std::vector<int64_t> integers; // integer columns
+        std::vector<double> reals; // real columns
+    };
+
+    std::mutex lock;
+    int fd = -1;
+    int write_error = 0;
+    int zstd_level; // 0: uncompressed pages
+    std::vector<std::string> sources;
+    std::vector<ColumnBuffer> buffers;
+    size_t buffered_rows = 0;
+
+    uint64_t data_end = 0; // where the next row group goes, the current footer starts here
+    uint64_t total_rows = 0;
+    std::vector<std::string> row_groups; // serialized RowGroup metadata
+
+    void write_bytes(const std::string &bytes);
+
+    // Writes one page (header and body) and returns the bytes it took uncompressed / on disk
+    std::pair<size_t, size_t> write_page(int page_type, const std::string &body, size_t values, int encoding);
+
+    void flush_row_group();
+
+    void write_footer();
+
+public:
+    ParquetOutput(const std::string &path, ColumnMask selected, const std::vector<std::string> &source_names,
+                  int page_level);
+
+    ~ParquetOutput() override;
+
+    bool is_open() const {
+        return fd >= 0;
+    }
+
+    int error() const {
+        return write_error;
+    }
+
+    void write(const UEData &data) override;
+};
@@ -0,0 +1,193 @@
+#include "parser.h"
+
+#include <ctime>
+
+#include "checkpoint.h"
+#include "fields.h"
+
+
+UEData &Parser::create_ue_data(uint16_t rnti) {
+    bool created;
+    UEData &data = temp_ue_data.get_or_create(rnti, created);
+    if (created) {
+        data.rnti = rnti;
+        data.source = source;
+        data.timestamp = std::time(nullptr);
+    }
+    return data;
+}
+
+void Parser::store_data(uint16_t rnti) {
+    output.write(*temp_ue_data.find(rnti));
+    records++;
+
+    // Only clear this RNTI's data
+    temp_ue_data.erase(rnti);
+    awaiting_mac[rnti] = false;
+}
+
+void Parser::parse_line(std::string_view line) {
+    size_t at = line.find("UE ");
+    if (at == std::string_view::npos) {
+        if (line.find("Frame.Slot") != std::string_view::npos) {
+            new_period();
+        }
+        return;
+    }
+    if (skip_period) {
+        return;
+    }
+    FieldCursor c(line.substr(at + 3));
+    uint16_t rnti;
+
+    if (c.literal("RNTI ")) {
+        if (!c.hex16(rnti)) {
+            return;
+        }
+        // The previous record never got its MAC line: it is stored without the counters
+        if (awaiting_mac[rnti]) {
+            store_data(rnti);
+        }
+        int ue_id = 0, ph = 0, pcmax = 0, rsrp = 0;
+        std::string_view state;
+        if (wants(Column::UeId) || wants(Column::State) || filter.by_ue_id()) {
+            if (!(c.literal(" CU-UE-ID ") && c.uint(ue_id) && c.literal(" ") && c.token(state))) {
+                return;
+            }
+            if (filter.by_ue_id()) {
+                filter.bind(rnti, ue_id);
+            }
+        }
+        if (!filter.accepts(rnti) || !(columns & basic_line_columns)) {
+            return;
+        }
+        if ((!wants(Column::Ph) || (c.skip_past(" PH ") && c.integer(ph))) &&
+            (!wants(Column::Pcmax) || (c.skip_past(" PCMAX ") && c.integer(pcmax))) &&
+            (!wants(Column::Rsrp) || (c.skip_past(" average RSRP ") && c.integer(rsrp)))) {
+            UEData &data = create_ue_data(rnti);
+            data.timestamp = std::time(nullptr);
+            data.ue_id = ue_id;
+            data.state = state == "in-sync" ? UEState::InSync
+                         : state == "out-of-sync" ? UEState::OutOfSync
+                         : UEState::Unknown;
+            data.ph = ph;
+            data.pcmax = pcmax;
+            data.rsrp = rsrp;
+        }
+        return;
+    }
+
+    if (!c.hex16(rnti) || !filter.accepts(rnti) || !c.literal(": ")) {
+        return;
+    }
+
+    if (c.literal("CQI ")) {
+        int cqi = 0, ri = 0;
+        if ((columns & indicators_line_columns) &&
+            (!wants(Column::Cqi) || c.uint(cqi)) &&
+            (!wants(Column::DlRi) || (c.skip_past(", RI ") && c.uint(ri)))) {
+            UEData &data = create_ue_data(rnti);
+            data.cqi = cqi;
+            data.dl_ri = ri;
+        }
+    } else if (c.literal("UL-RI ")) {
+        int ri;
+        if ((columns & ul_ri_line_columns) && c.uint(ri)) {
+            create_ue_data(rnti).ul_ri = ri;
+        }
+    } else if (c.literal("dlsch_rounds ")) {
+        int err = 0, dtx = 0, mcs = 0;
+        double bler = 0;
+        if ((columns & dl_phy_line_columns) &&
+            (!wants(Column::DlschErr) || (c.skip_past(" dlsch_errors ") && c.uint(err))) &&
+            (!wants(Column::PucchDtx) || (c.skip_past(" pucch0_DTX ") && c.uint(dtx))) &&
+            (!wants(Column::DlBler) || (c.skip_past(" BLER ") && c.real(bler))) &&
+            (!wants(Column::DlMcs) || (c.skip_past(" MCS ") && c.parenthesised() && c.uint(mcs)))) {
+            UEData &data = create_ue_data(rnti);
+            data.dlsch_err = err;
+            data.pucch_dtx = dtx;
+            data.dl_bler = bler;
+            data.dl_mcs = mcs;
+        }
+    } else if (c.literal("ulsch_rounds ")) {
+        // Completes the record, so it is handled even when none of its own fields are selected
+        int err = 0, dtx = 0, mcs = 0, nprb = 0;
+        double bler = 0, snr = 0;
+        if ((!wants(Column::UlschErr) || (c.skip_past(" ulsch_errors ") && c.uint(err))) &&
+            (!wants(Column::UlschDtx) || (c.skip_past(" ulsch_DTX ") && c.uint(dtx))) &&
+            (!wants(Column::UlBler) || (c.skip_past(" BLER ") && c.real(bler))) &&
+            (!wants(Column::UlMcs) || (c.skip_past(" MCS ") && c.parenthesised() && c.uint(mcs))) &&
+            (!wants(Column::Nprb) || (c.skip_past(" NPRB ") && c.uint(nprb))) &&
+            (!wants(Column::Snr) || (c.skip_past(" SNR ") && c.real(snr)))) {
+            UEData &data = create_ue_data(rnti);
+            data.ulsch_err = err;
+            data.ulsch_dtx = dtx;
+            data.ul_bler = bler;
+            data.ul_mcs = mcs;
+            data.nprb = nprb;
+            data.snr = snr;
+            // With the MAC counters selected, the MAC line printed next completes the record
+            if (columns & mac_line_columns) {
+                awaiting_mac[rnti] = true;
+            } else {
+                store_data(rnti);
+            }
+        }
+    } else if (c.literal("MAC:")) {
+        if (!awaiting_mac[rnti]) {
+            return;
+        }
+        uint64_t tx = 0, rx = 0;
+        if (c.spaces() && c.literal("TX") && c.spaces() && c.uint(tx) && c.spaces() && c.literal("RX") &&
+            c.spaces() && c.uint(rx)) {
+            UEData &data = *temp_ue_data.find(rnti);
+            data.mac_tx = tx;
+            data.mac_rx = rx;
+        }
+        store_data(rnti);
+    }
+}
+
+void Parser::finish() {
+    for (uint32_t rnti = 0; rnti < awaiting_mac.size(); rnti++) {
+        if (awaiting_mac[rnti]) {
+            store_data(static_cast<uint16_t>(rnti));
+        }
+    }
+}
+
+void Parser::save_state(std::string &out) const {
+    put_raw(out, periods_seen);
+    put_raw(out, periods_kept);
+    put_raw(out, records);
+    put_raw(out, static_cast<uint32_t>(temp_ue_data.size()));
+    temp_ue_data.for_each([&](const UEData &data) {
+        put_raw(out, data);
+        put_raw(out, static_cast<uint8_t>(awaiting_mac[data.rnti]));
+    });
+}
+
+bool Parser::restore_state(std::string_view state) {
+    const char *p = state.data();
+    const char *end = p + state.size();
+    uint64_t seen, kept, written;
+    uint32_t count;
+    if (!get_raw(p, end, seen) || !get_raw(p, end, kept) || !get_raw(p, end, written) || !get_raw(p, end, count) ||
+        static_cast<size_t>(end - p) != count * (sizeof(UEData) + 1)) {
+        return false;
+    }
+    periods_seen = seen;
+    periods_kept = kept;
+    records = written;
+    for (uint32_t i = 0; i < count; i++) {
+        UEData data;
+        uint8_t awaiting;
+        if (!get_raw(p, end, data) || !get_raw(p, end, awaiting)) {
+            return false;
+        }
+        bool created;
+        temp_ue_data.get_or_create(data.rnti, created) = data;
+        awaiting_mac[data.rnti] = awaiting != 0;
+    }
+    return true;
+}
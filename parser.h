@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "columns.h"
+#include "overload.h"
+#include "record_sink.h"
+#include "ue_data.h"
+#include "ue_filter.h"
+#include "ue_table.h"
+
+
+/* Example Frame Slot format
+ *
+ *   [NR_MAC]   Frame.Slot 128.0
+ *   UE RNTI 928c CU-UE-ID 1 in-sync PH 45 dB PCMAX 21 dBm, average RSRP -83 (17 meas)
+ *   UE 928c: CQI 13, RI 2, PMI (0,0)
+ *   UE 928c: UL-RI 1, TPMI 0
+ *   UE 928c: dlsch_rounds 681/10/1/0, dlsch_errors 0, pucch0_DTX 9, BLER 0.02678 MCS (1) 22
+ *   UE 928c: ulsch_rounds 1136/77/0/0, ulsch_errors 0, ulsch_DTX 0, BLER 0.07390 MCS (1) 6 (Qm 4 deltaMCS 0 dB) NPRB 106  SNR 17.5 dB
+ *   UE 928c: MAC:    TX         344885 RX        2627890 bytes
+ *   UE 928c: LCID 1: TX            369 RX           1074 bytes
+ *   UE 928c: LCID 2: TX              3 RX             25 bytes
+ *   UE 928c: LCID 4: TX          43621 RX        2616709 bytes
+ *   UE RNTI 6542 CU-UE-ID 1 in-sync PH 45 dB PCMAX 21 dBm, average RSRP -83 (17 meas)
+ */
+
+
+// Turns the stats lines of one gNB into UE records. Each input has its own Parser (and so its own
+// UE table); completed records go to the shared sink.
+class Parser {
+private:
+    RecordSink &output;
+    uint16_t source;
+
+    UETable temp_ue_data;
+    // Records whose ulsch line was parsed, waiting for the MAC line that completes them
+    std::vector<bool> awaiting_mac = std::vector<bool>(65536);
+
+    ColumnMask columns;
+    UEFilter filter;
+
+    // Load shedding state, see OverloadController
+    ColumnMask decoded;
+    unsigned period_stride = 1;
+    bool skip_period = false;
+    uint64_t periods_seen = 0;
+    uint64_t periods_kept = 0;
+
+    uint64_t records = 0;
+
+    bool wants(Column column) const {
+        return decoded & column_bit(column);
+    }
+
+    void new_period() {
+        periods_seen++;
+        skip_period = periods_seen % period_stride != 0;
+        periods_kept += !skip_period;
+    }
+
+    UEData &create_ue_data(uint16_t rnti);
+
+    void store_data(uint16_t rnti);
+
+public:
+    explicit Parser(RecordSink &sink, ColumnMask selected = default_columns, const UEFilter &ue_filter = UEFilter(),
+                    uint16_t source_index = 0)
+        : output(sink), source(source_index), columns(selected), filter(ue_filter), decoded(selected) {
+    }
+
+    void shed(const ShedMode &mode) {
+        decoded = columns & mode.decoded;
+        period_stride = mode.period_stride;
+    }
+
+    uint64_t stats_periods() const {
+        return periods_seen;
+    }
+
+    uint64_t stats_periods_kept() const {
+        return periods_kept;
+    }
+
+    uint64_t records_written() const {
+        return records;
+    }
+
+    // End of input: stores the records still waiting for a MAC line
+    void finish();
+
+    // --checkpoint: the partially assembled records and the period counters
+    void save_state(std::string &out) const;
+
+    // False, restoring nothing, when the state is damaged
+    bool restore_state(std::string_view state);
+
+// Fields are decoded in place with the SWAR helpers and applied once every selected field of the
+// line decoded, so a truncated line changes nothing. Unselected fields are never decoded: the
+// label search for the next selected field steps over them, and line types without a selected
+// field are dropped right after the RNTI, as are lines of UEs rejected by --rnti / --ue-id.
+    void parse_line(std::string_view line);
+};
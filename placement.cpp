@@ -0,0 +1,132 @@
+#include "placement.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+
+namespace {
+    struct Settings {
+        cpu_set_t cpus[static_cast<size_t>(ThreadRole::Count)];
+        bool has_cpus[static_cast<size_t>(ThreadRole::Count)] = {};
+        cpu_set_t any_cpus;
+        bool has_any_cpus = false;
+        int nice = 0;
+        bool idle = false;
+    };
+
+    Settings settings;
+
+    std::atomic<bool> affinity_failed{false};
+    std::atomic<bool> priority_failed{false};
+
+    const char *role_names[] = {"reader", "parser", "writer"};
+
+    // "3", "2-5", "1,3,8-9"
+    bool parse_cpu_list(const std::string &text, cpu_set_t &set) {
+        CPU_ZERO(&set);
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t comma = text.find(',', start);
+            std::string item = text.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+            size_t dash = item.find('-');
+            char *end;
+            unsigned long first = std::strtoul(item.c_str(), &end, 10);
+            if (end == item.c_str()) {
+                return false;
+            }
+            unsigned long last = first;
+            if (dash != std::string::npos) {
+                const char *upper = item.c_str() + dash + 1;
+                last = std::strtoul(upper, &end, 10);
+                if (end == upper) {
+                    return false;
+                }
+            }
+            if (*end != '\0' || last < first || last >= CPU_SETSIZE) {
+                return false;
+            }
+            for (unsigned long cpu = first; cpu <= last; cpu++) {
+                CPU_SET(cpu, &set);
+            }
+            if (comma == std::string::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
+        return true;
+    }
+}
+
+bool add_cpu_spec(const std::string &spec, std::string &error) {
+    size_t equals = spec.find('=');
+    std::string list = equals == std::string::npos ? spec : spec.substr(equals + 1);
+    cpu_set_t *set = &settings.any_cpus;
+    bool *has = &settings.has_any_cpus;
+    if (equals != std::string::npos) {
+        std::string role = spec.substr(0, equals);
+        size_t i = 0;
+        while (i < std::size(role_names) && role != role_names[i]) {
+            i++;
+        }
+        if (i == std::size(role_names)) {
+            error = "unknown role " + role + " (reader, parser, writer)";
+            return false;
+        }
+        set = &settings.cpus[i];
+        has = &settings.has_cpus[i];
+    }
+    if (!parse_cpu_list(list, *set)) {
+        error = "bad CPU list " + list;
+        return false;
+    }
+    *has = true;
+    return true;
+}
+
+void set_thread_priority(int nice, bool idle) {
+    settings.nice = nice;
+    settings.idle = idle;
+}
+
+void place_thread(ThreadRole role) {
+    auto index = static_cast<size_t>(role);
+    const cpu_set_t *cpus = settings.has_cpus[index] ? &settings.cpus[index]
+                            : settings.has_any_cpus ? &settings.any_cpus : nullptr;
+    if (cpus && sched_setaffinity(0, sizeof(cpu_set_t), cpus) != 0 && !affinity_failed.exchange(true)) {
+        std::cerr << "--cpu: cannot pin the " << role_names[index] << " thread: " << std::strerror(errno)
+                << std::endl;
+    }
+
+    // Both are per thread on Linux
+    bool failed = false;
+    if (settings.idle) {
+        sched_param param{};
+        failed |= sched_setscheduler(0, SCHED_IDLE, &param) != 0;
+    }
+    if (settings.nice != 0) {
+        failed |= setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), settings.nice) != 0;
+    }
+    if (failed && !priority_failed.exchange(true)) {
+        std::cerr << "--nice/--idle: " << std::strerror(errno) << std::endl;
+    }
+}
+
+bool lock_memory(std::string &error) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        int code = errno;
+        error = std::strerror(code);
+        if (code == ENOMEM || code == EPERM) {
+            error += " (raise the memlock limit, e.g. ulimit -l unlimited, or grant CAP_IPC_LOCK)";
+        }
+        return false;
+    }
+    return true;
+}
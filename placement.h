@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+
+/* --cpu / --nice / --idle / --mlock: staying out of the gNB's way
+ *
+ * main records the settings before it starts any thread; every thread then calls place_thread()
+ * with its role as the first thing it does, which pins it to the CPUs of that role and applies
+ * the nice value and SCHED_IDLE. Roles without CPUs of their own use the CPUs given without a
+ * role, or stay where the scheduler puts them.
+ *   - reader: the --input event loop
+ *   - parser: the --input workers, and the main thread when reading stdin (it reads and parses)
+ *   - writer: compression, rotation, async writes, --tee archive, --export sender
+ */
+enum class ThreadRole {
+    Reader,
+    Parser,
+    Writer,
+    Count
+};
+
+// "2-5", "reader=2", "parser=3,4" (one --cpu option each); false with error set on a bad list
+bool add_cpu_spec(const std::string &spec, std::string &error);
+
+// nice value for every thread (0 leaves it), and SCHED_IDLE: only run when a CPU is otherwise idle
+void set_thread_priority(int nice, bool idle);
+
+// Applies the settings to the calling thread; problems are reported once per kind
+void place_thread(ThreadRole role);
+
+// mlockall(MCL_CURRENT | MCL_FUTURE): everything mapped now and later is faulted in and stays
+// resident, so parsing never waits for a page fault; false with error set
+bool lock_memory(std::string &error);
@@ -0,0 +1,230 @@
+#include "publisher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "input.h"
+
+
+namespace {
+    // Log-linear buckets: exact below 32 ns, then 32 per power of two
+    constexpr unsigned sub_bits = 5;
+    constexpr unsigned sub_buckets = 1 << sub_bits;
+    constexpr size_t bucket_count = sub_buckets + (64 - sub_bits) * sub_buckets;
+
+    size_t bucket_of(uint64_t ns) {
+        if (ns < sub_buckets) {
+            return ns;
+        }
+        unsigned exponent = 63 - __builtin_clzll(ns);
+        uint64_t sub = (ns >> (exponent - sub_bits)) & (sub_buckets - 1);
+        return sub_buckets + (exponent - sub_bits) * sub_buckets + sub;
+    }
+
+    uint64_t bucket_start(size_t bucket) {
+        if (bucket < sub_buckets) {
+            return bucket;
+        }
+        size_t exponent = (bucket - sub_buckets) / sub_buckets + sub_bits;
+        uint64_t sub = (bucket - sub_buckets) % sub_buckets;
+        return (sub_buckets + sub) << (exponent - sub_bits);
+    }
+
+    constexpr size_t header_size = (sizeof(PublishRingHeader) + 63) / 64 * 64;
+
+    PublishRingSlot &slot_at(PublishRingHeader *ring, uint64_t n) {
+        auto *slots = reinterpret_cast<PublishRingSlot *>(reinterpret_cast<char *>(ring) + header_size);
+        return slots[n & (ring->slots - 1)];
+    }
+}
+
+int64_t monotonic_ns() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+RecordPublisher::RecordPublisher(RecordSink &next_sink, const std::string &target)
+    : next(next_sink), latency_counts(bucket_count) {
+    if (target.starts_with("shm:") && target.size() > 4) {
+        shm_name = "/" + target.substr(4);
+        if (!open_ring()) {
+            std::cerr << "--latency: cannot create " << target << ": " << std::strerror(errno) << std::endl;
+        }
+    } else if (target.starts_with("unix:") && target.size() > 5) {
+        if (target.size() - 5 >= sizeof(sockaddr_un::sun_path)) {
+            std::cerr << "--latency: socket path too long: " << target << std::endl;
+            return;
+        }
+        fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "--latency: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        socket_path = target.substr(5);
+    } else {
+        std::cerr << "--latency: expected shm:<name> or unix:<path>, got " << target << std::endl;
+    }
+}
+
+RecordPublisher::~RecordPublisher() {
+    // The ring stays in /dev/shm for readers still catching up; the next run starts it over
+    if (ring) {
+        munmap(ring, ring_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool RecordPublisher::open_ring() {
+    int shm = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (shm < 0) {
+        return false;
+    }
+    ring_size = header_size + ring_slots * sizeof(PublishRingSlot);
+    void *address = MAP_FAILED;
+    if (ftruncate(shm, static_cast<off_t>(ring_size)) == 0) {
+        address = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, shm, 0);
+    }
+    int code = errno;
+    close(shm);
+    if (address == MAP_FAILED) {
+        shm_unlink(shm_name.c_str());
+        errno = code;
+        return false;
+    }
+
+    ring = new(address) PublishRingHeader{};
+    ring->magic = PublishRingHeader::magic_value;
+    ring->version = PublishRingHeader::version_value;
+    ring->slots = ring_slots;
+    ring->slot_size = sizeof(PublishRingSlot);
+    for (uint32_t i = 0; i < ring_slots; i++) {
+        new(&slot_at(ring, i)) PublishRingSlot{};
+    }
+    return true;
+}
+
+bool RecordPublisher::connect_socket() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    connected = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+    return connected;
+}
+
+void RecordPublisher::send(const PublishedRecord &record) {
+    // Nobody listening: try again at most once a second, and drop until then
+    if (!connected && (record.publish_ns < next_connect_ns || !connect_socket())) {
+        next_connect_ns = std::max(next_connect_ns, record.publish_ns + 1000000000);
+        dropped++;
+        return;
+    }
+    if (::send(fd, &record, sizeof(record), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(record)) {
+        return;
+    }
+    if (errno == ECONNREFUSED || errno == ENOTCONN) {
+        // The listener went away; a new one may bind the same path
+        connected = false;
+        next_connect_ns = record.publish_ns + 1000000000;
+    }
+    dropped++;
+}
+
+void RecordPublisher::record_latency(uint64_t ns) {
+    latency_counts[bucket_of(ns)]++;
+    latency_max = std::max(latency_max, ns);
+}
+
+uint64_t RecordPublisher::latency_quantile(double q) const {
+    uint64_t total = 0;
+    for (uint64_t count: latency_counts) {
+        total += count;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < latency_counts.size(); bucket++) {
+        seen += latency_counts[bucket];
+        if (seen >= rank && seen > 0) {
+            return bucket_start(bucket);
+        }
+    }
+    return 0;
+}
+
+void RecordPublisher::write(const UEData &data) {
+    PublishedRecord record{};
+    record.sequence = sequence;
+    record.read_ns = clock ? clock->last_read_ns() : 0;
+    record.timestamp = data.timestamp;
+    record.mac_tx = data.mac_tx;
+    record.mac_rx = data.mac_rx;
+    record.rsrp = data.rsrp;
+    record.dl_bler = data.dl_bler;
+    record.ul_bler = data.ul_bler;
+    record.snr = data.snr;
+    record.ue_id = data.ue_id;
+    record.ph = data.ph;
+    record.pcmax = data.pcmax;
+    record.cqi = data.cqi;
+    record.dl_ri = data.dl_ri;
+    record.ul_ri = data.ul_ri;
+    record.dlsch_err = data.dlsch_err;
+    record.pucch_dtx = data.pucch_dtx;
+    record.dl_mcs = data.dl_mcs;
+    record.ulsch_err = data.ulsch_err;
+    record.ulsch_dtx = data.ulsch_dtx;
+    record.ul_mcs = data.ul_mcs;
+    record.nprb = data.nprb;
+    record.rnti = data.rnti;
+    record.source = data.source;
+    record.state = static_cast<uint8_t>(data.state);
+    record.publish_ns = monotonic_ns();
+
+    if (ring) {
+        PublishRingSlot &slot = slot_at(ring, sequence);
+        slot.sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.record = record;
+        slot.sequence.store(2 * sequence + 2, std::memory_order_release);
+        ring->written.store(sequence + 1, std::memory_order_release);
+    } else if (fd >= 0) {
+        send(record);
+    }
+    sequence++;
+
+    if (clock) {
+        record_latency(static_cast<uint64_t>(std::max<int64_t>(0, record.publish_ns - record.read_ns)));
+    }
+    next.write(data);
+}
+
+void RecordPublisher::print_stats() const {
+    std::cerr << "--latency: " << sequence << " records published";
+    if (dropped > 0) {
+        std::cerr << ", " << dropped << " dropped (no listener, or it fell behind)";
+    }
+    std::cerr << std::endl;
+    if (!clock || sequence == 0) {
+        return;
+    }
+    auto us = [](uint64_t ns) {
+        return static_cast<double>(ns) / 1000;
+    };
+    std::cerr << std::fixed << std::setprecision(1) << "--latency: read to publish p50 "
+            << us(latency_quantile(0.5)) << " us, p99 " << us(latency_quantile(0.99)) << " us, p999 "
+            << us(latency_quantile(0.999)) << " us, max " << us(latency_max) << " us" << std::endl;
+    std::cerr << std::defaultfloat;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "record_sink.h"
+#include "ue_data.h"
+
+
+class BusyPollInput;
+
+// One record as published by --latency: fixed-width fields, native byte order (the consumer runs
+// on the same host). Times are CLOCK_MONOTONIC nanoseconds.
+struct PublishedRecord {
+    uint64_t sequence; // 0, 1, 2, ... for the run
+    int64_t read_ns; // when the bytes holding the completing (ulsch) line were read
+    int64_t publish_ns;
+    int64_t timestamp; // Unix seconds, as in the CSV
+    uint64_t mac_tx;
+    uint64_t mac_rx;
+    double rsrp;
+    double dl_bler;
+    double ul_bler;
+    double snr;
+    int32_t ue_id;
+    int32_t ph;
+    int32_t pcmax;
+    int32_t cqi;
+    int32_t dl_ri;
+    int32_t ul_ri;
+    int32_t dlsch_err;
+    int32_t pucch_dtx;
+    int32_t dl_mcs;
+    int32_t ulsch_err;
+    int32_t ulsch_dtx;
+    int32_t ul_mcs;
+    int32_t nprb;
+    uint16_t rnti;
+    uint16_t source;
+    uint8_t state; // UEState
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(PublishedRecord) == 144);
+
+/* Layout of the shm:<name> ring (/dev/shm/<name>)
+ *
+ * A header, then slots records in slots of slot_size bytes. Record n goes to slot n % slots, as
+ * a seqlock: the slot's sequence is 2n + 1 while it is written and 2n + 2 once it is complete,
+ * and written counts the records published. A reader wanting record n loads sequence (acquire),
+ * copies the record, fences (acquire) and loads sequence again; the copy is good when both loads
+ * were 2n + 2. Anything else means the writer lapped the reader, which then resynchronizes at
+ * written - slots.
+ */
+struct PublishRingHeader {
+    static constexpr uint32_t magic_value = 0x524e4247; // "GBNR"
+    static constexpr uint32_t version_value = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots; // a power of two
+    uint32_t slot_size;
+    alignas(64) std::atomic<uint64_t> written;
+};
+
+struct alignas(64) PublishRingSlot {
+    std::atomic<uint64_t> sequence;
+    PublishedRecord record;
+};
+
+/* --latency <target>: every completed record, as it completes
+ *
+ * Sits in front of the other sinks and publishes each record before they see it, either into a
+ * shared-memory ring (shm:<name>) or as one datagram to a Unix socket (unix:<path>). The datagram
+ * socket never blocks: while nobody listens, or when the listener's queue is full, the record is
+ * dropped and counted, and the connection is retried at most once a second. Fed by a
+ * BusyPollInput, the time from reading the bytes to publishing each record goes into a log-linear
+ * histogram (within 3%) whose p50/p99/p999 are printed at the end.
+ */
+class RecordPublisher : public RecordSink {
+private:
+    static constexpr uint32_t ring_slots = 4096;
+
+    RecordSink &next;
+    const BusyPollInput *clock = nullptr;
+    uint64_t sequence = 0;
+
+    // shm:
+    std::string shm_name;
+    PublishRingHeader *ring = nullptr;
+    size_t ring_size = 0;
+
+    // unix:
+    std::string socket_path;
+    int fd = -1;
+    bool connected = false;
+    int64_t next_connect_ns = 0;
+    uint64_t dropped = 0;
+
+    std::vector<uint64_t> latency_counts;
+    uint64_t latency_max = 0;
+
+    bool open_ring();
+
+    bool connect_socket();
+
+    void send(const PublishedRecord &record);
+
+    void record_latency(uint64_t ns);
+
+    // Lower bound of the histogram bucket holding the q-quantile
+    uint64_t latency_quantile(double q) const;
+
+public:
+    // Reports a bad target on stderr, see is_open()
+    RecordPublisher(RecordSink &next_sink, const std::string &target);
+
+    ~RecordPublisher() override;
+
+    bool is_open() const {
+        return ring || !socket_path.empty();
+    }
+
+    // The input whose read times the latency is measured from
+    void measure_from(const BusyPollInput &input) {
+        clock = &input;
+    }
+
+    void write(const UEData &data) override;
+
+    // Records published and dropped, and the latency quantiles, on stderr
+    void print_stats() const;
+};
+
+// CLOCK_MONOTONIC in nanoseconds
+int64_t monotonic_ns();
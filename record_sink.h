@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ue_data.h"
+
+
+// Receives every completed UE record. One set of sinks is shared by the parsers of all inputs, so
+// write() can be called from several worker threads.
+class RecordSink {
+public:
+    virtual ~RecordSink() = default;
+
+    virtual void write(const UEData &data) = 0;
+};
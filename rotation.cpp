@@ -0,0 +1,159 @@
+#include "rotation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+
+#include "placement.h"
+
+
+RotationThread::RotationThread(const RotationPolicy &policy) : rotation_policy(policy) {
+    worker = std::thread(&RotationThread::run, this);
+}
+
+RotationThread::~RotationThread() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void RotationThread::post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void RotationThread::run() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&] { return !jobs.empty() || stopping; });
+        if (jobs.empty()) {
+            return;
+        }
+        std::function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+        guard.unlock();
+        job();
+        guard.lock();
+    }
+}
+
+RotatingFile::RotatingFile(std::string file_stem, std::string file_extension, std::string file_header,
+                           const OutputOptions &output_options)
+    : stem(std::move(file_stem)), extension(std::move(file_extension)), header(std::move(file_header)),
+      options(output_options) {
+    current = std::make_unique<OutputFile>();
+    // A resumed run continues the file, or starts the segment after the last one
+    bool append = false;
+    if (options.resume && options.rotation) {
+        while (existing_size(segment_path(segment), options) > 0) {
+            segment++;
+        }
+    } else if (options.resume) {
+        append = existing_size(segment_path(0), options) > 0;
+    }
+    if (!current->open(segment_path(segment), options, append)) {
+        return;
+    }
+    if (!append) {
+        current->write(header);
+    }
+    current->flush();
+    if (options.rotation) {
+        prepare(segment + 1);
+    }
+}
+
+RotatingFile::~RotatingFile() {
+    if (current) {
+        current->close(options.rotation != nullptr);
+    }
+    if (!prepared) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(prepared->lock);
+    if (prepared->file) {
+        prepared->file->close();
+        unlink(prepared->file->path().c_str());
+    }
+    prepared->abandoned = true;
+}
+
+std::string RotatingFile::segment_path(unsigned n) const {
+    if (!options.rotation) {
+        return stem + extension;
+    }
+    char number[16];
+    std::snprintf(number, sizeof(number), ".%04u", n);
+    return stem + number + extension;
+}
+
+void RotatingFile::prepare(unsigned n) {
+    auto state = std::make_shared<Prepared>();
+    prepared = state;
+    options.rotation->post([state, path = segment_path(n), header = header, options = options] {
+        auto file = std::make_unique<OutputFile>();
+        if (file->open(path, options)) {
+            file->write(header);
+        } else {
+            std::cerr << "Cannot open " << path << ", continuing in the current segment" << std::endl;
+            file.reset();
+        }
+        std::lock_guard<std::mutex> guard(state->lock);
+        if (state->abandoned && file) {
+            file->close();
+            unlink(file->path().c_str());
+        } else {
+            state->file = std::move(file);
+        }
+        state->ready = true;
+        state->done.notify_one();
+    });
+}
+
+void RotatingFile::rotate() {
+    std::unique_ptr<OutputFile> next;
+    {
+        // Only waits when a whole segment was written faster than the next one could be opened
+        std::unique_lock<std::mutex> guard(prepared->lock);
+        prepared->done.wait(guard, [&] { return prepared->ready; });
+        next = std::move(prepared->file);
+    }
+    if (!next) {
+        failed = true;
+        return;
+    }
+
+    std::shared_ptr<OutputFile> finished(std::move(current));
+    current = std::move(next);
+    options.rotation->post([finished] {
+        finished->close(true);
+    });
+    prepare(++segment + 1);
+}
+
+void RotatingFile::write(const char *data, size_t size, time_t timestamp) {
+    if (options.rotation && !failed) {
+        const RotationPolicy &policy = options.rotation->policy();
+        bool full = policy.max_bytes && current->bytes() > header.size() &&
+                    current->bytes() + size > policy.max_bytes;
+        bool boundary = false;
+        if (policy.every_seconds) {
+            int64_t index = timestamp / policy.every_seconds;
+            // Records of several inputs may be slightly out of order; never rotate back
+            boundary = period >= 0 && index > period;
+            period = std::max(period, index);
+        }
+        if (full || boundary) {
+            rotate();
+        }
+    }
+    current->write(data, size);
+}
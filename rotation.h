@@ -0,0 +1,103 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "output_file.h"
+
+
+// --rotate-size / --rotate-every
+struct RotationPolicy {
+    uint64_t max_bytes = 0; // per segment, before compression
+    int64_t every_seconds = 0; // segments end on multiples of this since the epoch, by record timestamp
+
+    bool enabled() const {
+        return max_bytes || every_seconds;
+    }
+};
+
+// Opens upcoming segments and fsyncs and closes finished ones, off the parsing threads
+class RotationThread {
+private:
+    RotationPolicy rotation_policy;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::thread worker;
+
+    void run();
+
+public:
+    explicit RotationThread(const RotationPolicy &policy);
+
+    // Runs every queued job first
+    ~RotationThread();
+
+    const RotationPolicy &policy() const {
+        return rotation_policy;
+    }
+
+    void post(std::function<void()> job);
+};
+
+/* One CSV output in segments
+ *
+ * Without rotation this is just <stem><extension>. With it, segments are <stem>.0000<extension>,
+ * <stem>.0001<extension>, ..., each starting with the header. A segment ends once it holds
+ * max_bytes, or on the first record past the next time boundary. The segment after the current one
+ * is always being opened (header included) on the RotationThread, so a rotation on the parsing
+ * thread swaps two pointers and posts the old segment to be closed. A resumed run appends to the
+ * file without rotation, and with it starts the segment after the last one on disk.
+ */
+class RotatingFile {
+private:
+    struct Prepared {
+        std::mutex lock;
+        std::condition_variable done;
+        bool ready = false;
+        bool abandoned = false; // the RotatingFile is gone, remove the file again
+        std::unique_ptr<OutputFile> file;
+    };
+
+    std::string stem;
+    std::string extension;
+    std::string header;
+    OutputOptions options;
+    unsigned segment = 0;
+    int64_t period = -1; // time boundary index of the current segment
+    bool failed = false;
+    std::unique_ptr<OutputFile> current;
+    std::shared_ptr<Prepared> prepared;
+
+    std::string segment_path(unsigned n) const;
+
+    void prepare(unsigned n);
+
+    void rotate();
+
+public:
+    RotatingFile(std::string file_stem, std::string file_extension, std::string file_header,
+                 const OutputOptions &output_options);
+
+    ~RotatingFile();
+
+    bool is_open() const {
+        return current && current->is_open();
+    }
+
+    // timestamp: the record's, which decides --rotate-every, so segments split exactly on the rows
+    void write(const char *data, size_t size, time_t timestamp);
+
+    void flush() {
+        current->flush();
+    }
+};
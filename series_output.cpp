@@ -0,0 +1,252 @@
+#include "series_output.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "bitstream.h"
+#include "varint.h"
+
+
+namespace {
+    constexpr ColumnMask key_columns = column_bits(Column::Rnti, Column::Source);
+
+    // Delta-of-delta buckets: 0 | 10+7 | 110+9 | 1110+12 | 1111+64 bits, zigzag encoded
+    void put_dod(BitWriter &bits, int64_t dod) {
+        uint64_t z = varint::zigzag(dod);
+        if (z == 0) {
+            bits.put(0, 1);
+        } else if (z < (1 << 7)) {
+            bits.put(0b10, 2);
+            bits.put(z, 7);
+        } else if (z < (1 << 9)) {
+            bits.put(0b110, 3);
+            bits.put(z, 9);
+        } else if (z < (1 << 12)) {
+            bits.put(0b1110, 4);
+            bits.put(z, 12);
+        } else {
+            bits.put(0b1111, 4);
+            bits.put(z, 64);
+        }
+    }
+
+    int64_t get_dod(BitReader &bits) {
+        if (!bits.bit()) {
+            return 0;
+        }
+        unsigned width = !bits.bit() ? 7 : !bits.bit() ? 9 : !bits.bit() ? 12 : 64;
+        return varint::unzigzag(bits.get(width));
+    }
+
+    // Differences are taken modulo 2^64, so counters near the int64 limits cannot overflow
+    void encode_integers(BitWriter &bits, const std::vector<UEData> &rows, Column column) {
+        auto previous = static_cast<uint64_t>(column_integer(rows[0], column));
+        uint64_t delta = 0;
+        bits.put(previous, 64);
+        for (size_t i = 1; i < rows.size(); i++) {
+            auto value = static_cast<uint64_t>(column_integer(rows[i], column));
+            uint64_t next_delta = value - previous;
+            put_dod(bits, static_cast<int64_t>(next_delta - delta));
+            delta = next_delta;
+            previous = value;
+        }
+    }
+
+    void decode_integers(BitReader &bits, std::vector<UEData> &rows, Column column) {
+        uint64_t value = bits.get(64);
+        uint64_t delta = 0;
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (i > 0) {
+                delta += static_cast<uint64_t>(get_dod(bits));
+                value += delta;
+            }
+            set_column_integer(rows[i], column, static_cast<int64_t>(value));
+        }
+    }
+
+    void encode_reals(BitWriter &bits, const std::vector<UEData> &rows, Column column) {
+        auto previous = std::bit_cast<uint64_t>(column_real(rows[0], column));
+        unsigned leading = 64; // no window yet
+        unsigned trailing = 0;
+        bits.put(previous, 64);
+        for (size_t i = 1; i < rows.size(); i++) {
+            auto value = std::bit_cast<uint64_t>(column_real(rows[i], column));
+            uint64_t x = value ^ previous;
+            previous = value;
+            if (x == 0) {
+                bits.put(0, 1);
+                continue;
+            }
+            unsigned lz = std::min(std::countl_zero(x), 31);
+            unsigned tz = std::countr_zero(x);
+            if (leading < 64 && lz >= leading && tz >= trailing) {
+                bits.put(0b10, 2);
+                bits.put(x >> trailing, 64 - leading - trailing);
+            } else {
+                leading = lz;
+                trailing = tz;
+                bits.put(0b11, 2);
+                bits.put(lz, 5);
+                bits.put(64 - lz - tz - 1, 6);
+                bits.put(x >> tz, 64 - lz - tz);
+            }
+        }
+    }
+
+    void decode_reals(BitReader &bits, std::vector<UEData> &rows, Column column) {
+        uint64_t value = bits.get(64);
+        unsigned leading = 0;
+        unsigned trailing = 0;
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (i > 0 && bits.bit()) {
+                if (bits.bit()) {
+                    leading = bits.get(5);
+                    unsigned meaningful = bits.get(6) + 1;
+                    trailing = 64 - leading - meaningful;
+                }
+                value ^= bits.get(64 - leading - trailing) << trailing;
+            }
+            set_column_real(rows[i], column, std::bit_cast<double>(value));
+        }
+    }
+
+    template<class T>
+    void put(std::string &out, T value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<class T>
+    bool get(const char *&p, const char *end, T &value) {
+        if (static_cast<size_t>(end - p) < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return true;
+    }
+}
+
+SeriesOutput::SeriesOutput(const std::string &path, ColumnMask selected,
+                           const std::vector<std::string> &source_names, const OutputOptions &options)
+    : columns(selected) {
+    // A resumed run appends its blocks after the ones of the run before, under the same header
+    bool continued = options.resume && existing_size(path, options) > 0;
+    if (!file.open(path, options, continued) || continued) {
+        return;
+    }
+    put(block, magic);
+    put(block, columns);
+    put(block, static_cast<uint16_t>(source_names.size()));
+    for (const std::string &name: source_names) {
+        put(block, static_cast<uint16_t>(name.size()));
+        block += name;
+    }
+    file.write(block.data(), block.size());
+}
+
+SeriesOutput::~SeriesOutput() {
+    for (auto &[key, rows]: pending) {
+        if (!rows.empty()) {
+            write_block(rows);
+        }
+    }
+}
+
+void SeriesOutput::write(const UEData &data) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<UEData> &rows = pending[uint32_t(data.source) << 16 | data.rnti];
+    if (rows.empty()) {
+        rows.reserve(block_rows);
+    }
+    rows.push_back(data);
+    if (rows.size() == block_rows) {
+        write_block(rows);
+        rows.clear();
+    }
+}
+
+void SeriesOutput::write_block(const std::vector<UEData> &rows) {
+    block.clear();
+    put(block, rows[0].source);
+    put(block, rows[0].rnti);
+    put(block, static_cast<uint16_t>(rows.size()));
+    put(block, uint32_t(0));
+
+    BitWriter bits(block);
+    for (ColumnMask left = columns & ~key_columns; left; left &= left - 1) {
+        auto column = static_cast<Column>(std::countr_zero(left));
+        if (column_type(column) == ColumnType::Real) {
+            encode_reals(bits, rows, column);
+        } else {
+            encode_integers(bits, rows, column);
+        }
+    }
+    bits.finish();
+
+    uint32_t payload = block.size() - 10;
+    std::memcpy(block.data() + 6, &payload, sizeof(payload));
+    file.write(block.data(), block.size());
+}
+
+bool decode_series(std::string_view input, std::FILE *out) {
+    const char *p = input.data();
+    const char *end = p + input.size();
+    uint32_t file_magic;
+    ColumnMask mask;
+    uint16_t count;
+    if (!get(p, end, file_magic) || file_magic != SeriesOutput::magic || !get(p, end, mask) || !get(p, end, count)) {
+        return false;
+    }
+    std::vector<std::string> names(count);
+    for (std::string &name: names) {
+        uint16_t size;
+        if (!get(p, end, size) || end - p < size) {
+            return false;
+        }
+        name.assign(p, size);
+        p += size;
+    }
+
+    RowFormatter formatter(names);
+    std::string text = csv_header(mask);
+    std::vector<UEData> rows;
+    while (p < end) {
+        uint16_t source, rnti, size;
+        uint32_t payload;
+        if (!get(p, end, source) || !get(p, end, rnti) || !get(p, end, size) || !get(p, end, payload) ||
+            end - p < payload) {
+            return false;
+        }
+        rows.assign(size, UEData{});
+        for (UEData &row: rows) {
+            row.source = source;
+            row.rnti = rnti;
+        }
+
+        BitReader bits(p, p + payload);
+        for (ColumnMask left = mask & ~key_columns; left; left &= left - 1) {
+            auto column = static_cast<Column>(std::countr_zero(left));
+            if (column_type(column) == ColumnType::Real) {
+                decode_reals(bits, rows, column);
+            } else {
+                decode_integers(bits, rows, column);
+            }
+        }
+        if (bits.failed()) {
+            return false;
+        }
+        p += payload;
+
+        char row[max_row_size];
+        for (const UEData &data: rows) {
+            text.append(row, formatter.format_row(data, mask, row));
+        }
+        if (text.size() > (1 << 20)) {
+            fwrite(text.data(), 1, text.size(), out);
+            text.clear();
+        }
+    }
+    fwrite(text.data(), 1, text.size(), out);
+    return true;
+}
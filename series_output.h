@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "columns.h"
+#include "output_file.h"
+#include "record_sink.h"
+
+
+/* Per-UE compressed time series (--format series)
+ *
+ * Rows are buffered per UE and encoded in blocks of block_rows rows, Gorilla style and column by
+ * column, so a reader can decode a single column of a block without the others:
+ *   - integer columns (timestamp, counters, MCS, ...): the first value as 64 bits, then
+ *     delta-of-delta in variable-width buckets, a single 0 bit while the series moves linearly
+ *   - real columns (BLER, SNR, RSRP): the first value as 64 bits, then the XOR with the previous
+ *     value; a 0 bit when unchanged, else only its meaningful bits, reusing the previous
+ *     leading/trailing zero window when the new bits fit in it
+ *
+ * File: u32 magic "GSR1", u32 column mask, u16 input count, per input u16 size and name. Per
+ * block: u16 input, u16 RNTI, u16 rows, u32 payload size, payload bits. Host byte order. Partial
+ * blocks are written when the output closes. --decode prints the rows back as CSV, block by block.
+ */
+class SeriesOutput : public RecordSink {
+private:
+    static constexpr size_t block_rows = 128;
+
+    std::mutex lock;
+    OutputFile file;
+    ColumnMask columns;
+    std::unordered_map<uint32_t, std::vector<UEData>> pending; // keyed by source << 16 | rnti
+    std::string block;
+
+    void write_block(const std::vector<UEData> &rows);
+
+public:
+    static constexpr uint32_t magic = 0x31525347;
+
+    SeriesOutput(const std::string &path, ColumnMask selected, const std::vector<std::string> &source_names,
+                 const OutputOptions &options = {});
+
+    ~SeriesOutput() override;
+
+    bool is_open() const {
+        return file.is_open();
+    }
+
+    void write(const UEData &data) override;
+};
+
+// Writes every row of a series file as CSV; false on damaged input
+bool decode_series(std::string_view input, std::FILE *out);
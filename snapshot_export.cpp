@@ -0,0 +1,282 @@
+#include "snapshot_export.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <tuple>
+#include <unistd.h>
+
+#include "endpoint.h"
+#include "placement.h"
+#include "summary.h"
+
+
+namespace {
+    constexpr double quantiles[] = {0.5, 0.95};
+
+    // How long a client gets to take its dump
+    constexpr timeval send_timeout{1, 0};
+
+    bool write_all(int fd, const std::string &out, int flags) {
+        size_t sent = 0;
+        while (sent < out.size()) {
+            ssize_t n = flags ? send(fd, out.data() + sent, out.size() - sent, flags)
+                              : ::write(fd, out.data() + sent, out.size() - sent);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    void put_number(std::string &out, double value) {
+        char number[32];
+        std::snprintf(number, sizeof(number), ",%.6g", value);
+        out += number;
+    }
+}
+
+void block_snapshot_signal() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+SnapshotExport::SnapshotExport(RecordSink &next_sink, std::string snapshot_file, std::string endpoint_spec,
+                               ColumnMask selected, std::vector<std::string> source_names)
+    : next(next_sink), file(std::move(snapshot_file)), endpoint(std::move(endpoint_spec)), columns(selected),
+      sources(std::move(source_names)), formatter(sources) {
+    if (!file.empty()) {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR2);
+        signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+        if (signal_fd < 0) {
+            std::cerr << "--snapshot: signalfd: " << std::strerror(errno) << std::endl;
+            return;
+        }
+    }
+    if (!endpoint.empty()) {
+        std::string error;
+        listen_fd = listen_endpoint(endpoint, error);
+        if (listen_fd < 0) {
+            std::cerr << "--snapshot-socket: " << error << std::endl;
+            return;
+        }
+    }
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    open = true;
+    dumper = std::thread(&SnapshotExport::run, this);
+}
+
+SnapshotExport::~SnapshotExport() {
+    finish();
+    for (int fd: {signal_fd, listen_fd, wake_fd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void SnapshotExport::write(const UEData &data) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t count = slot_count.load(std::memory_order_relaxed);
+        auto [entry, added] = slot_of.try_emplace(uint32_t(data.source) << 16 | data.rnti, count);
+        if (added) {
+            if (count == chunk_slots * max_chunks) {
+                slot_of.erase(entry);
+                untracked++;
+                next.write(data);
+                return;
+            }
+            if (count % chunk_slots == 0) {
+                chunks[count / chunk_slots] = std::make_unique<Slot[]>(chunk_slots);
+            }
+        }
+        Slot &target = slot(entry->second);
+        uint64_t sequence = target.sequence.load(std::memory_order_relaxed);
+        target.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        target.data = data;
+        target.updates++;
+        target.sequence.store(sequence + 2, std::memory_order_release);
+        // The dump thread sees the new slot (and its chunk) only once it is complete
+        if (added) {
+            slot_count.store(count + 1, std::memory_order_release);
+        }
+    }
+    next.write(data);
+}
+
+void SnapshotExport::run() {
+    place_thread(ThreadRole::Writer);
+    // A dump is never urgent: on a CPU shared with a parser it only gets the time the parser leaves
+    sched_param param{};
+    sched_setscheduler(0, SCHED_IDLE, &param);
+
+    pollfd polled[] = {{wake_fd, POLLIN, 0}, {signal_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}};
+    while (true) {
+        if (poll(polled, std::size(polled), -1) < 0) {
+            continue;
+        }
+        if (polled[0].revents) {
+            break;
+        }
+        if (polled[1].revents) {
+            signalfd_siginfo info{};
+            if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                write_file(dump());
+            }
+        }
+        if (polled[2].revents) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+                write_all(fd, dump(), MSG_NOSIGNAL);
+                close(fd);
+            }
+        }
+    }
+}
+
+std::string SnapshotExport::dump() {
+    auto started = std::chrono::steady_clock::now();
+    // Slots past count may still be filled in: they are left for the next dump
+    size_t count = slot_count.load(std::memory_order_acquire);
+    std::vector<Row> rows(count);
+    for (size_t i = 0; i < count; i++) {
+        Slot &source = slot(i);
+        while (true) {
+            uint64_t before = source.sequence.load(std::memory_order_acquire);
+            if (!(before & 1)) {
+                rows[i].updates = source.updates;
+                rows[i].data = source.data;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (source.sequence.load(std::memory_order_relaxed) == before) {
+                    break;
+                }
+            }
+            retries++;
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        return std::tie(a.data.source, a.data.rnti) < std::tie(b.data.source, b.data.rnti);
+    });
+
+    struct Cell {
+        uint64_t ues = 0;
+        uint64_t in_sync = 0;
+        uint64_t records = 0;
+        uint64_t mac_tx = 0;
+        uint64_t mac_rx = 0;
+        CellSummary summary;
+    };
+    std::vector<Cell> cells(sources.size());
+    std::string out = csv_header(columns);
+    out.reserve(out.size() + rows.size() * 160);
+    char row[max_row_size];
+    for (const Row &entry: rows) {
+        out.append(row, formatter.format_row(entry.data, columns, row));
+        if (entry.data.source >= cells.size()) {
+            continue;
+        }
+        Cell &cell = cells[entry.data.source];
+        cell.ues++;
+        cell.in_sync += entry.data.state == UEState::InSync;
+        cell.records += entry.updates;
+        cell.mac_tx += entry.data.mac_tx;
+        cell.mac_rx += entry.data.mac_rx;
+        cell.summary.add(entry.data, columns);
+    }
+
+    out += "\ninput,ues,in_sync,records";
+    for (size_t i = 0; i < static_cast<size_t>(Metric::Count); i++) {
+        std::string name = metric_info(static_cast<Metric>(i)).name;
+        out += "," + name + "_mean";
+        for (double q: quantiles) {
+            out += "," + name + "_p" + std::to_string(static_cast<int>(q * 100));
+        }
+    }
+    out += ",mac_tx,mac_rx\n";
+    for (size_t source = 0; source < cells.size(); source++) {
+        const Cell &cell = cells[source];
+        out += sources[source] + ',' + std::to_string(cell.ues) + ',' + std::to_string(cell.in_sync) + ',' +
+                std::to_string(cell.records);
+        for (size_t i = 0; i < static_cast<size_t>(Metric::Count); i++) {
+            const Histogram &histogram = cell.summary.metrics[i];
+            if (!histogram.count()) {
+                out += std::string(std::size(quantiles) + 1, ',');
+                continue;
+            }
+            put_number(out, histogram.mean());
+            for (double q: quantiles) {
+                put_number(out, histogram.quantile(q, metric_info(static_cast<Metric>(i))));
+            }
+        }
+        out += ',' + std::to_string(cell.mac_tx) + ',' + std::to_string(cell.mac_rx) + '\n';
+    }
+
+    dumps++;
+    last_ues = rows.size();
+    last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return out;
+}
+
+bool SnapshotExport::write_file(const std::string &out) {
+    std::string temporary = file + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write_all(fd, out, 0);
+    int code = errno;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ok && rename(temporary.c_str(), file.c_str()) != 0) {
+        ok = false;
+        code = errno;
+    }
+    if (!ok) {
+        std::cerr << "--snapshot: cannot write " << file << ": " << std::strerror(code) << std::endl;
+        unlink(temporary.c_str());
+    }
+    return ok;
+}
+
+void SnapshotExport::finish() {
+    if (!dumper.joinable()) {
+        return;
+    }
+    uint64_t one = 1;
+    ::write(wake_fd, &one, sizeof(one));
+    dumper.join();
+    if (!endpoint.empty()) {
+        unlink_endpoint(endpoint);
+    }
+    std::cerr << "--snapshot: " << dumps << " dumps";
+    if (dumps) {
+        char took[32];
+        std::snprintf(took, sizeof(took), "%.1f", last_ms);
+        std::cerr << ", the last of " << last_ues << " UEs in " << took << " ms";
+    }
+    std::cerr << ", " << retries << " slots copied again";
+    if (untracked) {
+        std::cerr << ", " << untracked << " records of UEs beyond " << chunk_slots * max_chunks << " not held";
+    }
+    std::cerr << std::endl;
+}
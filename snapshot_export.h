@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "columns.h"
+#include "record_sink.h"
+#include "ue_data.h"
+
+
+/* --snapshot <file> / --snapshot-socket unix:<path>: the whole UE table on demand
+ *
+ * Every UE has a slot holding its latest record, in chunks that never move once allocated. A parser
+ * updates a slot as a seqlock: its sequence is odd while the record is written and even once it is
+ * complete. The dump thread copies the slots without taking the parsers' lock and copies a slot
+ * again when its sequence moved, so a dump of any size never holds up parsing. Each row is one
+ * complete record; rows of different UEs may be a few records apart. The dump thread runs under
+ * SCHED_IDLE, so on a CPU it shares with a parser it also never takes the parser's time.
+ *
+ * SIGUSR2 writes <file> through <file>.tmp and a rename. A client connecting to the socket is sent a
+ * dump, then the connection is closed. A dump is the CSV of every UE's latest record (the output
+ * columns, sorted by input and RNTI), an empty line, then per input the UEs, in-sync UEs, records,
+ * the mean/p50/p95 of each --export metric over the latest records and the summed MAC counters.
+ */
+class SnapshotExport : public RecordSink {
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        uint64_t updates = 0; // records of this UE so far
+        UEData data{};
+    };
+
+    struct Row {
+        uint64_t updates;
+        UEData data;
+    };
+
+    static constexpr size_t chunk_slots = 4096;
+    static constexpr size_t max_chunks = 256; // every RNTI of 16 inputs
+
+    RecordSink &next;
+    std::string file;
+    std::string endpoint;
+    ColumnMask columns;
+    std::vector<std::string> sources;
+
+    // Parsers
+    std::mutex lock;
+    std::unordered_map<uint32_t, uint32_t> slot_of; // keyed by source << 16 | rnti
+    std::unique_ptr<Slot[]> chunks[max_chunks];
+    std::atomic<size_t> slot_count{0};
+    uint64_t untracked = 0; // records of UEs beyond the last chunk
+
+    // Dump thread
+    int signal_fd = -1;
+    int listen_fd = -1;
+    int wake_fd = -1;
+    bool open = false;
+    RowFormatter formatter;
+    uint64_t dumps = 0;
+    uint64_t retries = 0; // slots copied again because a parser was writing them
+    size_t last_ues = 0;
+    double last_ms = 0;
+    std::thread dumper;
+
+    Slot &slot(size_t index) const {
+        return chunks[index / chunk_slots][index % chunk_slots];
+    }
+
+    void run();
+
+    std::string dump();
+
+    bool write_file(const std::string &out);
+
+public:
+    // Either file or endpoint may be empty
+    SnapshotExport(RecordSink &next_sink, std::string snapshot_file, std::string endpoint_spec, ColumnMask selected,
+                   std::vector<std::string> source_names);
+
+    ~SnapshotExport() override;
+
+    // False when the signal or the socket could not be set up (reported on stderr)
+    bool is_open() const {
+        return open;
+    }
+
+    void write(const UEData &data) override;
+
+    // Stops the dump thread and prints what it did
+    void finish();
+};
+
+// SIGUSR2 is taken with a signalfd, which only works while no thread accepts it: call before starting any
+void block_snapshot_signal();
@@ -0,0 +1,202 @@
+#include "sqlite_output.h"
+
+#include <bit>
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+
+#include "placement.h"
+
+#ifdef GNB_HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+
+#ifdef GNB_HAVE_SQLITE
+
+namespace {
+    const char *sql_type(Column column) {
+        switch (column) {
+            case Column::Rnti:
+            case Column::State:
+            case Column::Source:
+                return "TEXT";
+            default:
+                return column_type(column) == ColumnType::Real ? "REAL" : "INTEGER";
+        }
+    }
+}
+
+bool sqlite_available() {
+    return true;
+}
+
+SqliteOutput::SqliteOutput(const std::string &path, ColumnMask selected,
+                           const std::vector<std::string> &source_names, bool resume)
+    : columns(selected), sources(source_names) {
+    // A fresh database per run, like the other formats truncate their file, unless it continues one
+    if (!resume) {
+        for (const char *suffix: {"", "-wal", "-shm"}) {
+            unlink((path + suffix).c_str());
+        }
+    }
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "sqlite: " << sqlite3_errmsg(db) << std::endl;
+        return;
+    }
+
+    std::string create = "CREATE TABLE IF NOT EXISTS ue_metrics (";
+    std::string values;
+    for (ColumnMask left = columns; left; left &= left - 1) {
+        auto column = static_cast<Column>(std::countr_zero(left));
+        if (!values.empty()) {
+            create += ", ";
+            values += ", ";
+        }
+        create += std::string(column_name(column)) + " " + sql_type(column);
+        values += "?";
+    }
+    create += ")";
+
+    if (!exec("PRAGMA journal_mode=WAL") || !exec("PRAGMA synchronous=NORMAL") ||
+        !exec("PRAGMA cache_size=-65536") || !exec(create)) {
+        return;
+    }
+    std::string sql = "INSERT INTO ue_metrics VALUES (" + values + ")";
+    if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &insert, nullptr) != SQLITE_OK) {
+        std::cerr << "sqlite: " << sqlite3_errmsg(db) << std::endl;
+        insert = nullptr;
+        return;
+    }
+    committer = std::thread(&SqliteOutput::run_committer, this);
+}
+
+SqliteOutput::~SqliteOutput() {
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+    guard.unlock();
+    wake.notify_one();
+    if (committer.joinable()) {
+        committer.join();
+    }
+    guard.lock();
+    if (insert) {
+        commit();
+        sqlite3_finalize(insert);
+
+        // Built once over the whole load instead of being maintained row by row
+        std::string key;
+        for (Column column: {Column::Source, Column::Rnti, Column::Timestamp}) {
+            if (columns & column_bit(column)) {
+                key += (key.empty() ? "" : ", ") + std::string(column_name(column));
+            }
+        }
+        if (!key.empty()) {
+            exec("CREATE INDEX IF NOT EXISTS ue_metrics_ue_time ON ue_metrics (" + key + ")");
+        }
+        exec("PRAGMA wal_checkpoint(TRUNCATE)");
+    }
+    sqlite3_close(db);
+}
+
+bool SqliteOutput::exec(const std::string &sql) {
+    char *error = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK) {
+        std::cerr << "sqlite: " << sql << ": " << (error ? error : "failed") << std::endl;
+        sqlite3_free(error);
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+void SqliteOutput::commit() {
+    if (batched > 0) {
+        exec("COMMIT");
+        batched = 0;
+    }
+}
+
+void SqliteOutput::run_committer() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        if (batched == 0) {
+            wake.wait(guard);
+        } else if (std::chrono::steady_clock::now() < batch_start + batch_interval) {
+            wake.wait_until(guard, batch_start + batch_interval);
+        } else {
+            commit();
+        }
+    }
+}
+
+void SqliteOutput::write(const UEData &data) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!insert || failed) {
+        return;
+    }
+    if (batched == 0) {
+        exec("BEGIN");
+        batch_start = std::chrono::steady_clock::now();
+        // The committer sleeps until there is a transaction to end
+        wake.notify_one();
+    }
+
+    int index = 1;
+    char rnti[8];
+    for (ColumnMask left = columns; left; left &= left - 1, index++) {
+        auto column = static_cast<Column>(std::countr_zero(left));
+        switch (column) {
+            case Column::Rnti:
+                snprintf(rnti, sizeof(rnti), "%04x", data.rnti);
+                sqlite3_bind_text(insert, index, rnti, 4, SQLITE_TRANSIENT);
+                break;
+            case Column::State:
+                sqlite3_bind_text(insert, index, state_name(data.state), -1, SQLITE_STATIC);
+                break;
+            case Column::Source:
+                if (data.source < sources.size()) {
+                    const std::string &name = sources[data.source];
+                    sqlite3_bind_text(insert, index, name.data(), name.size(), SQLITE_STATIC);
+                } else {
+                    sqlite3_bind_null(insert, index);
+                }
+                break;
+            default:
+                if (column_type(column) == ColumnType::Real) {
+                    sqlite3_bind_double(insert, index, column_real(data, column));
+                } else {
+                    sqlite3_bind_int64(insert, index, column_integer(data, column));
+                }
+                break;
+        }
+    }
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+        std::cerr << "sqlite: " << sqlite3_errmsg(db) << ", no further rows are stored" << std::endl;
+        failed = true;
+    }
+    sqlite3_reset(insert);
+
+    batched++;
+    if (batched == batch_rows) {
+        commit();
+    }
+}
+
+#else
+
+bool sqlite_available() {
+    return false;
+}
+
+SqliteOutput::SqliteOutput(const std::string &, ColumnMask selected, const std::vector<std::string> &source_names,
+                           bool) : columns(selected), sources(source_names) {
+}
+
+SqliteOutput::~SqliteOutput() = default;
+
+void SqliteOutput::write(const UEData &) {
+}
+
+#endif
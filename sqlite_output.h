@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "columns.h"
+#include "record_sink.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+
+/* SQLite output (--format sqlite)
+ *
+ * One table, ue_metrics, with the selected columns: timestamp as Unix seconds, rnti, state and
+ * source as text. Rows go through one prepared INSERT inside large transactions (commit every
+ * batch_rows rows or batch_interval), in WAL mode with synchronous=NORMAL, so the rate is bound by
+ * the B-tree, not by fsync. A committer thread ends a transaction whose interval is up even when no
+ * further rows arrive. The (source, rnti, timestamp) index is only built when the output closes,
+ * after the bulk load. Other processes can query committed rows while a capture runs. A run resumed
+ * from a --checkpoint adds its rows to the table of the run before.
+ */
+class SqliteOutput : public RecordSink {
+private:
+    static constexpr size_t batch_rows = 100000;
+    static constexpr auto batch_interval = std::chrono::seconds(1);
+
+    std::mutex lock;
+    sqlite3 *db = nullptr;
+    sqlite3_stmt *insert = nullptr;
+    ColumnMask columns;
+    std::vector<std::string> sources;
+    size_t batched = 0;
+    std::chrono::steady_clock::time_point batch_start;
+    bool failed = false;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread committer;
+
+    bool exec(const std::string &sql);
+
+    // Called with lock held
+    void commit();
+
+    void run_committer();
+
+public:
+    // resume keeps the rows of an earlier run (--checkpoint) instead of starting a fresh database
+    SqliteOutput(const std::string &path, ColumnMask selected, const std::vector<std::string> &source_names,
+                 bool resume = false);
+
+    ~SqliteOutput() override;
+
+    bool is_open() const {
+        return insert != nullptr;
+    }
+
+    void write(const UEData &data) override;
+};
+
+// False when built without SQLite
+bool sqlite_available();
@@ -0,0 +1,358 @@
+#include "subscribers.h"
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "endpoint.h"
+#include "placement.h"
+
+
+namespace {
+    constexpr ColumnMask key_columns = column_bits(Column::Rnti, Column::Source);
+
+    // How long finish() keeps sending to subscribers that are still reading
+    constexpr auto final_flush = std::chrono::seconds(1);
+}
+
+SubscriberHub::SubscriberHub(RecordSink &next_sink, std::string endpoint_spec, ColumnMask parsed,
+                             std::vector<std::string> source_names, unsigned keyframe_every)
+    : next(next_sink), endpoint(std::move(endpoint_spec)), parsed_columns(parsed), sources(std::move(source_names)),
+      keyframe_interval(keyframe_every) {
+    std::string error;
+    listen_fd = listen_endpoint(endpoint, error);
+    if (listen_fd < 0) {
+        std::cerr << "--subscribe: " << error << std::endl;
+        return;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+    hub = std::thread(&SubscriberHub::run, this);
+}
+
+SubscriberHub::~SubscriberHub() {
+    finish();
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink_endpoint(endpoint);
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+}
+
+void SubscriberHub::write(const UEData &data) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        bool queued = false;
+        for (const auto &subscriber: active) {
+            if (subscriber->filter.enabled()) {
+                subscriber->filter.bind(data.rnti, data.ue_id);
+                if (!subscriber->filter.accepts(data.rnti)) {
+                    continue;
+                }
+            }
+            if (subscriber->sample > 1 &&
+                subscriber->sample_counts[uint32_t(data.source) << 16 | data.rnti]++ % subscriber->sample != 0) {
+                continue;
+            }
+            uint64_t head = subscriber->head.load(std::memory_order_relaxed);
+            if (head - subscriber->tail.load(std::memory_order_acquire) == ring_records) {
+                subscriber->dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            subscriber->ring[head % ring_records] = data;
+            subscriber->head.store(head + 1, std::memory_order_release);
+            queued = true;
+        }
+        // Only a sleeping hub needs the syscall
+        if (queued && hub_sleeping.exchange(false)) {
+            uint64_t one = 1;
+            ::write(wake_fd, &one, sizeof(one));
+        }
+    }
+    next.write(data);
+}
+
+void SubscriberHub::run() {
+    place_thread(ThreadRole::Writer);
+    auto give_up = std::chrono::steady_clock::time_point::max();
+    while (true) {
+        bool stop;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = stopping;
+        }
+        if (stop && give_up == std::chrono::steady_clock::time_point::max()) {
+            give_up = std::chrono::steady_clock::now() + final_flush;
+        }
+
+        std::vector<int> gone;
+        bool pending = false;
+        for (auto &[fd, subscriber]: connections) {
+            if (subscriber->subscribed && !subscriber->waiting && !pump(*subscriber)) {
+                gone.push_back(fd);
+            }
+            pending = pending || (subscriber->subscribed && (!subscriber->ring_empty() || !subscriber->out.empty()));
+        }
+        for (int fd: gone) {
+            disconnect(fd);
+        }
+        if (stop && (!pending || std::chrono::steady_clock::now() >= give_up)) {
+            break;
+        }
+
+        // Sleep only when no ring has anything left to encode; a parser wakes the hub otherwise
+        hub_sleeping = true;
+        int timeout = stop ? 10 : -1;
+        if (any_queued()) {
+            hub_sleeping = false;
+            timeout = 0;
+        }
+        epoll_event events[64];
+        int n = epoll_wait(epoll_fd, events, 64, timeout);
+        hub_sleeping = false;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd) {
+                uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0) {
+                }
+            } else if (fd == listen_fd) {
+                accept_connections();
+            } else if (auto found = connections.find(fd); found != connections.end()) {
+                Subscriber &subscriber = *found->second;
+                if (subscriber.waiting && (events[i].events & EPOLLOUT)) {
+                    subscriber.waiting = false;
+                    epoll_event event{};
+                    event.events = EPOLLIN | EPOLLRDHUP;
+                    event.data.fd = fd;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    read_from(subscriber);
+                }
+            }
+        }
+    }
+
+    while (!connections.empty()) {
+        disconnect(connections.begin()->first);
+    }
+}
+
+bool SubscriberHub::any_queued() {
+    for (const auto &[fd, subscriber]: connections) {
+        if (subscriber->subscribed && !subscriber->waiting && !subscriber->ring_empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SubscriberHub::accept_connections() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        auto subscriber = std::make_shared<Subscriber>(keyframe_interval);
+        subscriber->fd = fd;
+        subscriber->id = next_id++;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        connections.emplace(fd, std::move(subscriber));
+    }
+}
+
+void SubscriberHub::read_from(Subscriber &subscriber) {
+    char buffer[1024];
+    while (true) {
+        ssize_t n = read(subscriber.fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            return;
+        }
+        if (n <= 0) {
+            disconnect(subscriber.fd);
+            return;
+        }
+        if (subscriber.subscribed) {
+            continue; // nothing more is expected from a subscriber
+        }
+        subscriber.request.append(buffer, n);
+        size_t newline = subscriber.request.find('\n');
+        if (newline == std::string::npos) {
+            if (subscriber.request.size() > max_request) {
+                disconnect(subscriber.fd);
+                return;
+            }
+            continue;
+        }
+        std::string error;
+        std::string_view line(subscriber.request.data(), newline);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!subscribe(subscriber, line, error)) {
+            std::string reply = "error: " + error + "\n";
+            send(subscriber.fd, reply.data(), reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            disconnect(subscriber.fd);
+            return;
+        }
+    }
+}
+
+bool SubscriberHub::subscribe(Subscriber &subscriber, std::string_view line, std::string &error) {
+    ColumnMask columns = parsed_columns;
+    for (size_t start = 0; start < line.size();) {
+        size_t space = line.find(' ', start);
+        std::string_view option = line.substr(start, space == std::string_view::npos ? line.npos : space - start);
+        start = space == std::string_view::npos ? line.size() : space + 1;
+        if (option.empty()) {
+            continue;
+        }
+        size_t equals = option.find('=');
+        std::string_view key = option.substr(0, equals);
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : option.substr(equals + 1);
+        if (key == "rnti") {
+            if (!subscriber.filter.add_rntis(value, error)) {
+                error = "bad RNTI " + error;
+                return false;
+            }
+        } else if (key == "ue-id") {
+            if (!subscriber.filter.add_ue_ids(value, error)) {
+                error = "bad CU-UE-ID " + error;
+                return false;
+            }
+        } else if (key == "columns") {
+            std::string unknown;
+            if (!parse_columns(value, columns, unknown)) {
+                error = "unknown column " + unknown;
+                return false;
+            }
+            columns &= parsed_columns | key_columns;
+        } else if (key == "sample") {
+            unsigned every = 0;
+            auto [end, code] = std::from_chars(value.data(), value.data() + value.size(), every);
+            if (code != std::errc() || end != value.data() + value.size() || every == 0) {
+                error = "bad sample " + std::string(value) + " (1 to " + std::to_string(UINT_MAX) + ")";
+                return false;
+            }
+            subscriber.sample = every;
+        } else {
+            error = "unknown option " + std::string(option) + " (rnti=, ue-id=, columns=, sample=)";
+            return false;
+        }
+    }
+    subscriber.columns = columns | column_bit(Column::Rnti);
+    if (sources.size() > 1) {
+        subscriber.columns |= column_bit(Column::Source);
+    }
+    subscriber.ring = std::make_unique<UEData[]>(ring_records);
+    put_binary_delta_header(subscriber.out, subscriber.columns, sources);
+    subscriber.subscribed = true;
+
+    std::lock_guard<std::mutex> guard(lock);
+    active.push_back(connections.at(subscriber.fd));
+    return true;
+}
+
+bool SubscriberHub::pump(Subscriber &subscriber) {
+    while (true) {
+        if (subscriber.out_sent == subscriber.out.size()) {
+            subscriber.out.clear();
+            subscriber.out_sent = 0;
+            // Encode what the ring holds now; the out buffer stays within one ring's worth
+            uint64_t head = subscriber.head.load(std::memory_order_acquire);
+            uint64_t tail = subscriber.tail.load(std::memory_order_relaxed);
+            for (; tail != head; tail++) {
+                const UEData &data = subscriber.ring[tail % ring_records];
+                subscriber.history.next(data, [&](const UEData *last) {
+                    put_binary_delta_row(subscriber.out, data, subscriber.columns, last);
+                });
+            }
+            subscriber.records += head - subscriber.tail.load(std::memory_order_relaxed);
+            subscriber.tail.store(tail, std::memory_order_release);
+            uint64_t dropped = subscriber.dropped.load(std::memory_order_relaxed);
+            if (dropped > subscriber.dropped_noted) {
+                put_binary_delta_gap(subscriber.out, dropped - subscriber.dropped_noted);
+                subscriber.dropped_noted = dropped;
+            }
+            if (subscriber.out.empty()) {
+                return true;
+            }
+        }
+
+        ssize_t n = send(subscriber.fd, subscriber.out.data() + subscriber.out_sent,
+                         subscriber.out.size() - subscriber.out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            // Its ring keeps filling (and dropping) until the socket drains
+            subscriber.waiting = true;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+            event.data.fd = subscriber.fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, subscriber.fd, &event);
+            return true;
+        }
+        if (n < 0) {
+            return false;
+        }
+        subscriber.out_sent += n;
+    }
+}
+
+void SubscriberHub::disconnect(int fd) {
+    auto found = connections.find(fd);
+    if (found == connections.end()) {
+        return;
+    }
+    std::shared_ptr<Subscriber> subscriber = found->second;
+    connections.erase(found);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::erase(active, subscriber);
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    if (subscriber->subscribed) {
+        std::cerr << "--subscribe: subscriber " << subscriber->id << " left after " << subscriber->records
+                << " records, " << subscriber->dropped.load() << " dropped" << std::endl;
+    }
+}
+
+void SubscriberHub::finish() {
+    if (!hub.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    uint64_t one = 1;
+    ::write(wake_fd, &one, sizeof(one));
+    hub.join();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "columns.h"
+#include "delta_output.h"
+#include "record_sink.h"
+#include "ue_filter.h"
+
+
+/* --subscribe unix:<path>: record fan-out to local tools
+ *
+ * A subscriber connects and sends one line of space-separated options, then reads a binary-delta
+ * stream (the --format binary-delta layout, so a saved stream goes through --decode) of the
+ * records it asked for. An empty line subscribes to everything; a bad one is answered with
+ * "error: ...\n" and the connection closed. Closing the connection, or only its sending side,
+ * unsubscribes.
+ *   rnti=928c,6542       only these UEs; ue-id=1,2 likewise (either matches)
+ *   columns=rnti,dl_bler only these of the parsed columns (RNTI, and the input with several, always)
+ *   sample=10            only every 10th record of each UE
+ *
+ * Every subscriber has its own ring of ring_records records. Parsers only copy matching records
+ * into the rings and never wait: a record that finds its subscriber's ring full is dropped and
+ * counted for that subscriber, and the stream carries a gap row with the count about where the
+ * records went missing. One hub thread accepts connections, encodes what the rings hold and writes
+ * it without blocking, so a slow subscriber only ever holds up itself.
+ */
+class SubscriberHub : public RecordSink {
+private:
+    static constexpr size_t ring_records = 4096;
+    static constexpr size_t max_request = 4096;
+
+    struct Subscriber {
+        int fd = -1;
+        unsigned id = 0;
+
+        // Set from the request before the subscriber is active, then read by the parsers
+        UEFilter filter;
+        ColumnMask columns = 0;
+        unsigned sample = 1;
+
+        // Parsers, under the hub lock
+        std::unordered_map<uint32_t, unsigned> sample_counts; // per source << 16 | rnti
+        std::unique_ptr<UEData[]> ring;
+        std::atomic<uint64_t> head{0}; // next record to write
+        std::atomic<uint64_t> tail{0}; // next record to encode
+        std::atomic<uint64_t> dropped{0};
+
+        // Hub thread only
+        std::string request; // until its newline
+        bool subscribed = false;
+        DeltaHistory history;
+        std::string out; // encoded, not yet sent
+        size_t out_sent = 0;
+        bool waiting = false; // for EPOLLOUT
+        uint64_t dropped_noted = 0; // covered by gap rows so far
+        uint64_t records = 0;
+
+        explicit Subscriber(unsigned keyframe_every) : history(keyframe_every) {
+        }
+
+        bool ring_empty() const {
+            return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+        }
+    };
+
+    RecordSink &next;
+    std::string endpoint;
+    ColumnMask parsed_columns;
+    std::vector<std::string> sources;
+    unsigned keyframe_interval;
+
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1; // eventfd: records arrived while the hub slept, or stop
+    std::atomic<bool> hub_sleeping{false};
+    bool stopping = false; // under lock
+
+    std::mutex lock; // parsers against changes to active
+    std::vector<std::shared_ptr<Subscriber>> active;
+    std::unordered_map<int, std::shared_ptr<Subscriber>> connections; // hub thread
+    unsigned next_id = 1;
+    std::thread hub;
+
+    void run();
+
+    void accept_connections();
+
+    // Reads the request, or notices a subscriber that hung up
+    void read_from(Subscriber &subscriber);
+
+    // Turns the request line into the subscription; false with error set
+    bool subscribe(Subscriber &subscriber, std::string_view line, std::string &error);
+
+    // Encodes ring contents and writes as much as the socket takes; false when the subscriber is gone
+    bool pump(Subscriber &subscriber);
+
+    void disconnect(int fd);
+
+    bool any_queued();
+
+public:
+    SubscriberHub(RecordSink &next_sink, std::string endpoint_spec, ColumnMask parsed,
+                  std::vector<std::string> source_names, unsigned keyframe_every);
+
+    ~SubscriberHub() override;
+
+    // False when the socket could not be set up (reported on stderr)
+    bool is_open() const {
+        return listen_fd >= 0;
+    }
+
+    void write(const UEData &data) override;
+
+    // Sends what the rings still hold and closes every subscriber
+    void finish();
+};
@@ -0,0 +1,283 @@
+#include "summary.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+    // Integer-valued metrics get bins centred on the integers
+    const MetricInfo metric_table[] = {
+        {"dl_bler", Column::DlBler, 0, 1, 200},
+        {"ul_bler", Column::UlBler, 0, 1, 200},
+        {"snr", Column::Snr, -20, 50, 140},
+        {"rsrp", Column::Rsrp, -160.5, -30.5, 130},
+        {"cqi", Column::Cqi, -0.5, 15.5, 16},
+        {"dl_mcs", Column::DlMcs, -0.5, 31.5, 32},
+        {"ul_mcs", Column::UlMcs, -0.5, 31.5, 32},
+    };
+    static_assert(std::size(metric_table) == static_cast<size_t>(Metric::Count));
+
+    template<class T>
+    void put(std::string &out, T value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<class T>
+    bool get(const char *&p, const char *end, T &value) {
+        if (static_cast<size_t>(end - p) < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return true;
+    }
+}
+
+const MetricInfo &metric_info(Metric metric) {
+    return metric_table[static_cast<size_t>(metric)];
+}
+
+Histogram::Histogram(Metric metric) : counts(metric_info(metric).bins + 2) {
+}
+
+void Histogram::add(double value, const MetricInfo &info) {
+    size_t bin;
+    if (value < info.low) {
+        bin = 0;
+    } else if (value >= info.high) {
+        bin = info.bins + 1;
+    } else {
+        bin = 1 + static_cast<size_t>((value - info.low) / (info.high - info.low) * info.bins);
+    }
+    counts[bin]++;
+    min = total ? std::min(min, value) : value;
+    max = total ? std::max(max, value) : value;
+    sum += value;
+    total++;
+}
+
+void Histogram::merge(const Histogram &other) {
+    if (!other.total) {
+        return;
+    }
+    min = total ? std::min(min, other.min) : other.min;
+    max = total ? std::max(max, other.max) : other.max;
+    sum += other.sum;
+    total += other.total;
+    for (size_t i = 0; i < counts.size(); i++) {
+        counts[i] += other.counts[i];
+    }
+}
+
+double Histogram::quantile(double q, const MetricInfo &info) const {
+    if (!total) {
+        return 0;
+    }
+    double target = q * total;
+    double width = (info.high - info.low) / info.bins;
+    uint64_t below = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i] && below + counts[i] >= target) {
+            if (i == 0) {
+                return min;
+            }
+            if (i == counts.size() - 1) {
+                return max;
+            }
+            double value = info.low + (i - 1 + (target - below) / counts[i]) * width;
+            return std::clamp(value, min, max);
+        }
+        below += counts[i];
+    }
+    return max;
+}
+
+void Histogram::serialize(std::string &out) const {
+    put(out, total);
+    put(out, sum);
+    put(out, min);
+    put(out, max);
+    // Sparse: most bins of a short interval are empty
+    uint16_t used = std::count_if(counts.begin(), counts.end(), [](uint64_t c) {
+        return c != 0;
+    });
+    put(out, used);
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i]) {
+            put(out, static_cast<uint16_t>(i));
+            put(out, counts[i]);
+        }
+    }
+}
+
+bool Histogram::deserialize(const char *&p, const char *end) {
+    uint16_t used;
+    if (!get(p, end, total) || !get(p, end, sum) || !get(p, end, min) || !get(p, end, max) ||
+        !get(p, end, used)) {
+        return false;
+    }
+    std::fill(counts.begin(), counts.end(), 0);
+    for (uint16_t i = 0; i < used; i++) {
+        uint16_t bin;
+        uint64_t count;
+        if (!get(p, end, bin) || !get(p, end, count) || bin >= counts.size()) {
+            return false;
+        }
+        counts[bin] = count;
+    }
+    return true;
+}
+
+void TopK::add(uint16_t rnti, uint64_t value) {
+    uint64_t &current = values[rnti];
+    current = std::max(current, value);
+}
+
+void TopK::merge(const TopK &other) {
+    for (auto [rnti, value]: other.values) {
+        add(rnti, value);
+    }
+}
+
+std::vector<std::pair<uint16_t, uint64_t>> TopK::top() const {
+    std::vector<std::pair<uint16_t, uint64_t>> result(values.begin(), values.end());
+    auto by_value = [](const auto &a, const auto &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    if (result.size() > k) {
+        std::partial_sort(result.begin(), result.begin() + k, result.end(), by_value);
+        result.resize(k);
+    } else {
+        std::sort(result.begin(), result.end(), by_value);
+    }
+    return result;
+}
+
+void TopK::serialize(std::string &out) const {
+    auto entries = top();
+    put(out, static_cast<uint16_t>(entries.size()));
+    for (auto [rnti, value]: entries) {
+        put(out, rnti);
+        put(out, value);
+    }
+}
+
+bool TopK::deserialize(const char *&p, const char *end) {
+    uint16_t size;
+    if (!get(p, end, size)) {
+        return false;
+    }
+    values.clear();
+    for (uint16_t i = 0; i < size; i++) {
+        uint16_t rnti;
+        uint64_t value;
+        if (!get(p, end, rnti) || !get(p, end, value)) {
+            return false;
+        }
+        values[rnti] = value;
+    }
+    return true;
+}
+
+CellSummary::CellSummary() {
+    for (size_t i = 0; i < std::size(metrics); i++) {
+        metrics[i] = Histogram(static_cast<Metric>(i));
+    }
+}
+
+void CellSummary::add(const UEData &data, ColumnMask columns) {
+    const double values[] = {data.dl_bler, data.ul_bler, data.snr, data.rsrp, double(data.cqi), double(data.dl_mcs),
+                             double(data.ul_mcs)};
+    records++;
+    for (size_t i = 0; i < std::size(metrics); i++) {
+        if (columns & column_bit(metric_table[i].column)) {
+            metrics[i].add(values[i], metric_table[i]);
+        }
+    }
+    if (columns & column_bit(Column::MacTx)) {
+        top_dl.add(data.rnti, data.mac_tx);
+    }
+}
+
+void CellSummary::merge(const CellSummary &other) {
+    records += other.records;
+    for (size_t i = 0; i < std::size(metrics); i++) {
+        metrics[i].merge(other.metrics[i]);
+    }
+    top_dl.merge(other.top_dl);
+}
+
+void CellSummary::serialize(std::string &out) const {
+    put(out, records);
+    for (const Histogram &histogram: metrics) {
+        histogram.serialize(out);
+    }
+    top_dl.serialize(out);
+}
+
+bool CellSummary::deserialize(const char *&p, const char *end) {
+    if (!get(p, end, records)) {
+        return false;
+    }
+    for (Histogram &histogram: metrics) {
+        if (!histogram.deserialize(p, end)) {
+            return false;
+        }
+    }
+    return top_dl.deserialize(p, end);
+}
+
+std::string encode_frame(const std::map<std::string, CellSummary> &cells) {
+    std::string frame;
+    put(frame, summary_magic);
+    put(frame, uint32_t(0));
+    put(frame, static_cast<uint16_t>(cells.size()));
+    for (const auto &[name, summary]: cells) {
+        put(frame, static_cast<uint16_t>(name.size()));
+        frame += name;
+        summary.serialize(frame);
+    }
+    uint32_t size = frame.size() - 8;
+    std::memcpy(frame.data() + 4, &size, sizeof(size));
+    return frame;
+}
+
+ptrdiff_t decode_frame(const char *buffer, size_t size, std::map<std::string, CellSummary> &cells) {
+    const char *p = buffer;
+    const char *end = buffer + size;
+    uint32_t magic, payload;
+    if (!get(p, end, magic) || !get(p, end, payload)) {
+        return 0;
+    }
+    if (magic != summary_magic) {
+        return -1;
+    }
+    if (static_cast<size_t>(end - p) < payload) {
+        return 0;
+    }
+    end = p + payload;
+
+    // Decoded completely before anything is merged, so a corrupt frame changes nothing
+    uint16_t count;
+    if (!get(p, end, count)) {
+        return -1;
+    }
+    std::vector<std::pair<std::string, CellSummary>> decoded;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t name_size;
+        if (!get(p, end, name_size) || end - p < name_size) {
+            return -1;
+        }
+        std::string name(p, name_size);
+        p += name_size;
+        CellSummary summary;
+        if (!summary.deserialize(p, end)) {
+            return -1;
+        }
+        decoded.emplace_back(std::move(name), std::move(summary));
+    }
+    for (const auto &[name, summary]: decoded) {
+        cells[name].merge(summary);
+    }
+    return end - buffer;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "columns.h"
+#include "ue_data.h"
+
+
+// Per-record values summarised for --export, each with a fixed histogram range
+enum class Metric : uint8_t {
+    DlBler,
+    UlBler,
+    Snr,
+    Rsrp,
+    Cqi,
+    DlMcs,
+    UlMcs,
+    Count
+};
+
+struct MetricInfo {
+    const char *name;
+    Column column;
+    double low;
+    double high;
+    uint16_t bins;
+};
+
+const MetricInfo &metric_info(Metric metric);
+
+/* Mergeable summary of one metric
+ *
+ * Count, sum, min and max plus a fixed-bin histogram over the metric's range (values outside land
+ * in an underflow/overflow bin). Bins never depend on the data, so merging two histograms is an
+ * element-wise sum and the result is exactly what one parser would have built from both inputs.
+ * Quantiles are interpolated within a bin, i.e. accurate to one bin width.
+ */
+class Histogram {
+private:
+    uint64_t total = 0;
+    double sum = 0;
+    double min = 0;
+    double max = 0;
+    std::vector<uint64_t> counts; // [0] underflow, [1..bins] range, [bins + 1] overflow
+
+public:
+    explicit Histogram(Metric metric = Metric::DlBler);
+
+    void add(double value, const MetricInfo &info);
+
+    void merge(const Histogram &other);
+
+    uint64_t count() const {
+        return total;
+    }
+
+    double mean() const {
+        return total ? sum / total : 0;
+    }
+
+    double quantile(double q, const MetricInfo &info) const;
+
+    void serialize(std::string &out) const;
+
+    bool deserialize(const char *&p, const char *end);
+};
+
+// Top-K UEs by downlink MAC bytes. The MAC counters are cumulative, so a UE's value is the largest
+// one seen and merging keeps the larger value per RNTI; only the top K survive serialization.
+class TopK {
+private:
+    std::unordered_map<uint16_t, uint64_t> values;
+
+public:
+    static constexpr size_t k = 10;
+
+    void add(uint16_t rnti, uint64_t value);
+
+    void merge(const TopK &other);
+
+    // Largest first, at most k
+    std::vector<std::pair<uint16_t, uint64_t>> top() const;
+
+    void serialize(std::string &out) const;
+
+    bool deserialize(const char *&p, const char *end);
+};
+
+// Everything exported for one cell (one gNB input) over one interval
+struct CellSummary {
+    uint64_t records = 0;
+    Histogram metrics[static_cast<size_t>(Metric::Count)];
+    TopK top_dl;
+
+    CellSummary();
+
+    void add(const UEData &data, ColumnMask columns);
+
+    void merge(const CellSummary &other);
+
+    void serialize(std::string &out) const;
+
+    bool deserialize(const char *&p, const char *end);
+};
+
+/* Wire format (host byte order, little-endian on every platform we run on)
+ *
+ *   u32 magic "GSK1", u32 payload size, payload:
+ *   u16 cell count, then per cell: u16 name size, name, CellSummary
+ *
+ * A frame is self-contained: the aggregator can merge frames in any order and from any number of
+ * connections.
+ */
+constexpr uint32_t summary_magic = 0x314b5347;
+
+std::string encode_frame(const std::map<std::string, CellSummary> &cells);
+
+// Decodes one frame at the start of buffer. Returns bytes used, 0 when the frame is incomplete
+// and -1 when the data is not a frame.
+ptrdiff_t decode_frame(const char *buffer, size_t size, std::map<std::string, CellSummary> &cells);
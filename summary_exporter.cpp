@@ -0,0 +1,155 @@
+#include "summary_exporter.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "endpoint.h"
+#include "placement.h"
+
+
+namespace {
+    // For connecting and for each send: a dead or stuck aggregator costs an interval, not the shutdown
+    constexpr int network_timeout_ms = 1000;
+}
+
+SummaryExporter::SummaryExporter(RecordSink &next_sink, std::string endpoint_spec,
+                                 std::vector<std::string> cell_names, ColumnMask selected,
+                                 std::chrono::milliseconds export_interval)
+    : next(next_sink), endpoint(std::move(endpoint_spec)), cells(std::move(cell_names)), columns(selected),
+      interval(export_interval), current(cells.size()) {
+    sender = std::thread(&SummaryExporter::run, this);
+}
+
+SummaryExporter::~SummaryExporter() {
+    finish();
+}
+
+void SummaryExporter::write(const UEData &data) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current[data.source].add(data, columns);
+    }
+    next.write(data);
+}
+
+void SummaryExporter::run() {
+    place_thread(ThreadRole::Writer);
+    std::unique_lock<std::mutex> guard(lock);
+    // The interval cut short by finish() is sent as well, even when it is the first one
+    bool last = false;
+    while (!last) {
+        wake.wait_for(guard, interval, [&] {
+            return stopping;
+        });
+        last = stopping;
+        guard.unlock();
+        send_interval();
+        guard.lock();
+    }
+}
+
+void SummaryExporter::send_interval() {
+    std::vector<CellSummary> taken(cells.size());
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::swap(taken, current);
+    }
+
+    std::map<std::string, CellSummary> frame_cells;
+    for (size_t i = 0; i < taken.size(); i++) {
+        if (taken[i].records) {
+            frame_cells.emplace(cells[i], std::move(taken[i]));
+        }
+    }
+    if (frame_cells.empty()) {
+        return;
+    }
+    std::string frame = encode_frame(frame_cells);
+
+    std::string error;
+    if (fd < 0) {
+        fd = connect_endpoint(endpoint, error, network_timeout_ms);
+    }
+    size_t done = 0;
+    while (fd >= 0 && done < frame.size()) {
+        ssize_t n = send(fd, frame.data() + done, frame.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            error = endpoint + ": " + (n < 0 && errno == EAGAIN ? "send timed out" : std::strerror(errno));
+            close(fd);
+            fd = -1;
+            break;
+        }
+        done += n;
+    }
+
+    if (fd < 0) {
+        // Report the first failure of a streak only; a half-sent frame is discarded by the aggregator
+        if (!failing) {
+            std::cerr << "--export: " << error << ", dropping summaries until it is reachable" << std::endl;
+        }
+        failing = true;
+        dropped++;
+        return;
+    }
+    if (failing) {
+        std::cerr << "--export: reconnected to " << endpoint << std::endl;
+    }
+    failing = false;
+    sent++;
+}
+
+void SummaryExporter::finish() {
+    if (!sender.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    sender.join();
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    std::cerr << "--export: " << sent << " summaries sent, " << dropped << " dropped" << std::endl;
+}
+
+void SummaryExporter::save_state(std::string &out, bool take) {
+    std::lock_guard<std::mutex> guard(lock);
+    put_raw(out, static_cast<uint16_t>(current.size()));
+    for (CellSummary &summary: current) {
+        summary.serialize(out);
+        if (take) {
+            summary = CellSummary();
+        }
+    }
+}
+
+bool SummaryExporter::restore_state(std::string_view state) {
+    const char *p = state.data();
+    const char *end = p + state.size();
+    uint16_t count;
+    if (!get_raw(p, end, count) || count != cells.size()) {
+        return false;
+    }
+    std::vector<CellSummary> restored(count);
+    for (CellSummary &summary: restored) {
+        if (!summary.deserialize(p, end)) {
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < count; i++) {
+        current[i].merge(restored[i]);
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "columns.h"
+#include "record_sink.h"
+#include "summary.h"
+
+
+/* --export: periodic mergeable summaries for gnb_aggregator
+ *
+ * Every record also goes into the CellSummary of its input. A sender thread swaps the summaries
+ * out once per interval and sends them as one frame. It also (re)connects lazily, so parsing never
+ * waits for the network; an interval that cannot be delivered is dropped and counted. Connecting
+ * and sending give up after a second, so an unreachable aggregator cannot hold up the exit either.
+ */
+class SummaryExporter : public RecordSink {
+private:
+    RecordSink &next;
+    std::string endpoint;
+    std::vector<std::string> cells; // cell name per input
+    ColumnMask columns;
+    std::chrono::milliseconds interval;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<CellSummary> current; // per input
+    std::thread sender;
+
+    int fd = -1;
+    bool failing = false;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+
+    void run();
+
+    void send_interval();
+
+public:
+    SummaryExporter(RecordSink &next_sink, std::string endpoint_spec, std::vector<std::string> cell_names,
+                    ColumnMask selected, std::chrono::milliseconds export_interval);
+
+    ~SummaryExporter() override;
+
+    void write(const UEData &data) override;
+
+    // Sends the last partial interval and stops the sender
+    void finish();
+
+    // --checkpoint: the interval so far. With take it is also cleared: the run is ending, and the
+    // next one continues the interval instead of finish() sending it.
+    void save_state(std::string &out, bool take);
+
+    bool restore_state(std::string_view state);
+};
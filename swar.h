@@ -0,0 +1,157 @@
+#pragma once
+
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+
+/* SWAR (SIMD within a register) field decoders
+ *
+ * Each decoder loads 8 bytes into a 64-bit register, classifies all of them at once and converts
+ * the digits with three multiplies instead of a per-character loop. Loads never go past end: short
+ * tails are copied into a zeroed word first, and the zero bytes then classify as non-digits.
+ * Byte order is assumed little-endian (x86, ARM).
+ */
+
+namespace swar {
+    constexpr uint64_t ones = 0x0101010101010101;
+    constexpr uint64_t high_bits = 0x8080808080808080;
+
+    inline uint64_t load8(const char *p, const char *end) {
+        uint64_t v = 0;
+        std::memcpy(&v, p, end - p >= 8 ? 8 : end - p);
+        return v;
+    }
+
+    // High bit of every byte that is non-zero
+    inline uint64_t nonzero_bytes(uint64_t v) {
+        return (((v & ~high_bits) + ~high_bits) | v) & high_bits;
+    }
+
+    // Number of leading bytes before the first set high bit (8 if there is none)
+    inline int leading_bytes(uint64_t marks) {
+        return std::countr_zero(marks) >> 3;
+    }
+
+    // Leading ASCII digits in the word, 0..8. Both nibble tests must pass: high nibble 3 and the
+    // low nibble + 6 still below 16. A carry out of a non-digit byte only disturbs later bytes.
+    inline int digit_count(uint64_t v) {
+        uint64_t hi = (v & (0xf0 * ones)) ^ (0x30 * ones);
+        uint64_t lo = ((v + 0x06 * ones) & (0xf0 * ones)) ^ (0x30 * ones);
+        return leading_bytes(nonzero_bytes(hi | lo));
+    }
+
+    // Value of the first n (1..8) digits of the word
+    inline uint32_t digits_value(uint64_t v, int n) {
+        v = (v & (0x0f * ones)) << (8 * (8 - n));
+        v = (v * (1 + (10 << 8))) >> 8 & 0x00ff00ff00ff00ff;
+        v = (v * (1 + (100 << 16))) >> 16 & 0x0000ffff0000ffff;
+        return static_cast<uint32_t>((v * (1 + (10000ull << 32))) >> 32);
+    }
+
+    // Leading spaces in the word, 0..8
+    inline int space_count(uint64_t v) {
+        return leading_bytes(nonzero_bytes(v ^ (0x20 * ones)));
+    }
+
+    constexpr uint64_t pow10[] = {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull
+    };
+
+    // Skips a run of spaces (OAI right-aligns its byte counters in wide columns)
+    inline const char *skip_spaces(const char *p, const char *end) {
+        while (p < end) {
+            int n = space_count(load8(p, end));
+            p += n;
+            if (n < 8) {
+                break;
+            }
+        }
+        return p < end ? p : end;
+    }
+
+    // Unsigned decimal, 8 digits per step. Returns the first byte past the digits, or nullptr if
+    // there are none.
+    inline const char *parse_uint(const char *p, const char *end, uint64_t &value) {
+        uint64_t result = 0;
+        const char *start = p;
+        while (p < end) {
+            uint64_t word = load8(p, end);
+            int n = digit_count(word);
+            if (n == 0) {
+                break;
+            }
+            result = result * pow10[n] + digits_value(word, n);
+            p += n;
+            if (n < 8) {
+                break;
+            }
+        }
+        value = result;
+        return p == start ? nullptr : p;
+    }
+
+    inline const char *parse_int(const char *p, const char *end, int64_t &value) {
+        bool negative = p < end && *p == '-';
+        uint64_t magnitude;
+        const char *next = parse_uint(p + negative, end, magnitude);
+        value = negative ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+        return next;
+    }
+
+    inline bool is_word_char(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    // Up to 4 hex digits (RNTIs are printed as %04x). Returns nullptr unless the token ends there.
+    inline const char *parse_hex16(const char *p, const char *end, uint16_t &value) {
+        // Setting bit 5 lowercases letters and leaves digits alone
+        uint64_t lower = load8(p, end) | 0x20 * ones;
+        uint64_t not_digit = ((lower & (0xf0 * ones)) ^ (0x30 * ones)) |
+                             (((lower + 0x06 * ones) & (0xf0 * ones)) ^ (0x30 * ones));
+        uint64_t not_alpha = (((lower + 0x09 * ones) & (0xf0 * ones)) ^ (0x60 * ones)) |
+                             (((lower + 0x0f * ones) & (0xf0 * ones)) ^ (0x70 * ones));
+        uint64_t invalid = nonzero_bytes(not_digit) & nonzero_bytes(not_alpha);
+        int n = leading_bytes(invalid | uint64_t(0x80) << 32);
+        if (n == 0 || (p + n < end && is_word_char(p[n]))) {
+            return nullptr;
+        }
+
+        // Letters carry bit 6, so their low nibble needs +9
+        uint32_t nibbles = static_cast<uint32_t>((lower & (0x0f * ones)) + ((lower >> 6) & ones) * 9);
+        nibbles <<= 8 * (4 - n);
+        uint32_t pairs = ((nibbles << 4) | (nibbles >> 8)) & 0x00ff00ff;
+        value = static_cast<uint16_t>((pairs & 0xff) << 8 | pairs >> 16);
+        return p + n;
+    }
+
+    // Fixed-point decimal such as "0.02678" or "-17.5". Digits are gathered into one integer and
+    // divided once, which rounds exactly like strtod while both stay below 2^53.
+    inline const char *parse_real(const char *p, const char *end, double &value) {
+        bool negative = p < end && *p == '-';
+        uint64_t whole;
+        const char *q = parse_uint(p + negative, end, whole);
+        if (!q) {
+            return nullptr;
+        }
+        double result = static_cast<double>(whole);
+        if (q < end && *q == '.') {
+            uint64_t fraction;
+            const char *r = parse_uint(q + 1, end, fraction);
+            if (r) {
+                long digits = r - (q + 1);
+                if (digits <= 8 && whole < (uint64_t(1) << 53) / pow10[8]) {
+                    result = static_cast<double>(whole * pow10[digits] + fraction) / pow10[digits];
+                } else {
+                    result = std::strtod(std::string(p + negative, r).c_str(), nullptr);
+                }
+                q = r;
+            }
+        }
+        value = negative ? -result : result;
+        return q;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+#include "delta_output.h"
+
+
+// Checks for the test executables. A failed check is reported (the first few of them) and the
+// test goes on, so one run shows everything that broke; main returns test_result().
+namespace check {
+    inline int failures = 0;
+
+    inline void failed(const char *file, int line, const char *condition) {
+        if (failures++ < 20) {
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+        }
+    }
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            check::failed(__FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+inline int test_result() {
+    if (check::failures) {
+        std::fprintf(stderr, "%d checks failed\n", check::failures);
+        return 1;
+    }
+    return 0;
+}
+
+// A fresh directory under $TMPDIR (or /tmp), removed with everything in it at the end of the test
+class TempDir {
+private:
+    std::string path;
+
+public:
+    TempDir() {
+        const char *base = std::getenv("TMPDIR");
+        std::string pattern = std::string(base && *base ? base : "/tmp") + "/gnb_test.XXXXXX";
+        path = mkdtemp(pattern.data()) ? pattern : std::string();
+    }
+
+    ~TempDir() {
+        if (!path.empty()) {
+            std::error_code ignored;
+            std::filesystem::remove_all(path, ignored);
+        }
+    }
+
+    TempDir(const TempDir &) = delete;
+
+    TempDir &operator=(const TempDir &) = delete;
+
+    std::string file(const std::string &name) const {
+        return path + "/" + name;
+    }
+};
+
+inline std::string read_file(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+// What --decode prints for the file. run_decode writes to stdout and reports to stderr, so both
+// are pointed at files next to it for the call; messages, when given, gets what went to stderr.
+inline std::string decode_file(const std::string &path, std::string *messages = nullptr) {
+    std::string csv = path + ".csv";
+    std::string log = path + ".log";
+    std::fflush(stdout);
+    std::fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    int out = open(csv.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int err = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    dup2(out, STDOUT_FILENO);
+    dup2(err, STDERR_FILENO);
+    close(out);
+    close(err);
+    int code = run_decode(path);
+    std::fflush(stdout);
+    std::fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    CHECK(code == 0);
+    if (messages) {
+        *messages = read_file(log);
+    }
+    return read_file(csv);
+}
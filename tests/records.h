@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "ue_data.h"
+
+
+// A stream of UE records shaped like a gNB's: per UE most fields repeat from one period to the
+// next, reals have a few decimals (now and then any double), timestamps advance by 0-2 s and the
+// MAC counters grow until the UE reattaches
+class RecordGenerator {
+private:
+    std::mt19937_64 rng;
+    std::vector<UEData> ues;
+    size_t next_ue = 0;
+
+    uint64_t below(uint64_t n) {
+        return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+    }
+
+    bool chance(unsigned percent) {
+        return below(100) < percent;
+    }
+
+    double decimal(int low, int high, double scale) {
+        if (chance(2)) {
+            return std::uniform_real_distribution<double>(low, high)(rng);
+        }
+        auto steps = static_cast<uint64_t>((high - low) * scale) + 1;
+        return (low * scale + static_cast<double>(below(steps))) / scale;
+    }
+
+public:
+    RecordGenerator(uint64_t seed, size_t ue_count, uint16_t sources = 1) : rng(seed), ues(ue_count) {
+        for (size_t i = 0; i < ue_count; i++) {
+            UEData &data = ues[i];
+            data.rnti = static_cast<uint16_t>(below(65536));
+            data.source = static_cast<uint16_t>(i % sources);
+            data.ue_id = static_cast<int>(i + 1);
+            data.timestamp = 1760000000 + static_cast<time_t>(below(1000));
+        }
+    }
+
+    const UEData &next() {
+        UEData &data = ues[next_ue];
+        next_ue = (next_ue + 1) % ues.size();
+        data.timestamp += static_cast<time_t>(below(3));
+        if (chance(10)) {
+            data.state = chance(80) ? UEState::InSync : chance(50) ? UEState::OutOfSync : UEState::Unknown;
+        }
+        if (chance(20)) {
+            data.ph = static_cast<int>(below(80)) - 20;
+            data.pcmax = static_cast<int>(below(30));
+            data.rsrp = decimal(-140, -40, 1);
+        }
+        if (chance(30)) {
+            data.cqi = static_cast<int>(below(16));
+            data.dl_ri = static_cast<int>(below(4)) + 1;
+            data.ul_ri = static_cast<int>(below(4)) + 1;
+        }
+        if (chance(60)) {
+            data.dlsch_err += static_cast<int>(below(3));
+            data.pucch_dtx += static_cast<int>(below(20));
+            data.dl_bler = decimal(0, 1, 1e5);
+            data.dl_mcs = static_cast<int>(below(29));
+        }
+        if (chance(60)) {
+            data.ulsch_err += static_cast<int>(below(3));
+            data.ulsch_dtx += static_cast<int>(below(20));
+            data.ul_bler = decimal(0, 1, 1e5);
+            data.ul_mcs = static_cast<int>(below(29));
+            data.nprb = static_cast<int>(below(274));
+            data.snr = decimal(-10, 50, 10);
+        }
+        if (chance(1)) {
+            data.mac_tx = 0;
+            data.mac_rx = 0;
+        }
+        data.mac_tx += below(1000000);
+        data.mac_rx += below(100000000);
+        return data;
+    }
+};
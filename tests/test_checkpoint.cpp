@@ -0,0 +1,386 @@
+// --checkpoint: a run stopped anywhere and restored from its checkpoint has to write what one
+// uninterrupted run writes, records waiting for their MAC line and delta keyframe cycles included,
+// and damaged state has to be refused without restoring any of it
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef GNB_HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+#include "check.h"
+#include "checkpoint.h"
+#include "columns.h"
+#include "delta_output.h"
+#include "parser.h"
+#include "records.h"
+#include "series_output.h"
+#include "sqlite_output.h"
+
+
+namespace {
+    std::mt19937_64 rng(20261018);
+
+    size_t below(size_t n) {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    }
+
+    std::string format(const char *pattern, auto... values) {
+        char line[512];
+        std::snprintf(line, sizeof(line), pattern, values...);
+        return line;
+    }
+
+    // Stats periods in the OAI layout. Now and then a MAC line is missing or a UE sits a period
+    // out, so records wait for their MAC line across periods and at the end.
+    std::vector<std::string> log_lines(int periods) {
+        const uint16_t rntis[] = {0x928c, 0x0001, 0xffee, 0x4a0b, 0x1234};
+        uint64_t mac_tx[std::size(rntis)] = {};
+        std::vector<std::string> lines;
+        for (int period = 0; period < periods; period++) {
+            lines.push_back(format("[NR_MAC]   Frame.Slot %d.0", period));
+            for (size_t ue = 0; ue < std::size(rntis); ue++) {
+                if (below(8) == 0) {
+                    continue;
+                }
+                std::string rnti = rnti_str(rntis[ue]);
+                lines.push_back(format("UE RNTI %s CU-UE-ID %zu %s PH %d dB PCMAX %d dBm, average RSRP %d (17 meas)",
+                                       rnti.c_str(), ue + 1, below(2) ? "in-sync" : "out-of-sync",
+                                       static_cast<int>(below(80)) - 20, static_cast<int>(below(30)),
+                                       -static_cast<int>(below(140))));
+                lines.push_back(format("UE %s: CQI %zu, RI %zu, PMI (0,0)", rnti.c_str(), below(16), below(4) + 1));
+                lines.push_back(format("UE %s: UL-RI %zu, TPMI 0", rnti.c_str(), below(4) + 1));
+                lines.push_back(format("UE %s: dlsch_rounds 681/10/1/0, dlsch_errors %zu, pucch0_DTX %zu, BLER %.5f "
+                                       "MCS (1) %zu", rnti.c_str(), below(100), below(1000),
+                                       static_cast<double>(below(100000)) / 1e5, below(29)));
+                lines.push_back(format("UE %s: ulsch_rounds 1136/77/0/0, ulsch_errors %zu, ulsch_DTX %zu, BLER %.5f "
+                                       "MCS (1) %zu (Qm 4 deltaMCS 0 dB) NPRB %zu  SNR %.1f dB", rnti.c_str(),
+                                       below(100), below(1000), static_cast<double>(below(100000)) / 1e5, below(29),
+                                       below(274), (static_cast<double>(below(600)) - 100) / 10));
+                mac_tx[ue] += below(100000);
+                if (below(10) != 0) {
+                    lines.push_back(format("UE %s: MAC:    TX %14llu RX %14llu bytes", rnti.c_str(),
+                                           static_cast<unsigned long long>(mac_tx[ue]),
+                                           static_cast<unsigned long long>(mac_tx[ue] * 3)));
+                }
+                lines.push_back(format("UE %s: LCID 1: TX            369 RX           1074 bytes", rnti.c_str()));
+            }
+        }
+        return lines;
+    }
+
+    class Collect : public RecordSink {
+    public:
+        std::vector<UEData> rows;
+
+        void write(const UEData &data) override {
+            rows.push_back(data);
+        }
+    };
+
+    // Records are stamped with the time they were parsed, which differs between runs
+    bool same_rows(const std::vector<UEData> &got, const std::vector<UEData> &want, ColumnMask columns) {
+        if (got.size() != want.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < got.size(); i++) {
+            for (int c = 0; c < static_cast<int>(Column::Count); c++) {
+                auto column = static_cast<Column>(c);
+                if (column != Column::Timestamp && (columns & column_bit(column)) &&
+                    !same_column(got[i], want[i], column)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The parser stopped before every line in turn and continued by a fresh one from its state
+    void test_parser(ColumnMask columns) {
+        std::vector<std::string> lines = log_lines(40);
+        Collect whole;
+        Parser reference(whole, columns);
+        for (const std::string &line: lines) {
+            reference.parse_line(line);
+        }
+        reference.finish();
+
+        for (size_t split = 0; split <= lines.size(); split++) {
+            Collect before, after;
+            Parser first(before, columns);
+            for (size_t i = 0; i < split; i++) {
+                first.parse_line(lines[i]);
+            }
+            std::string state;
+            first.save_state(state);
+
+            Parser second(after, columns);
+            CHECK(second.restore_state(state));
+            for (size_t i = split; i < lines.size(); i++) {
+                second.parse_line(lines[i]);
+            }
+            second.finish();
+            before.rows.insert(before.rows.end(), after.rows.begin(), after.rows.end());
+            CHECK(same_rows(before.rows, whole.rows, columns));
+            CHECK(second.records_written() == reference.records_written());
+            CHECK(second.stats_periods() == reference.stats_periods());
+        }
+    }
+
+    void test_damaged_parser_state() {
+        std::vector<std::string> lines = log_lines(10);
+        Collect sink;
+        Parser parser(sink, all_columns);
+        // Stop inside a UE's lines, with records under way
+        for (size_t i = 0; i < lines.size() / 2 + 3; i++) {
+            parser.parse_line(lines[i]);
+        }
+        std::string state;
+        parser.save_state(state);
+        CHECK(state.size() > 3 * sizeof(uint64_t) + sizeof(uint32_t));
+
+        for (size_t size: {size_t(0), size_t(7), size_t(28), state.size() - 1}) {
+            Parser fresh(sink, all_columns);
+            CHECK(!fresh.restore_state(std::string_view(state).substr(0, size)));
+            CHECK(fresh.stats_periods() == 0 && fresh.records_written() == 0);
+        }
+        Parser fresh(sink, all_columns);
+        CHECK(!fresh.restore_state(state + '\0'));
+        CHECK(fresh.stats_periods() == 0 && fresh.records_written() == 0);
+    }
+
+    // A DeltaHistory restored mid-stream picks the same keyframes and deltas as one that never stopped
+    void test_delta_history() {
+        ColumnMask columns = all_columns;
+        RecordGenerator generator(5, 30, 2);
+        std::vector<UEData> records;
+        for (int i = 0; i < 3000; i++) {
+            records.push_back(generator.next());
+        }
+        auto stream = [&](DeltaHistory &history, size_t from, size_t to, std::string &out) {
+            for (size_t i = from; i < to; i++) {
+                history.next(records[i], [&](const UEData *last) {
+                    put_binary_delta_row(out, records[i], columns, last);
+                });
+            }
+        };
+        DeltaHistory reference(7);
+        std::string whole;
+        stream(reference, 0, records.size(), whole);
+
+        for (size_t split: {size_t(0), size_t(1), size_t(29), size_t(1000), size_t(2999)}) {
+            DeltaHistory first(7);
+            std::string rows;
+            stream(first, 0, split, rows);
+            std::string state;
+            first.save(state);
+            DeltaHistory second(7);
+            CHECK(second.restore(state));
+            stream(second, split, records.size(), rows);
+            CHECK(rows == whole);
+
+            if (!state.empty()) {
+                DeltaHistory damaged(7);
+                CHECK(!damaged.restore(std::string_view(state).substr(0, state.size() - 1)));
+                CHECK(!damaged.restore(state + '\0'));
+            }
+        }
+    }
+
+    // Both runs as main wires them: the first ends with a clean checkpoint instead of finish(),
+    // the second restores it and appends to the first one's delta file
+    void test_restart(DeltaFormat format) {
+        TempDir dir;
+        // No timestamp column: both runs then write the same bytes
+        ColumnMask columns = default_columns & ~column_bit(Column::Timestamp);
+        std::vector<std::string> sources = {"gnb"};
+        std::vector<std::string> lines = log_lines(200);
+        std::string name = format == DeltaFormat::Csv ? "rows.csv" : "rows.bin";
+
+        std::string whole = dir.file("whole_" + name);
+        {
+            DeltaOutput output(whole, format, columns, sources, 16);
+            Parser parser(output, columns);
+            for (const std::string &line: lines) {
+                parser.parse_line(line);
+            }
+            parser.finish();
+        }
+
+        std::string resumed = dir.file(name);
+        std::string checkpoint = dir.file("checkpoint");
+        // Inside a UE's lines, between its ulsch and MAC lines
+        size_t split = lines.size() / 2;
+        while (lines[split].find("ulsch_rounds") == std::string::npos) {
+            split++;
+        }
+        split++;
+        {
+            DeltaOutput output(resumed, format, columns, sources, 16);
+            Parser parser(output, columns);
+            for (size_t i = 0; i < split; i++) {
+                parser.parse_line(lines[i]);
+            }
+            CheckpointBuilder builder(columns, sources, true);
+            builder.section(CheckpointSection::Parser, [&](std::string &out) {
+                parser.save_state(out);
+            });
+            builder.section(CheckpointSection::DeltaHistory, [&](std::string &out) {
+                output.save_state(out);
+            });
+            Checkpointer(checkpoint, std::chrono::milliseconds(10000)).write_final(builder.take());
+        }
+        {
+            LoadedCheckpoint restored;
+            std::string error;
+            CHECK(restored.load(checkpoint, columns, sources, error));
+            CHECK(error.empty() && restored.clean());
+            CHECK(restored.section(CheckpointSection::Summaries).empty());
+
+            OutputOptions options;
+            options.resume = true;
+            DeltaOutput output(resumed, format, columns, sources, 16, options);
+            Parser parser(output, columns);
+            CHECK(parser.restore_state(restored.section(CheckpointSection::Parser)));
+            CHECK(output.restore_state(restored.section(CheckpointSection::DeltaHistory)));
+            for (size_t i = split; i < lines.size(); i++) {
+                parser.parse_line(lines[i]);
+            }
+            parser.finish();
+        }
+        CHECK(read_file(resumed) == read_file(whole));
+        CHECK(decode_file(resumed) == decode_file(whole));
+    }
+
+    // The rows of a CSV without its header, sorted: blocks of a series file come in no fixed order
+    std::vector<std::string> sorted_rows(const std::string &csv) {
+        std::vector<std::string> rows;
+        for (size_t start = csv.find('\n') + 1; start < csv.size();) {
+            size_t end = csv.find('\n', start);
+            rows.push_back(csv.substr(start, end - start));
+            start = end + 1;
+        }
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    // A resumed run adds its blocks to the series file of the run before it
+    void test_resume_series() {
+        TempDir dir;
+        std::string path = dir.file("rows.series");
+        std::vector<std::string> sources = {"gnb"};
+        RecordGenerator generator(74, 20);
+        RowFormatter formatter(sources);
+        std::string expected = csv_header(default_columns | column_bit(Column::Rnti));
+        char row[max_row_size];
+        for (bool resume: {false, true}) {
+            OutputOptions options;
+            options.resume = resume;
+            SeriesOutput output(path, default_columns | column_bit(Column::Rnti), sources, options);
+            CHECK(output.is_open());
+            for (int i = 0; i < 3000; i++) {
+                const UEData &data = generator.next();
+                output.write(data);
+                expected.append(row, formatter.format_row(data, default_columns | column_bit(Column::Rnti), row));
+            }
+        }
+        CHECK(sorted_rows(decode_file(path)) == sorted_rows(expected));
+    }
+
+#ifdef GNB_HAVE_SQLITE
+    int64_t sqlite_rows(const std::string &path) {
+        sqlite3 *db = nullptr;
+        sqlite3_stmt *count = nullptr;
+        int64_t rows = -1;
+        if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK &&
+            sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM ue_metrics", -1, &count, nullptr) == SQLITE_OK &&
+            sqlite3_step(count) == SQLITE_ROW) {
+            rows = sqlite3_column_int64(count, 0);
+        }
+        sqlite3_finalize(count);
+        sqlite3_close(db);
+        return rows;
+    }
+
+    // A resumed run adds its rows to the table of the run before it; a new run starts over
+    void test_resume_sqlite() {
+        TempDir dir;
+        std::string path = dir.file("rows.sqlite");
+        RecordGenerator generator(74, 20);
+        for (bool resume: {false, true}) {
+            SqliteOutput output(path, default_columns, {"gnb"}, resume);
+            CHECK(output.is_open());
+            for (int i = 0; i < 1000; i++) {
+                output.write(generator.next());
+            }
+        }
+        CHECK(sqlite_rows(path) == 2000);
+        {
+            SqliteOutput output(path, default_columns, {"gnb"});
+            output.write(generator.next());
+        }
+        CHECK(sqlite_rows(path) == 1);
+    }
+#endif
+
+    // A checkpoint only loads into a run with the same columns and inputs, and only whole
+    void test_load() {
+        TempDir dir;
+        std::string path = dir.file("checkpoint");
+        std::vector<std::string> sources = {"gnb0", "gnb1"};
+        CheckpointBuilder builder(default_columns, sources, false);
+        builder.section(CheckpointSection::Parser, [](std::string &out) {
+            out += "parser";
+        });
+        builder.section(CheckpointSection::Summaries, [](std::string &out) {
+            out += "summaries";
+        });
+        std::string bytes = builder.take();
+        auto store = [&](const std::string &contents) {
+            std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+        };
+        store(bytes);
+
+        LoadedCheckpoint loaded;
+        std::string error;
+        CHECK(loaded.load(path, default_columns, sources, error));
+        CHECK(!loaded.clean());
+        CHECK(loaded.section(CheckpointSection::Parser) == "parser");
+        CHECK(loaded.section(CheckpointSection::Summaries) == "summaries");
+        CHECK(loaded.section(CheckpointSection::DeltaHistory).empty());
+
+        CHECK(!LoadedCheckpoint().load(path, all_columns, sources, error) && !error.empty());
+        error.clear();
+        CHECK(!LoadedCheckpoint().load(path, default_columns, {"gnb0", "gnb2"}, error) && !error.empty());
+        error.clear();
+        CHECK(!LoadedCheckpoint().load(path, default_columns, {"gnb0"}, error) && !error.empty());
+        for (size_t cut: {size_t(1), bytes.size() - 10, size_t(20)}) {
+            store(bytes.substr(0, bytes.size() - cut));
+            error.clear();
+            CHECK(!LoadedCheckpoint().load(path, default_columns, sources, error) && !error.empty());
+        }
+        // No checkpoint yet is not an error
+        error.clear();
+        CHECK(!LoadedCheckpoint().load(dir.file("missing"), default_columns, sources, error) && error.empty());
+    }
+}
+
+int main() {
+    test_parser(default_columns);
+    test_parser(all_columns);
+    test_damaged_parser_state();
+    test_delta_history();
+    test_restart(DeltaFormat::Csv);
+    test_restart(DeltaFormat::Binary);
+    test_resume_series();
+#ifdef GNB_HAVE_SQLITE
+    test_resume_sqlite();
+#endif
+    test_load();
+    return test_result();
+}
@@ -0,0 +1,269 @@
+// The SWAR field decoders (swar.h) against the C library on random input, and the parser built on
+// them against records it is given as formatted log lines
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "columns.h"
+#include "parser.h"
+#include "swar.h"
+
+
+namespace {
+    std::mt19937_64 rng(20260517);
+
+    size_t below(size_t n) {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    }
+
+    // Mostly digits, with the punctuation, letters and high bytes a log line can hold
+    std::string random_text() {
+        static const std::string alphabet = "0123456789012345678901234567890123456789-.  abcdefABCDEFxyzXYZ_(),:+";
+        std::string text(below(25), ' ');
+        for (char &c: text) {
+            c = below(20) == 0 ? static_cast<char>(0x80 + below(128)) : alphabet[below(alphabet.size())];
+        }
+        return text;
+    }
+
+    bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    size_t digit_run(const std::string &text, size_t from) {
+        size_t end = from;
+        while (end < text.size() && is_digit(text[end])) {
+            end++;
+        }
+        return end - from;
+    }
+
+    bool same_bits(double a, double b) {
+        return std::memcmp(&a, &b, sizeof(a)) == 0;
+    }
+
+    // Each decoder on a buffer exactly as long as the text, so a load past its end would show up
+    // under a sanitizer, compared with what the C library makes of the same bytes
+    void check_decoders(const std::string &text) {
+        auto buffer = std::make_unique<char[]>(text.size() + 1);
+        std::memcpy(buffer.get(), text.data(), text.size());
+        const char *p = buffer.get();
+        const char *end = p + text.size();
+
+        size_t spaces = 0;
+        while (spaces < text.size() && text[spaces] == ' ') {
+            spaces++;
+        }
+        CHECK(swar::skip_spaces(p, end) == p + spaces);
+
+        // Counters fit 19 digits; longer runs only have to end in the right place
+        size_t digits = digit_run(text, 0);
+        uint64_t value = 0;
+        const char *next = swar::parse_uint(p, end, value);
+        CHECK(next == (digits ? p + digits : nullptr));
+        if (digits && digits <= 19) {
+            CHECK(value == std::strtoull(std::string(text, 0, digits).c_str(), nullptr, 10));
+        }
+
+        bool negative = !text.empty() && text[0] == '-';
+        size_t magnitude = digit_run(text, negative);
+        int64_t integer = 0;
+        next = swar::parse_int(p, end, integer);
+        CHECK(next == (magnitude ? p + negative + magnitude : nullptr));
+        if (magnitude && magnitude <= 18) {
+            CHECK(integer == std::strtoll(std::string(text, 0, negative + magnitude).c_str(), nullptr, 10));
+        }
+
+        size_t real_end = negative + magnitude;
+        if (magnitude && real_end < text.size() && text[real_end] == '.') {
+            size_t fraction = digit_run(text, real_end + 1);
+            real_end += fraction ? fraction + 1 : 0;
+        }
+        double real = 0;
+        next = swar::parse_real(p, end, real);
+        CHECK(next == (magnitude ? p + real_end : nullptr));
+        if (magnitude && magnitude <= 19) {
+            CHECK(same_bits(real, std::strtod(std::string(text, 0, real_end).c_str(), nullptr)));
+        }
+
+        size_t hex = 0;
+        while (hex < 4 && hex < text.size() && std::isxdigit(static_cast<unsigned char>(text[hex]))) {
+            hex++;
+        }
+        bool token_ends = hex == text.size() || !swar::is_word_char(text[hex]);
+        uint16_t rnti = 0;
+        next = swar::parse_hex16(p, end, rnti);
+        CHECK(next == (hex && token_ends ? p + hex : nullptr));
+        if (next) {
+            CHECK(rnti == std::strtoul(std::string(text, 0, hex).c_str(), nullptr, 16));
+        }
+    }
+
+    void test_words() {
+        for (int i = 0; i < 200000; i++) {
+            uint64_t word = rng();
+            // Plant a run of digits in front of random bytes
+            int planted = static_cast<int>(below(9));
+            for (int b = 0; b < planted; b++) {
+                word = (word & ~(uint64_t(0xff) << 8 * b)) | uint64_t('0' + below(10)) << 8 * b;
+            }
+            char bytes[8];
+            std::memcpy(bytes, &word, sizeof(word));
+            int expected = 0;
+            while (expected < 8 && is_digit(bytes[expected])) {
+                expected++;
+            }
+            CHECK(swar::digit_count(word) == expected);
+            for (int n = 1; n <= expected; n++) {
+                CHECK(swar::digits_value(word, n) == std::strtoul(std::string(bytes, n).c_str(), nullptr, 10));
+            }
+        }
+    }
+
+    void test_fuzz() {
+        for (int i = 0; i < 300000; i++) {
+            check_decoders(random_text());
+        }
+        // The shapes the log has, at every length around the 8 byte steps
+        for (size_t length = 1; length <= 20; length++) {
+            std::string digits;
+            for (size_t i = 0; i < length; i++) {
+                digits += static_cast<char>('0' + below(10));
+            }
+            for (const std::string &text: {digits, "-" + digits, digits + ".", "0." + digits, "-17." + digits,
+                                           digits + " dB", std::string(length, ' ') + digits}) {
+                check_decoders(text);
+            }
+        }
+        for (const char *text: {"", "-", ".", "-.", "0", "-0", "-0.0", "928c", "928c:", "928C ", "ffff", "12345",
+                                "0x1f", "1.", "1.e5", "18446744073709551615", "4.99999999999999999999"}) {
+            check_decoders(text);
+        }
+    }
+
+    class Collect : public RecordSink {
+    public:
+        std::vector<UEData> rows;
+
+        void write(const UEData &data) override {
+            rows.push_back(data);
+        }
+    };
+
+    std::string format(const char *pattern, auto... values) {
+        char line[512];
+        std::snprintf(line, sizeof(line), pattern, values...);
+        return line;
+    }
+
+    // Random stats periods in the OAI layout through Parser: every field has to come back as the
+    // C library reads the printed text, and the MAC counters of a period belong to its own record
+    void test_parser(ColumnMask columns) {
+        Collect sink;
+        Parser parser(sink, columns);
+        std::vector<UEData> expected;
+        uint64_t mac_tx[4] = {};
+        uint64_t mac_rx[4] = {};
+        const uint16_t rntis[] = {0x928c, 0x0001, 0xffee, 0x4a0b};
+        for (int period = 0; period < 2000; period++) {
+            parser.parse_line(format("[NR_MAC]   Frame.Slot %d.0", period));
+            for (int ue = 0; ue < 4; ue++) {
+                UEData data{};
+                data.rnti = rntis[ue];
+                data.ue_id = ue + 1;
+                data.state = below(2) ? UEState::InSync : UEState::OutOfSync;
+                data.ph = static_cast<int>(below(80)) - 20;
+                data.pcmax = static_cast<int>(below(30));
+                data.rsrp = -static_cast<int>(below(140));
+                data.cqi = static_cast<int>(below(16));
+                data.dl_ri = static_cast<int>(below(4)) + 1;
+                data.ul_ri = static_cast<int>(below(4)) + 1;
+                data.dlsch_err = static_cast<int>(below(100000));
+                data.pucch_dtx = static_cast<int>(below(100000));
+                data.dl_mcs = static_cast<int>(below(29));
+                data.ulsch_err = static_cast<int>(below(100000));
+                data.ulsch_dtx = static_cast<int>(below(100000));
+                data.ul_mcs = static_cast<int>(below(29));
+                data.nprb = static_cast<int>(below(274));
+                std::string dl_bler = format("%.5f", static_cast<double>(below(100000)) / 1e5);
+                std::string ul_bler = format("%.5f", static_cast<double>(below(100000)) / 1e5);
+                std::string snr = format("%.1f", (static_cast<double>(below(600)) - 100) / 10);
+                data.dl_bler = std::strtod(dl_bler.c_str(), nullptr);
+                data.ul_bler = std::strtod(ul_bler.c_str(), nullptr);
+                data.snr = std::strtod(snr.c_str(), nullptr);
+                // Cumulative, some wider than the column OAI pads them to
+                mac_tx[ue] += below(ue == 3 ? uint64_t(1) << 50 : 100000);
+                mac_rx[ue] += below(1000000);
+                // Now and then a MAC line is missing: the record is stored without counters
+                bool mac_line = below(10) != 0;
+                bool wants_mac = columns & mac_line_columns;
+                data.mac_tx = mac_line && wants_mac ? mac_tx[ue] : 0;
+                data.mac_rx = mac_line && wants_mac ? mac_rx[ue] : 0;
+
+                std::string rnti = rnti_str(data.rnti);
+                parser.parse_line(format("UE RNTI %s CU-UE-ID %d %s PH %d dB PCMAX %d dBm, average RSRP %d (17 meas)",
+                                         rnti.c_str(), data.ue_id, state_name(data.state), data.ph, data.pcmax,
+                                         static_cast<int>(data.rsrp)));
+                parser.parse_line(format("UE %s: CQI %d, RI %d, PMI (0,0)", rnti.c_str(), data.cqi, data.dl_ri));
+                parser.parse_line(format("UE %s: UL-RI %d, TPMI 0", rnti.c_str(), data.ul_ri));
+                parser.parse_line(format("UE %s: dlsch_rounds 681/10/1/0, dlsch_errors %d, pucch0_DTX %d, BLER %s "
+                                         "MCS (1) %d", rnti.c_str(), data.dlsch_err, data.pucch_dtx, dl_bler.c_str(),
+                                         data.dl_mcs));
+                parser.parse_line(format("UE %s: ulsch_rounds 1136/77/0/0, ulsch_errors %d, ulsch_DTX %d, BLER %s "
+                                         "MCS (1) %d (Qm 4 deltaMCS 0 dB) NPRB %d  SNR %s dB", rnti.c_str(),
+                                         data.ulsch_err, data.ulsch_dtx, ul_bler.c_str(), data.ul_mcs, data.nprb,
+                                         snr.c_str()));
+                if (mac_line) {
+                    parser.parse_line(format("UE %s: MAC:    TX %14llu RX %14llu bytes", rnti.c_str(),
+                                             static_cast<unsigned long long>(mac_tx[ue]),
+                                             static_cast<unsigned long long>(mac_rx[ue])));
+                }
+                parser.parse_line(format("UE %s: LCID 1: TX            369 RX           1074 bytes", rnti.c_str()));
+                expected.push_back(data);
+            }
+        }
+        parser.finish();
+
+        CHECK(sink.rows.size() == expected.size());
+        // A record without its MAC line is stored when its UE's next one starts, so only the order
+        // within one UE is fixed
+        for (uint16_t rnti: rntis) {
+            std::vector<const UEData *> got, want;
+            for (const UEData &data: sink.rows) {
+                if (data.rnti == rnti) {
+                    got.push_back(&data);
+                }
+            }
+            for (const UEData &data: expected) {
+                if (data.rnti == rnti) {
+                    want.push_back(&data);
+                }
+            }
+            CHECK(got.size() == want.size());
+            for (size_t i = 0; i < std::min(got.size(), want.size()); i++) {
+                for (int c = 0; c < static_cast<int>(Column::Count); c++) {
+                    auto column = static_cast<Column>(c);
+                    if (column != Column::Timestamp && (columns & column_bit(column))) {
+                        CHECK(same_column(*got[i], *want[i], column));
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    test_words();
+    test_fuzz();
+    test_parser(default_columns);
+    test_parser(all_columns);
+    test_parser(column_bits(Column::Rnti, Column::Snr, Column::MacRx));
+    return test_result();
+}
@@ -0,0 +1,276 @@
+// --history: with the pool used up, the oldest blocks go first, whichever UE has them, and a query
+// has to answer with exactly the records still held of its UE, in order, copied across as many
+// holds of the lock as the chain needs; ranges and step= means are checked against those records
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "check.h"
+#include "records.h"
+#include "ue_history.h"
+
+
+namespace {
+    constexpr size_t pool_blocks = 48;
+    constexpr size_t column_count = UEHistory::metric_count + 2;
+
+    class NullSink : public RecordSink {
+    public:
+        void write(const UEData &) override {
+        }
+    };
+
+    class Connection {
+    private:
+        int fd = -1;
+
+    public:
+        explicit Connection(const std::string &path) {
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+            CHECK(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+        }
+
+        ~Connection() {
+            close(fd);
+        }
+
+        Connection(const Connection &) = delete;
+
+        Connection &operator=(const Connection &) = delete;
+
+        // The answer up to and including its closing empty line
+        std::string query(const std::string &line) {
+            std::string request = line + "\n";
+            CHECK(::write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+            std::string answer;
+            char buffer[65536];
+            while (!answer.ends_with("\n\n")) {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                if (n <= 0) {
+                    CHECK(!"connection closed before the end of the answer");
+                    break;
+                }
+                answer.append(buffer, n);
+            }
+            return answer;
+        }
+    };
+
+    std::string hex(uint16_t rnti) {
+        char text[8];
+        std::snprintf(text, sizeof(text), "%04x", rnti);
+        return text;
+    }
+
+    const char *column_name(size_t column) {
+        if (column < UEHistory::metric_count) {
+            return metric_info(static_cast<Metric>(column)).name;
+        }
+        return column == UEHistory::metric_count ? "mac_tx" : "mac_rx";
+    }
+
+    // In the order UEHistory::write stores them
+    double value_of(const UEData &data, size_t column) {
+        const float metrics[] = {float(data.dl_bler), float(data.ul_bler), float(data.snr), float(data.rsrp),
+                                 float(data.cqi), float(data.dl_mcs), float(data.ul_mcs)};
+        if (column < UEHistory::metric_count) {
+            return metrics[column];
+        }
+        return static_cast<double>(column == UEHistory::metric_count ? data.mac_tx : data.mac_rx);
+    }
+
+    // The times of an answer's rows, in Unix milliseconds
+    std::vector<int64_t> times_of(const std::string &answer) {
+        std::vector<int64_t> times;
+        size_t start = answer.find('\n') + 1;
+        while (start < answer.size() && answer[start] != '\n') {
+            char *end = nullptr;
+            long long seconds = std::strtoll(answer.c_str() + start, &end, 10);
+            long long ms = std::strtoll(end + 1, nullptr, 10);
+            times.push_back(seconds * 1000 + ms);
+            start = answer.find('\n', start) + 1;
+        }
+        return times;
+    }
+
+    std::string time_text(int64_t ms) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%lld.%03lld", static_cast<long long>(ms / 1000),
+                      static_cast<long long>(ms % 1000));
+        return text;
+    }
+
+    // What a query answers for records at times, each bucket of step_ms from base as one row
+    std::string expected_answer(const std::vector<UEData> &records, const std::vector<int64_t> &times,
+                                const std::vector<bool> &selected, int64_t step_ms = 0, int64_t base = 0) {
+        std::string out = "time";
+        for (size_t column = 0; column < column_count; column++) {
+            if (selected[column]) {
+                out += ',';
+                out += column_name(column);
+            }
+        }
+        out += '\n';
+        char number[32];
+        for (size_t i = 0; i < records.size();) {
+            size_t j = i + 1;
+            int64_t time = times[i];
+            if (step_ms > 0) {
+                time = base + (times[i] - base) / step_ms * step_ms;
+                while (j < records.size() && times[j] < time + step_ms) {
+                    j++;
+                }
+            }
+            out += time_text(time);
+            for (size_t column = 0; column < column_count; column++) {
+                if (!selected[column]) {
+                    continue;
+                }
+                if (column >= UEHistory::metric_count) {
+                    std::snprintf(number, sizeof(number), ",%.0f", value_of(records[j - 1], column));
+                } else {
+                    double sum = 0;
+                    for (size_t k = i; k < j; k++) {
+                        sum += value_of(records[k], column);
+                    }
+                    std::snprintf(number, sizeof(number), ",%.6g", sum / static_cast<double>(j - i));
+                }
+                out += number;
+            }
+            out += '\n';
+            i = j;
+        }
+        return out + "\n";
+    }
+
+    // The records held of a UE, from the list answer
+    uint64_t held_records(const std::string &list, uint16_t rnti) {
+        std::string prefix = "\n" + hex(rnti) + ",gnb,";
+        size_t at = list.find(prefix);
+        return at == std::string::npos ? 0 : std::strtoull(list.c_str() + at + prefix.size(), nullptr, 10);
+    }
+
+    void write_all(UEHistory &history, RecordGenerator &generator, size_t count, std::vector<UEData> *kept = nullptr) {
+        for (size_t i = 0; i < count; i++) {
+            const UEData &data = generator.next();
+            history.write(data);
+            if (kept) {
+                kept->push_back(data);
+            }
+        }
+    }
+
+    void test_eviction() {
+        TempDir dir;
+        std::string path = dir.file("history.sock");
+        NullSink sink;
+        UEHistory history(sink, "unix:" + path, {"gnb"}, pool_blocks * sizeof(UEHistory::Block));
+        CHECK(history.is_open());
+
+        // Every UE of the test on its own RNTI
+        std::set<uint16_t> rntis;
+        for (auto [seed, ues]: {std::pair(1, 1), std::pair(2, 8), std::pair(3, 1), std::pair(4, 4)}) {
+            RecordGenerator generator(seed, ues);
+            for (int i = 0; i < ues; i++) {
+                rntis.insert(generator.next().rnti);
+            }
+        }
+        CHECK(rntis.size() == 14);
+
+        // A fills two blocks, eight other UEs the whole pool: A is evicted first, entirely
+        RecordGenerator a(1, 1);
+        RecordGenerator fill(2, 8);
+        write_all(history, a, 100);
+        write_all(history, fill, 8 * 6 * UEHistory::block_records);
+
+        // B takes 24 blocks in bursts 15 ms apart, then four new UEs take 28 more: the 24 oldest
+        // blocks are the first eight UEs', the next 4 B's oldest
+        RecordGenerator b(3, 1);
+        std::vector<UEData> b_records;
+        for (int burst = 0; burst < 30; burst++) {
+            write_all(history, b, 50, &b_records);
+            std::this_thread::sleep_for(std::chrono::milliseconds(15));
+        }
+        RecordGenerator more(4, 4);
+        write_all(history, more, 4 * 7 * UEHistory::block_records);
+
+        uint16_t a_rnti = RecordGenerator(1, 1).next().rnti;
+        uint16_t b_rnti = b_records[0].rnti;
+
+        Connection connection(path);
+        std::string list = connection.query("list");
+        CHECK(list.starts_with("rnti,input,records,first,last\n"));
+        CHECK(held_records(list, a_rnti) == 0);
+        CHECK(connection.query("rnti=" + hex(a_rnti)).starts_with("error: "));
+        uint64_t held = held_records(list, b_rnti);
+        CHECK(held == b_records.size() - 4 * UEHistory::block_records);
+
+        // Everything still held of B: more blocks than one hold of the lock copies
+        std::vector<UEData> tail(b_records.end() - static_cast<long>(held), b_records.end());
+        std::string whole = connection.query("rnti=" + hex(b_rnti));
+        std::vector<int64_t> times = times_of(whole);
+        CHECK(times.size() == held);
+        if (times.size() != held) {
+            return;
+        }
+        CHECK(std::is_sorted(times.begin(), times.end()));
+        std::vector<bool> all(column_count, true);
+        CHECK(whole == expected_answer(tail, times, all));
+        CHECK(connection.query("rnti=" + hex(b_rnti) + " last=3600") == whole);
+
+        // A few columns, in the answer's column order whatever the request's
+        std::vector<bool> some(column_count, false);
+        some[static_cast<size_t>(Metric::Snr)] = some[static_cast<size_t>(Metric::DlBler)] = true;
+        some[UEHistory::metric_count + 1] = true;
+        std::string columns = std::string("mac_rx,") + column_name(static_cast<size_t>(Metric::Snr)) + "," +
+                              column_name(static_cast<size_t>(Metric::DlBler));
+        CHECK(connection.query("rnti=" + hex(b_rnti) + " columns=" + columns) == expected_answer(tail, times, some));
+
+        // Means of every 250 ms, from the first record
+        CHECK(connection.query("rnti=" + hex(b_rnti) + " step=0.25") ==
+              expected_answer(tail, times, all, 250, times[0]));
+
+        // A range inside what is held, alone and in steps from its start
+        std::string from = time_text(times[held / 4] - 5);
+        std::string to = time_text(times[held * 3 / 4] + 5);
+        auto from_ms = static_cast<int64_t>(std::strtod(from.c_str(), nullptr) * 1000);
+        auto to_ms = static_cast<int64_t>(std::strtod(to.c_str(), nullptr) * 1000);
+        std::vector<UEData> in_range;
+        std::vector<int64_t> range_times;
+        for (size_t i = 0; i < held; i++) {
+            if (times[i] >= from_ms && times[i] <= to_ms) {
+                in_range.push_back(tail[i]);
+                range_times.push_back(times[i]);
+            }
+        }
+        CHECK(!in_range.empty() && in_range.size() < held);
+        std::string range = "rnti=" + hex(b_rnti) + " from=" + from + " to=" + to;
+        CHECK(connection.query(range) == expected_answer(in_range, range_times, all));
+        CHECK(connection.query(range + " step=0.1 columns=" + columns) ==
+              expected_answer(in_range, range_times, some, 100, from_ms));
+
+        for (const char *bad: {"rnti=zz", "rnti=1 step=-1", "rnti=1 columns=nope", "last=60", "rnti=1 colour=red"}) {
+            std::string answer = connection.query(bad);
+            CHECK(answer.starts_with("error: ") && answer.ends_with("\n\n"));
+        }
+        history.finish();
+    }
+}
+
+int main() {
+    test_eviction();
+    return test_result();
+}
@@ -0,0 +1,495 @@
+// --format parquet written by ParquetOutput and read back by a minimal reader of what it writes:
+// the footer and page headers (thrift compact protocol), PLAIN and dictionary pages and the
+// RLE/bit-packed dictionary indices. Every column of every row has to come back as written.
+
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.h"
+#include "columns.h"
+#include "compression.h"
+#include "parquet_output.h"
+#include "records.h"
+
+
+namespace {
+    // parquet.thrift values the reader needs
+    enum Type { Int32 = 1, Int64 = 2, Double = 5, ByteArray = 6 };
+    enum Encoding { Plain = 0, RleDictionary = 8 };
+    enum PageType { DataPage = 0, DictionaryPage = 2 };
+    enum Codec { Uncompressed = 0, Zstd = 6 };
+
+    constexpr size_t row_group_rows = 65536; // ParquetOutput::row_group_rows
+
+    // Physical type and encoding of every data page read, to see that both INT32 encodings ran
+    std::set<std::pair<int, int>> pages_seen;
+
+    // A thrift value read without its IDL: integers, binaries, lists and structs (by field id)
+    struct Thrift {
+        int64_t integer = 0;
+        std::string binary;
+        std::vector<Thrift> list;
+        std::map<int16_t, Thrift> fields;
+
+        bool has(int16_t id) const {
+            return fields.count(id) != 0;
+        }
+
+        const Thrift &operator[](int16_t id) const {
+            static const Thrift missing;
+            auto field = fields.find(id);
+            return field == fields.end() ? missing : field->second;
+        }
+    };
+
+    class ThriftReader {
+    private:
+        const char *p;
+        const char *end;
+        bool failed = false;
+
+        uint8_t byte() {
+            if (p == end) {
+                failed = true;
+                return 0;
+            }
+            return static_cast<uint8_t>(*p++);
+        }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64 && !failed; shift += 7) {
+                uint8_t b = byte();
+                value |= uint64_t(b & 0x7f) << shift;
+                if (!(b & 0x80)) {
+                    break;
+                }
+            }
+            return value;
+        }
+
+        int64_t zigzag() {
+            uint64_t value = varint();
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        void value(uint8_t type, Thrift &out) {
+            switch (type) {
+                case 1: // boolean true, as a struct field
+                case 2: // false
+                    out.integer = type == 1;
+                    break;
+                case 3:
+                    out.integer = static_cast<int8_t>(byte());
+                    break;
+                case 4:
+                case 5:
+                case 6:
+                    out.integer = zigzag();
+                    break;
+                case 8: {
+                    uint64_t size = varint();
+                    if (size > static_cast<uint64_t>(end - p)) {
+                        failed = true;
+                        return;
+                    }
+                    out.binary.assign(p, size);
+                    p += size;
+                    break;
+                }
+                case 9: {
+                    uint8_t header = byte();
+                    uint64_t size = header >> 4 == 15 ? varint() : header >> 4;
+                    if (size > static_cast<uint64_t>(end - p)) {
+                        failed = true;
+                        return;
+                    }
+                    out.list.resize(size);
+                    for (Thrift &element: out.list) {
+                        value(header & 0x0f, element);
+                    }
+                    break;
+                }
+                case 12:
+                    read_struct(out);
+                    break;
+                default: // doubles, sets and maps are not in what ParquetOutput writes
+                    failed = true;
+            }
+        }
+
+        void read_struct(Thrift &out) {
+            int16_t last = 0;
+            while (!failed) {
+                uint8_t header = byte();
+                if (header == 0) {
+                    return;
+                }
+                auto id = static_cast<int16_t>(header >> 4 ? last + (header >> 4) : zigzag());
+                value(header & 0x0f, out.fields[id]);
+                last = id;
+            }
+        }
+
+    public:
+        ThriftReader(const char *begin, const char *stop) : p(begin), end(stop) {
+        }
+
+        bool read(Thrift &out) {
+            read_struct(out);
+            return !failed;
+        }
+
+        const char *position() const {
+            return p;
+        }
+    };
+
+    int expected_type(Column column) {
+        switch (column) {
+            case Column::Rnti:
+            case Column::State:
+            case Column::Source:
+                return ByteArray;
+            case Column::Timestamp:
+            case Column::MacTx:
+            case Column::MacRx:
+                return Int64;
+            default:
+                return column_type(column) == ColumnType::Real ? Double : Int32;
+        }
+    }
+
+    template<class T>
+    T load(const char *p) {
+        T value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    class ParquetReader {
+    private:
+        const std::string &file;
+        const std::vector<std::string> &sources;
+
+        // A page at offset: its header, and its body uncompressed
+        bool page(uint64_t offset, int codec, Thrift &header, std::string &body) const {
+            if (offset >= file.size()) {
+                return false;
+            }
+            ThriftReader reader(file.data() + offset, file.data() + file.size());
+            if (!reader.read(header)) {
+                return false;
+            }
+            const char *start = reader.position();
+            auto stored = static_cast<size_t>(header[3].integer);
+            if (stored > static_cast<size_t>(file.data() + file.size() - start)) {
+                return false;
+            }
+            if (codec == Zstd) {
+                if (!zstd_decompress(start, stored, body)) {
+                    return false;
+                }
+            } else {
+                body.assign(start, stored);
+            }
+            return body.size() == static_cast<size_t>(header[2].integer);
+        }
+
+        // A string column's text back to the value ParquetOutput took it from
+        bool string_integer(Column column, std::string_view text, int64_t &value) const {
+            if (column == Column::Rnti) {
+                char *stop = nullptr;
+                std::string digits(text);
+                value = static_cast<int64_t>(std::strtoul(digits.c_str(), &stop, 16));
+                return text.size() == 4 && *stop == '\0';
+            }
+            if (column == Column::State) {
+                for (UEState state: {UEState::Unknown, UEState::InSync, UEState::OutOfSync}) {
+                    if (text == state_name(state)) {
+                        value = static_cast<int64_t>(state);
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (size_t i = 0; i < sources.size(); i++) {
+                if (text == sources[i]) {
+                    value = static_cast<int64_t>(i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // RLE/bit-packed hybrid of count values, after the width byte
+        static bool hybrid(const std::string &body, size_t count, std::vector<uint32_t> &values) {
+            if (body.empty()) {
+                return false;
+            }
+            unsigned width = static_cast<uint8_t>(body[0]);
+            size_t at = 1;
+            auto read_varint = [&](uint64_t &value) {
+                value = 0;
+                for (unsigned shift = 0; at < body.size() && shift < 64; shift += 7) {
+                    auto b = static_cast<uint8_t>(body[at++]);
+                    value |= uint64_t(b & 0x7f) << shift;
+                    if (!(b & 0x80)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+            while (values.size() < count) {
+                uint64_t header;
+                if (!read_varint(header)) {
+                    return false;
+                }
+                if (header & 1) {
+                    // Each group of 8 values takes width bytes
+                    if (at + (header >> 1) * width > body.size()) {
+                        return false;
+                    }
+                    uint64_t bits = 0;
+                    unsigned held = 0;
+                    for (size_t i = 0; i < (header >> 1) * 8; i++) {
+                        while (held < width) {
+                            bits |= uint64_t(static_cast<uint8_t>(body[at++])) << held;
+                            held += 8;
+                        }
+                        values.push_back(static_cast<uint32_t>(bits & ((uint64_t(1) << width) - 1)));
+                        bits >>= width;
+                        held -= width;
+                    }
+                } else {
+                    unsigned bytes = (width + 7) / 8;
+                    if (at + bytes > body.size()) {
+                        return false;
+                    }
+                    uint32_t value = 0;
+                    for (unsigned byte = 0; byte < bytes; byte++) {
+                        value |= uint32_t(static_cast<uint8_t>(body[at++])) << 8 * byte;
+                    }
+                    values.insert(values.end(), header >> 1, value);
+                }
+            }
+            // Bit-packed groups are padded to 8 values: only the padding may follow
+            values.resize(count);
+            return at == body.size();
+        }
+
+    public:
+        ParquetReader(const std::string &contents, const std::vector<std::string> &source_names)
+            : file(contents), sources(source_names) {
+        }
+
+        // Fills column of rows[first, first + count) from one column chunk
+        bool chunk(const Thrift &meta, Column column, std::vector<UEData> &rows, size_t first, size_t count) const {
+            int type = static_cast<int>(meta[1].integer);
+            auto codec = static_cast<int>(meta[4].integer);
+            if (type != expected_type(column) || static_cast<size_t>(meta[5].integer) != count) {
+                return false;
+            }
+
+            std::vector<int64_t> dictionary;
+            Thrift header;
+            std::string body;
+            if (meta.has(11)) {
+                if (!page(meta[11].integer, codec, header, body) || header[1].integer != DictionaryPage) {
+                    return false;
+                }
+                auto size = static_cast<size_t>(header[7][1].integer);
+                size_t at = 0;
+                for (size_t i = 0; i < size; i++) {
+                    if (type == ByteArray) {
+                        if (at + 4 > body.size() || at + 4 + load<uint32_t>(&body[at]) > body.size()) {
+                            return false;
+                        }
+                        uint32_t length = load<uint32_t>(&body[at]);
+                        int64_t value;
+                        if (!string_integer(column, std::string_view(body).substr(at + 4, length), value)) {
+                            return false;
+                        }
+                        dictionary.push_back(value);
+                        at += 4 + length;
+                    } else {
+                        if (type != Int32 || at + 4 > body.size()) {
+                            return false;
+                        }
+                        dictionary.push_back(load<int32_t>(&body[at]));
+                        at += 4;
+                    }
+                }
+                if (at != body.size()) {
+                    return false;
+                }
+            }
+
+            if (!page(meta[9].integer, codec, header, body) || header[1].integer != DataPage ||
+                static_cast<size_t>(header[5][1].integer) != count) {
+                return false;
+            }
+            auto encoding = static_cast<int>(header[5][2].integer);
+            pages_seen.emplace(type, encoding);
+            if (encoding == RleDictionary) {
+                std::vector<uint32_t> indices;
+                if (dictionary.empty() || !hybrid(body, count, indices)) {
+                    return false;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    if (indices[i] >= dictionary.size()) {
+                        return false;
+                    }
+                    set_column_integer(rows[first + i], column, dictionary[indices[i]]);
+                }
+                return true;
+            }
+
+            size_t width = type == Int32 ? 4 : 8;
+            if (encoding != Plain || type == ByteArray || body.size() != count * width) {
+                return false;
+            }
+            for (size_t i = 0; i < count; i++) {
+                const char *value = body.data() + i * width;
+                if (type == Double) {
+                    set_column_real(rows[first + i], column, load<double>(value));
+                } else if (type == Int64) {
+                    int64_t integer = load<int64_t>(value);
+                    set_column_integer(rows[first + i], column, column == Column::Timestamp ? integer / 1000 : integer);
+                } else {
+                    set_column_integer(rows[first + i], column, load<int32_t>(value));
+                }
+            }
+            return true;
+        }
+
+        // Every row in the file; false when its layout is not what ParquetOutput writes
+        bool rows(ColumnMask columns, std::vector<UEData> &rows, size_t &groups) const {
+            if (file.size() < 12 || file.compare(0, 4, "PAR1") != 0 || file.compare(file.size() - 4, 4, "PAR1") != 0) {
+                return false;
+            }
+            uint32_t length = load<uint32_t>(file.data() + file.size() - 8);
+            if (length > file.size() - 12) {
+                return false;
+            }
+            const char *footer = file.data() + file.size() - 8 - length;
+            ThriftReader reader(footer, footer + length);
+            Thrift meta;
+            if (!reader.read(meta) || reader.position() != footer + length) {
+                return false;
+            }
+
+            std::vector<Column> order;
+            for (ColumnMask left = columns; left; left &= left - 1) {
+                order.push_back(static_cast<Column>(std::countr_zero(left)));
+            }
+            const std::vector<Thrift> &schema = meta[2].list;
+            if (schema.size() != order.size() + 1 || static_cast<size_t>(schema[0][5].integer) != order.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < order.size(); i++) {
+                if (schema[i + 1][4].binary != column_name(order[i]) ||
+                    schema[i + 1][1].integer != expected_type(order[i])) {
+                    return false;
+                }
+            }
+
+            rows.assign(static_cast<size_t>(meta[3].integer), UEData{});
+            groups = meta[4].list.size();
+            size_t first = 0;
+            for (const Thrift &group: meta[4].list) {
+                auto count = static_cast<size_t>(group[3].integer);
+                const std::vector<Thrift> &chunks = group[1].list;
+                if (first + count > rows.size() || chunks.size() != order.size()) {
+                    return false;
+                }
+                for (size_t c = 0; c < order.size(); c++) {
+                    const Thrift &chunk_meta = chunks[c][3];
+                    if (chunk_meta[3].list.size() != 1 || chunk_meta[3].list[0].binary != column_name(order[c]) ||
+                        !chunk(chunk_meta, order[c], rows, first, count)) {
+                        return false;
+                    }
+                }
+                first += count;
+            }
+            return first == rows.size();
+        }
+    };
+
+    bool same_rows(const std::vector<UEData> &got, const std::vector<UEData> &want, size_t count,
+                   ColumnMask columns) {
+        if (got.size() != count || want.size() < count) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (ColumnMask left = columns; left; left &= left - 1) {
+                if (!same_column(got[i], want[i], static_cast<Column>(std::countr_zero(left)))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void round_trip(ColumnMask selected, uint16_t source_count, size_t ue_count, size_t records, int page_level) {
+        TempDir dir;
+        std::string path = dir.file("rows.parquet");
+        std::vector<std::string> sources;
+        for (uint16_t i = 0; i < source_count; i++) {
+            sources.push_back("gnb" + std::to_string(i));
+        }
+        ColumnMask columns = selected | column_bit(Column::Rnti) | (source_count > 1 ? column_bit(Column::Source) : 0);
+
+        RecordGenerator generator(records + ue_count, ue_count, source_count);
+        std::vector<UEData> written;
+        std::vector<UEData> read;
+        size_t groups = 0;
+        {
+            ParquetOutput output(path, columns, sources, page_level);
+            CHECK(output.is_open());
+            // A file holds no rows until its first row group is full
+            std::string contents = read_file(path);
+            CHECK(ParquetReader(contents, sources).rows(columns, read, groups));
+            CHECK(read.empty() && groups == 0);
+            for (size_t i = 0; i < records; i++) {
+                written.push_back(generator.next());
+                output.write(written.back());
+                // While the output is open, the file holds every complete row group
+                if (i + 1 == row_group_rows + 10) {
+                    contents = read_file(path);
+                    CHECK(ParquetReader(contents, sources).rows(columns, read, groups));
+                    CHECK(groups == 1);
+                    CHECK(same_rows(read, written, row_group_rows, columns));
+                }
+            }
+            CHECK(output.error() == 0);
+        }
+
+        std::string contents = read_file(path);
+        CHECK(ParquetReader(contents, sources).rows(columns, read, groups));
+        CHECK(groups == (records + row_group_rows - 1) / row_group_rows);
+        CHECK(same_rows(read, written, records, columns));
+    }
+}
+
+int main() {
+    // Two row groups, the second partial, INT32 columns in both encodings
+    round_trip(default_columns, 1, 40, row_group_rows + 4000, 0);
+    round_trip(all_columns, 3, 300, 20000, 0);
+    round_trip(column_bits(Column::Timestamp, Column::Snr, Column::MacRx), 1, 5, 5000, 0);
+    // A single UE, state only: long runs of one dictionary index
+    round_trip(column_bits(Column::State), 1, 1, 3000, 0);
+    if (zstd_available()) {
+        round_trip(all_columns, 2, 100, row_group_rows + 100, 3);
+    }
+    CHECK(pages_seen.count({Int32, Plain}) && pages_seen.count({Int32, RleDictionary}));
+    CHECK(pages_seen.count({ByteArray, RleDictionary}) && pages_seen.count({Int64, Plain}));
+    return test_result();
+}
@@ -0,0 +1,102 @@
+// --format series written by SeriesOutput and read back by decode_series: every UE's rows have to
+// come back as the CSV of the records written, in order, whatever block they landed in
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "check.h"
+#include "columns.h"
+#include "records.h"
+#include "series_output.h"
+
+
+namespace {
+    using Rows = std::map<uint32_t, std::vector<std::string>>; // keyed by source << 16 | rnti
+
+    // decode_series into a string; empty when it reports damaged input
+    std::string decode(const std::string &input) {
+        char *text = nullptr;
+        size_t size = 0;
+        std::FILE *out = open_memstream(&text, &size);
+        bool ok = decode_series(input, out);
+        std::fclose(out);
+        std::string csv = ok ? std::string(text, size) : std::string();
+        std::free(text);
+        return csv;
+    }
+
+    void round_trip(ColumnMask selected, uint16_t source_count, size_t ue_count, int records) {
+        TempDir dir;
+        std::string path = dir.file("rows.series");
+        std::vector<std::string> sources;
+        for (uint16_t i = 0; i < source_count; i++) {
+            sources.push_back("gnb" + std::to_string(i));
+        }
+        ColumnMask columns = selected | column_bit(Column::Rnti) | (source_count > 1 ? column_bit(Column::Source) : 0);
+
+        // Blocks are written as they fill and the partial ones at close, so only the order of the
+        // rows of one UE is fixed: a row is matched to its UE by its text, which holds the RNTI
+        RecordGenerator generator(ue_count * 7 + source_count, ue_count, source_count);
+        RowFormatter formatter(sources);
+        Rows expected;
+        std::unordered_map<std::string, uint32_t> ue_of;
+        {
+            SeriesOutput output(path, columns, sources);
+            CHECK(output.is_open());
+            char row[max_row_size];
+            for (int i = 0; i < records; i++) {
+                const UEData &data = generator.next();
+                output.write(data);
+                uint32_t key = uint32_t(data.source) << 16 | data.rnti;
+                std::string line(row, formatter.format_row(data, columns, row));
+                ue_of.emplace(line, key);
+                expected[key].push_back(std::move(line));
+            }
+        }
+
+        std::string input = read_file(path);
+        std::string decoded = decode(input);
+        std::string header = csv_header(columns);
+        CHECK(decoded.compare(0, header.size(), header) == 0);
+        Rows got;
+        size_t unknown = 0;
+        for (size_t start = header.size(); start < decoded.size();) {
+            size_t end = decoded.find('\n', start);
+            end = end == std::string::npos ? decoded.size() : end + 1;
+            std::string line = decoded.substr(start, end - start);
+            auto ue = ue_of.find(line);
+            if (ue == ue_of.end()) {
+                unknown++;
+            } else {
+                got[ue->second].push_back(std::move(line));
+            }
+            start = end;
+        }
+        CHECK(unknown == 0);
+        CHECK(got.size() == expected.size());
+        CHECK(got == expected);
+
+        // A file cut short inside its last block is reported, not read past its end
+        for (size_t cut: {1, 5}) {
+            CHECK(decode(input.substr(0, input.size() - cut)).empty());
+        }
+    }
+}
+
+int main() {
+    // Rows are printed in local time: no DST gaps or repeats
+    setenv("TZ", "UTC", 1);
+    tzset();
+    // Under one block per UE, several full blocks and a partial one, and many UEs
+    round_trip(default_columns, 1, 40, 2000);
+    round_trip(default_columns, 1, 40, 20000);
+    round_trip(all_columns, 3, 300, 50000);
+    round_trip(column_bits(Column::Timestamp, Column::Snr, Column::MacRx), 1, 5, 5000);
+    round_trip(column_bits(Column::DlBler, Column::State), 2, 16, 3000);
+    return test_result();
+}
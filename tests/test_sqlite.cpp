@@ -0,0 +1,63 @@
+// --format sqlite: rows are committed within batch_interval of arriving, also when no further rows
+// follow, so another connection can read them while the output is still open
+
+#include <chrono>
+#include <sqlite3.h>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "columns.h"
+#include "records.h"
+#include "sqlite_output.h"
+
+
+namespace {
+    // Rows another connection sees, -1 when it cannot read the table
+    int64_t committed_rows(const std::string &path) {
+        sqlite3 *db = nullptr;
+        sqlite3_stmt *count = nullptr;
+        int64_t rows = -1;
+        if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK &&
+            sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM ue_metrics", -1, &count, nullptr) == SQLITE_OK &&
+            sqlite3_step(count) == SQLITE_ROW) {
+            rows = sqlite3_column_int64(count, 0);
+        }
+        sqlite3_finalize(count);
+        sqlite3_close(db);
+        return rows;
+    }
+
+    // Polls for the rows, giving up well after batch_interval
+    bool committed_soon(const std::string &path, int64_t rows) {
+        auto started = std::chrono::steady_clock::now();
+        while (committed_rows(path) != rows) {
+            if (std::chrono::steady_clock::now() - started > std::chrono::seconds(5)) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return true;
+    }
+
+    void test_idle_commit() {
+        TempDir dir;
+        std::string path = dir.file("rows.sqlite");
+        RecordGenerator generator(62, 10);
+        SqliteOutput output(path, default_columns, {"gnb"});
+        CHECK(output.is_open());
+        for (int i = 0; i < 100; i++) {
+            output.write(generator.next());
+        }
+        CHECK(committed_rows(path) == 0);
+        // Nothing else is written: the open transaction still has to end, and the next one too
+        CHECK(committed_soon(path, 100));
+        output.write(generator.next());
+        CHECK(committed_soon(path, 101));
+    }
+}
+
+int main() {
+    test_idle_commit();
+    return test_result();
+}
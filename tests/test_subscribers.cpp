@@ -0,0 +1,245 @@
+// --subscribe: each subscriber's stream has to --decode to the CSV of the records it asked for
+// (filtered, sampled, its columns only), a bad request has to be answered with an error, and a
+// subscriber that stops reading has to get a gap row for every record its ring could not take
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "check.h"
+#include "columns.h"
+#include "records.h"
+#include "subscribers.h"
+
+
+namespace {
+    const std::vector<std::string> sources = {"gnb0", "gnb1"};
+    constexpr ColumnMask parsed = default_columns;
+
+    class CountingSink : public RecordSink {
+    public:
+        std::atomic<uint64_t> records{0};
+
+        void write(const UEData &) override {
+            records++;
+        }
+    };
+
+    int connect_to(const std::string &path) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+        CHECK(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+        return fd;
+    }
+
+    void read_all(int fd, std::string &stream) {
+        char buffer[65536];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            stream.append(buffer, n);
+        }
+        close(fd);
+    }
+
+    // A connection that sent its request and is reading its stream: the first bytes (the stream
+    // header) only come once the hub has made it active, so records written after that reach it
+    struct Client {
+        int fd = -1;
+        std::string stream;
+        std::thread reader;
+
+        void start(const std::string &path, const std::string &request) {
+            fd = connect_to(path);
+            std::string line = request + "\n";
+            CHECK(::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()));
+            char first;
+            CHECK(read(fd, &first, 1) == 1);
+            stream.assign(1, first);
+        }
+
+        void read_rest() {
+            reader = std::thread(read_all, fd, std::ref(stream));
+        }
+    };
+
+    // The rows a subscriber should get: the same choice of records SubscriberHub::write makes
+    std::string expected_csv(const std::vector<UEData> &records, ColumnMask columns,
+                             const std::vector<uint16_t> &rntis, int ue_id, unsigned sample) {
+        RowFormatter formatter(sources);
+        std::string csv = csv_header(columns);
+        std::unordered_map<uint32_t, unsigned> counts;
+        char row[max_row_size];
+        for (const UEData &data: records) {
+            bool listed = rntis.empty() && ue_id == 0;
+            for (uint16_t rnti: rntis) {
+                listed = listed || data.rnti == rnti;
+            }
+            listed = listed || (ue_id != 0 && data.ue_id == ue_id);
+            if (listed && counts[uint32_t(data.source) << 16 | data.rnti]++ % sample == 0) {
+                csv.append(row, formatter.format_row(data, columns, row));
+            }
+        }
+        return csv;
+    }
+
+    std::string hex(uint16_t rnti) {
+        char text[8];
+        std::snprintf(text, sizeof(text), "%04x", rnti);
+        return text;
+    }
+
+    std::string decode_stream(const TempDir &dir, const std::string &name, const std::string &stream,
+                              std::string *messages = nullptr) {
+        std::string path = dir.file(name);
+        std::ofstream(path, std::ios::binary) << stream;
+        return decode_file(path, messages);
+    }
+
+    // Under a ring's worth of records: nothing may be dropped, every stream is exact
+    void test_requests() {
+        TempDir dir;
+        std::string path = dir.file("sub.sock");
+        CountingSink sink;
+        SubscriberHub hub(sink, "unix:" + path, parsed, sources, 16);
+        CHECK(hub.is_open());
+
+        RecordGenerator generator(71, 30, 2);
+        std::vector<UEData> records;
+        for (int i = 0; i < 4000; i++) {
+            records.push_back(generator.next());
+        }
+        uint16_t first = records[0].rnti;
+        uint16_t second = records[1].rnti;
+        ColumnMask keys = column_bits(Column::Rnti, Column::Source);
+
+        std::string requests[] = {
+            "",
+            "rnti=" + hex(first) + "," + hex(second),
+            "ue-id=7",
+            "columns=snr,dl_bler",
+            "sample=3",
+            "rnti=" + hex(first) + " columns=mac_tx,state sample=2",
+        };
+        Client clients[std::size(requests)];
+        for (size_t i = 0; i < std::size(requests); i++) {
+            clients[i].start(path, requests[i]);
+            clients[i].read_rest();
+        }
+        for (const UEData &data: records) {
+            hub.write(data);
+        }
+        hub.finish();
+        for (Client &client: clients) {
+            client.reader.join();
+        }
+        CHECK(sink.records == records.size());
+
+        CHECK(decode_stream(dir, "all.bin", clients[0].stream) ==
+              expected_csv(records, parsed | keys, {}, 0, 1));
+        CHECK(decode_stream(dir, "rnti.bin", clients[1].stream) ==
+              expected_csv(records, parsed | keys, {first, second}, 0, 1));
+        CHECK(decode_stream(dir, "ue_id.bin", clients[2].stream) ==
+              expected_csv(records, parsed | keys, {}, 7, 1));
+        CHECK(decode_stream(dir, "columns.bin", clients[3].stream) ==
+              expected_csv(records, column_bits(Column::Snr, Column::DlBler) | keys, {}, 0, 1));
+        CHECK(decode_stream(dir, "sample.bin", clients[4].stream) ==
+              expected_csv(records, parsed | keys, {}, 0, 3));
+        // A column that was not parsed is not sent
+        CHECK(decode_stream(dir, "mixed.bin", clients[5].stream) ==
+              expected_csv(records, (column_bits(Column::MacTx, Column::State) & parsed) | keys, {first}, 0, 2));
+    }
+
+    // Refused before any record is sent
+    void test_bad_requests() {
+        TempDir dir;
+        std::string path = dir.file("sub.sock");
+        CountingSink sink;
+        SubscriberHub hub(sink, "unix:" + path, parsed, sources, 16);
+        for (const char *request: {"sample=10x", "sample=-1", "sample=0", "sample=", "sample=99999999999",
+                                   "rnti=zz", "columns=nope", "colour=red"}) {
+            int fd = connect_to(path);
+            std::string line = std::string(request) + "\n";
+            CHECK(::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()));
+            std::string reply;
+            read_all(fd, reply);
+            CHECK(reply.starts_with("error: ") && reply.ends_with("\n"));
+        }
+        hub.write(RecordGenerator(1, 1).next());
+        hub.finish();
+        CHECK(sink.records == 1);
+    }
+
+    // A subscriber that does not read while far more than its ring is written: what it gets is
+    // the records in order with some missing, and the gap rows account for every missing one
+    void test_gaps() {
+        TempDir dir;
+        std::string path = dir.file("sub.sock");
+        CountingSink sink;
+        SubscriberHub hub(sink, "unix:" + path, parsed, sources, 16);
+
+        Client slow;
+        slow.start(path, "");
+        RecordGenerator generator(73, 50, 2);
+        std::vector<UEData> records;
+        for (int i = 0; i < 200000; i++) {
+            records.push_back(generator.next());
+            hub.write(records.back());
+        }
+        slow.read_rest();
+        hub.finish();
+        slow.reader.join();
+
+        std::string messages;
+        std::string decoded = decode_stream(dir, "slow.bin", slow.stream, &messages);
+        std::string expected = expected_csv(records, parsed | column_bits(Column::Rnti, Column::Source), {}, 0, 1);
+        const char *noted = "--decode: the stream dropped ";
+        size_t at = messages.find(noted);
+        CHECK(at != std::string::npos);
+        uint64_t gaps = at == std::string::npos ? 0 : std::strtoull(messages.c_str() + at + std::strlen(noted), nullptr, 10);
+        CHECK(gaps > 0);
+
+        // Every decoded row is the next matching row of what was written
+        std::string header = csv_header(parsed | column_bits(Column::Rnti, Column::Source));
+        CHECK(decoded.starts_with(header));
+        uint64_t rows = 0;
+        size_t from = header.size();
+        bool in_order = true;
+        for (size_t start = header.size(); start < decoded.size() && in_order;) {
+            size_t end = decoded.find('\n', start) + 1;
+            std::string_view line(decoded.data() + start, end - start);
+            size_t found = expected.find(line, from);
+            while (found != std::string::npos && expected[found - 1] != '\n') {
+                found = expected.find(line, found + 1);
+            }
+            in_order = found != std::string::npos;
+            from = found + line.size();
+            start = end;
+            rows++;
+        }
+        CHECK(in_order);
+        CHECK(rows + gaps == records.size());
+    }
+}
+
+int main() {
+    // Rows are printed in local time: no DST gaps or repeats
+    setenv("TZ", "UTC", 1);
+    tzset();
+    test_requests();
+    test_bad_requests();
+    test_gaps();
+    return test_result();
+}
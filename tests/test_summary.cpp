@@ -0,0 +1,223 @@
+// The --export summaries: merged summaries have to equal one summary over all the records, frames
+// have to survive encode_frame/decode_frame byte for byte, also when a socket splits them across
+// reads, and a damaged frame has to be refused without merging any of it
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "columns.h"
+#include "records.h"
+#include "summary.h"
+
+
+namespace {
+    constexpr ColumnMask summary_columns = default_columns | mac_line_columns;
+    constexpr double quantiles[] = {0, 0.01, 0.1, 0.5, 0.9, 0.99, 1};
+
+    std::mt19937_64 rng(58);
+
+    size_t below(size_t n) {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    }
+
+    // Sums may differ in the last bits with the order values were added in, nothing else may
+    bool same_summary(const CellSummary &a, const CellSummary &b) {
+        if (a.records != b.records || a.top_dl.top() != b.top_dl.top()) {
+            return false;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(Metric::Count); i++) {
+            const MetricInfo &info = metric_info(static_cast<Metric>(i));
+            const Histogram &x = a.metrics[i];
+            const Histogram &y = b.metrics[i];
+            if (x.count() != y.count() || std::abs(x.mean() - y.mean()) > 1e-9 * (1 + std::abs(x.mean()))) {
+                return false;
+            }
+            for (double q: quantiles) {
+                if (x.quantile(q, info) != y.quantile(q, info)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Whatever the order of the parts, merging them gives the summary of all the records
+    void test_merge() {
+        RecordGenerator generator(11, 60);
+        std::vector<UEData> records;
+        for (int i = 0; i < 20000; i++) {
+            records.push_back(generator.next());
+        }
+        CellSummary whole;
+        for (const UEData &data: records) {
+            whole.add(data, summary_columns);
+        }
+
+        for (size_t parts: {2, 3, 17}) {
+            std::vector<CellSummary> summaries(parts);
+            for (const UEData &data: records) {
+                summaries[below(parts)].add(data, summary_columns);
+            }
+            CellSummary merged;
+            for (const CellSummary &summary: summaries) {
+                merged.merge(summary);
+            }
+            CHECK(same_summary(merged, whole));
+
+            // The same through frames, as the aggregator merges what parsers send
+            std::map<std::string, CellSummary> window;
+            for (const CellSummary &summary: summaries) {
+                std::string frame = encode_frame({{"cell", summary}});
+                CHECK(decode_frame(frame.data(), frame.size(), window) == static_cast<ptrdiff_t>(frame.size()));
+            }
+            CHECK(window.size() == 1 && same_summary(window["cell"], whole));
+        }
+        // An empty summary merges as nothing
+        CellSummary merged = whole;
+        merged.merge(CellSummary());
+        CHECK(same_summary(merged, whole));
+    }
+
+    // Quantiles are accurate to one bin width
+    void test_quantiles() {
+        for (size_t m = 0; m < static_cast<size_t>(Metric::Count); m++) {
+            auto metric = static_cast<Metric>(m);
+            const MetricInfo &info = metric_info(metric);
+            Histogram histogram(metric);
+            std::vector<double> values;
+            for (int i = 0; i < 5000; i++) {
+                double value = std::uniform_real_distribution<double>(info.low, info.high)(rng);
+                values.push_back(value);
+                histogram.add(value, info);
+            }
+            std::sort(values.begin(), values.end());
+            double width = (info.high - info.low) / info.bins;
+            for (double q: {0.1, 0.5, 0.9, 0.99}) {
+                double exact = values[static_cast<size_t>(q * (values.size() - 1))];
+                CHECK(std::abs(histogram.quantile(q, info) - exact) <= width);
+            }
+            CHECK(histogram.quantile(0, info) >= values.front() && histogram.quantile(1, info) == values.back());
+        }
+    }
+
+    // TopK keeps each UE's largest counter, and merging keeps the larger of the two
+    void test_top() {
+        std::map<uint16_t, uint64_t> largest;
+        TopK a, b;
+        for (int i = 0; i < 3000; i++) {
+            auto rnti = static_cast<uint16_t>(below(40));
+            uint64_t value = below(1000000);
+            (below(2) ? a : b).add(rnti, value);
+            largest[rnti] = std::max(largest[rnti], value);
+        }
+        std::vector<std::pair<uint16_t, uint64_t>> expected(largest.begin(), largest.end());
+        std::sort(expected.begin(), expected.end(), [](const auto &x, const auto &y) {
+            return x.second != y.second ? x.second > y.second : x.first < y.first;
+        });
+        expected.resize(TopK::k);
+        a.merge(b);
+        CHECK(a.top() == expected);
+    }
+
+    std::map<std::string, CellSummary> sample_cells(uint64_t seed) {
+        RecordGenerator generator(seed, 20, 3);
+        std::map<std::string, CellSummary> cells;
+        for (int i = 0; i < 3000; i++) {
+            const UEData &data = generator.next();
+            cells["gnb/" + std::to_string(data.source)].add(data, summary_columns);
+        }
+        return cells;
+    }
+
+    // A decoded frame encodes back to the same bytes
+    void test_round_trip() {
+        std::map<std::string, CellSummary> cells = sample_cells(1);
+        std::string frame = encode_frame(cells);
+        std::map<std::string, CellSummary> decoded;
+        CHECK(decode_frame(frame.data(), frame.size(), decoded) == static_cast<ptrdiff_t>(frame.size()));
+        CHECK(encode_frame(decoded) == frame);
+
+        std::string empty = encode_frame({});
+        CHECK(decode_frame(empty.data(), empty.size(), decoded) == static_cast<ptrdiff_t>(empty.size()));
+    }
+
+    void test_damaged() {
+        std::string frame = encode_frame(sample_cells(2));
+        std::map<std::string, CellSummary> cells = sample_cells(3);
+        std::string before = encode_frame(cells);
+
+        // Incomplete: wait for more
+        for (size_t size = 0; size < frame.size(); size += 1 + below(50)) {
+            CHECK(decode_frame(frame.data(), size, cells) == 0);
+        }
+        // Not a frame
+        std::string bad = frame;
+        bad[0] ^= 1;
+        CHECK(decode_frame(bad.data(), bad.size(), cells) == -1);
+        // A payload shorter than its cells
+        bad = frame;
+        uint32_t payload = frame.size() - 9;
+        std::memcpy(bad.data() + 4, &payload, sizeof(payload));
+        CHECK(decode_frame(bad.data(), bad.size(), cells) == -1);
+        // More cells than the payload holds
+        bad = frame;
+        bad[8] = static_cast<char>(0xff);
+        CHECK(decode_frame(bad.data(), bad.size(), cells) == -1);
+        // Nothing of a refused frame was merged
+        CHECK(encode_frame(cells) == before);
+    }
+
+    // Frames written to a socket in arbitrary pieces, read back as the aggregator does
+    void test_split_reads() {
+        std::string stream;
+        std::map<std::string, CellSummary> expected;
+        for (uint64_t seed = 10; seed < 20; seed++) {
+            std::string frame = encode_frame(sample_cells(seed));
+            CHECK(decode_frame(frame.data(), frame.size(), expected) > 0);
+            stream += frame;
+        }
+
+        int fds[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+        std::map<std::string, CellSummary> window;
+        std::string buffer;
+        size_t frames = 0;
+        for (size_t sent = 0; sent < stream.size();) {
+            size_t piece = std::min(stream.size() - sent, 1 + below(700));
+            CHECK(write(fds[0], stream.data() + sent, piece) == static_cast<ssize_t>(piece));
+            sent += piece;
+            char data[1024];
+            ssize_t got = read(fds[1], data, sizeof(data));
+            CHECK(got > 0);
+            buffer.append(data, std::max<ssize_t>(got, 0));
+            ptrdiff_t used;
+            while ((used = decode_frame(buffer.data(), buffer.size(), window)) > 0) {
+                buffer.erase(0, used);
+                frames++;
+            }
+            CHECK(used == 0);
+        }
+        close(fds[0]);
+        close(fds[1]);
+        CHECK(frames == 10 && buffer.empty());
+        CHECK(encode_frame(window) == encode_frame(expected));
+    }
+}
+
+int main() {
+    test_merge();
+    test_quantiles();
+    test_top();
+    test_round_trip();
+    test_damaged();
+    test_split_reads();
+    return test_result();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+
+enum class UEState : uint8_t {
+    Unknown,
+    InSync,
+    OutOfSync
+};
+
+inline const char *state_name(UEState state) {
+    switch (state) {
+        case UEState::InSync: return "in-sync";
+        case UEState::OutOfSync: return "out-of-sync";
+        default: return "";
+    }
+}
+
+// RNTIs are printed by OAI as 4 lowercase hex digits
+inline std::string rnti_str(uint16_t rnti) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%04x", rnti);
+    return buf;
+}
+
+struct UEData {
+    uint16_t rnti; // UE ID
+    uint16_t source; // Input the record was parsed from (index into the --input list)
+    UEState state; // In-sync or Out-of-sync
+    double rsrp; // Reference Signals Received Power (DOWNLINK)
+    int pcmax; // Maximum UL Channel Transmit Power (dBm)
+    int ue_id; // User Equipment ID
+    int ph; // Power Headroom
+    int cqi; // Channel Quality Index
+    int dl_ri; // Downlink Rank Indicator
+    int ul_ri; // Uplink Rank Indicator
+    int dlsch_err; // Downlink Scheduling Errors
+    int pucch_dtx; // PUCCH Discontinuous Transmission
+    double dl_bler; // Downlink Block Error Rate
+    int dl_mcs; // Downlink MCS
+    int ulsch_err; // Uplink Scheduling Errors
+    int ulsch_dtx; // Uplink Scheduling Discontinuous Transmissions
+    double ul_bler; // Uplink Block Error Rate
+    int ul_mcs; // Uplink MCS
+    int nprb; // Number of PRB
+    double snr; // Signal to Noise
+    uint64_t mac_tx; // MAC TX bytes (cumulative, from the previous stats period)
+    uint64_t mac_rx; // MAC RX bytes (cumulative, from the previous stats period)
+    time_t timestamp; // Timestamp
+};
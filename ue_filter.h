@@ -0,0 +1,85 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "swar.h"
+
+
+// Per-UE line filter for --rnti / --ue-id. Checked right after a line's RNTI is decoded, so lines of
+// other UEs cost one bit test. CU-UE-IDs only appear on the "UE RNTI" line that opens each UE's
+// block; that line (re)binds the RNTI, which also follows a UE across RNTI changes.
+class UEFilter {
+private:
+    std::bitset<65536> listed_rntis;
+    std::bitset<65536> accepted_rntis;
+    std::vector<uint64_t> ue_ids;
+    bool active = false;
+
+public:
+    bool enabled() const {
+        return active;
+    }
+
+    // A UE passes if its RNTI or its CU-UE-ID is listed
+    bool accepts(uint16_t rnti) const {
+        return !active || accepted_rntis.test(rnti);
+    }
+
+    bool by_ue_id() const {
+        return !ue_ids.empty();
+    }
+
+    void bind(uint16_t rnti, uint64_t ue_id) {
+        bool listed = listed_rntis.test(rnti);
+        for (uint64_t id: ue_ids) {
+            listed = listed || id == ue_id;
+        }
+        accepted_rntis.set(rnti, listed);
+    }
+
+    // "928c,6542"; on failure returns false with the offending entry in error
+    bool add_rntis(std::string_view list, std::string &error) {
+        return add_list(list, error, [&](const char *p, const char *end) {
+            uint16_t rnti;
+            if (swar::parse_hex16(p, end, rnti) != end) {
+                return false;
+            }
+            listed_rntis.set(rnti);
+            accepted_rntis.set(rnti);
+            return true;
+        });
+    }
+
+    bool add_ue_ids(std::string_view list, std::string &error) {
+        return add_list(list, error, [&](const char *p, const char *end) {
+            uint64_t id;
+            if (swar::parse_uint(p, end, id) != end) {
+                return false;
+            }
+            ue_ids.push_back(id);
+            return true;
+        });
+    }
+
+private:
+    template<class F>
+    bool add_list(std::string_view list, std::string &error, F &&add) {
+        while (true) {
+            size_t comma = list.find(',');
+            std::string_view entry = list.substr(0, comma);
+            if (entry.empty() || !add(entry.data(), entry.data() + entry.size())) {
+                error = entry.empty() ? "(empty entry)" : std::string(entry);
+                return false;
+            }
+            active = true;
+            if (comma == std::string_view::npos) {
+                return true;
+            }
+            list.remove_prefix(comma + 1);
+        }
+    }
+};
@@ -0,0 +1,479 @@
+#include "ue_history.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <tuple>
+#include <unistd.h>
+
+#include "endpoint.h"
+#include "placement.h"
+
+
+namespace {
+    // Columns of a query: the metrics, then the MAC counters
+    constexpr size_t column_count = UEHistory::metric_count + 2;
+    constexpr size_t max_line = 4096;
+
+    // Blocks a query copies per hold of the lock
+    constexpr size_t copy_blocks = 16;
+
+    // How long a client gets to take an answer
+    constexpr int send_timeout_ms = 1000;
+
+    const char *column_name(size_t column) {
+        if (column < UEHistory::metric_count) {
+            return metric_info(static_cast<Metric>(column)).name;
+        }
+        return column == UEHistory::metric_count ? "mac_tx" : "mac_rx";
+    }
+
+    int64_t wall_ms() {
+        timespec now{};
+        clock_gettime(CLOCK_REALTIME, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    }
+
+    bool parse_seconds(std::string_view text, double &value) {
+        std::string copy(text);
+        char *end = nullptr;
+        value = std::strtod(copy.c_str(), &end);
+        return !copy.empty() && *end == '\0' && std::isfinite(value);
+    }
+
+    void put_time(std::string &out, int64_t ms) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%lld.%03lld", static_cast<long long>(ms / 1000),
+                      static_cast<long long>(ms % 1000));
+        out += text;
+    }
+
+    // Blocking send of a whole answer on a non-blocking socket; false when the client is gone or stuck
+    bool send_all(int fd, const std::string &out) {
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t n = send(fd, out.data() + done, out.size() - done, MSG_NOSIGNAL);
+            if (n > 0) {
+                done += n;
+            } else if (n < 0 && errno == EAGAIN) {
+                pollfd writable{fd, POLLOUT, 0};
+                if (poll(&writable, 1, send_timeout_ms) <= 0) {
+                    return false;
+                }
+            } else if (n < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+UEHistory::UEHistory(RecordSink &next_sink, std::string endpoint_spec, std::vector<std::string> source_names,
+                     uint64_t budget)
+    : next(next_sink), endpoint(std::move(endpoint_spec)), sources(std::move(source_names)),
+      clock_start_ms(wall_ms()) {
+    block_count = std::min<uint64_t>(budget / sizeof(Block), std::numeric_limits<uint32_t>::max());
+    if (block_count == 0) {
+        std::cerr << "--history-budget holds no block of " << block_records << " records (" << sizeof(Block)
+                << " bytes)" << std::endl;
+        return;
+    }
+    std::string error;
+    listen_fd = listen_endpoint(endpoint, error);
+    if (listen_fd < 0) {
+        std::cerr << "--history: " << error << std::endl;
+        return;
+    }
+    pool = PageBuffer(block_count * sizeof(Block));
+    infos.resize(block_count);
+    for (size_t id = block_count; id-- > 0;) {
+        free_blocks.push_back(static_cast<uint32_t>(id));
+    }
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    server = std::thread(&UEHistory::run, this);
+}
+
+UEHistory::~UEHistory() {
+    finish();
+}
+
+uint32_t UEHistory::take_block(uint32_t owner) {
+    uint32_t id;
+    if (!free_blocks.empty()) {
+        id = free_blocks.back();
+        free_blocks.pop_back();
+    } else {
+        // The front of in_use is the front of its owner's chain
+        id = in_use.front();
+        in_use.pop_front();
+        evicted_blocks++;
+        auto victim = series.find(infos[id].owner);
+        victim->second.blocks.pop_front();
+        victim->second.evicted += infos[id].count;
+        if (victim->second.blocks.empty() && victim->first != owner) {
+            series.erase(victim);
+        }
+    }
+    infos[id] = BlockInfo{owner, 0};
+    in_use.push_back(id);
+    return id;
+}
+
+void UEHistory::write(const UEData &data) {
+    const float metrics[] = {float(data.dl_bler), float(data.ul_bler), float(data.snr), float(data.rsrp),
+                             float(data.cqi), float(data.dl_mcs), float(data.ul_mcs)};
+    static_assert(std::size(metrics) == metric_count);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        // Read under the lock, so the times of every chain are in order
+        int64_t now = now_ms();
+        uint32_t key = uint32_t(data.source) << 16 | data.rnti;
+        auto [entry, added] = series.try_emplace(key);
+        Series &ue = entry->second;
+        if (added) {
+            ue.generation = ++series_created;
+        }
+        if (ue.blocks.empty() || infos[ue.blocks.back()].count == block_records) {
+            uint32_t id = take_block(key);
+            ue.blocks.push_back(id);
+        }
+        uint32_t id = ue.blocks.back();
+        Block &target = block(id);
+        uint32_t i = infos[id].count++;
+        target.time_ms[i] = now;
+        for (size_t m = 0; m < metric_count; m++) {
+            target.metrics[m][i] = metrics[m];
+        }
+        target.mac_tx[i] = data.mac_tx;
+        target.mac_rx[i] = data.mac_rx;
+    }
+    next.write(data);
+}
+
+void UEHistory::run() {
+    place_thread(ThreadRole::Writer);
+    struct Client {
+        int fd;
+        std::string pending; // until its newline
+    };
+    std::vector<Client> clients;
+    std::vector<pollfd> polled;
+    while (true) {
+        polled.assign({{wake_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}});
+        for (const Client &client: clients) {
+            polled.push_back({client.fd, POLLIN, 0});
+        }
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            continue;
+        }
+        if (polled[0].revents) {
+            break;
+        }
+        if (polled[1].revents) {
+            int fd;
+            while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                clients.push_back({fd, {}});
+            }
+        }
+
+        // Clients that went away, sent too long a line or did not take their answer are closed
+        std::vector<bool> closing(clients.size());
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (!polled[i + 2].revents) {
+                continue;
+            }
+            Client &client = clients[i];
+            char buffer[4096];
+            ssize_t n = read(client.fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                closing[i] = n == 0 || errno != EAGAIN;
+                continue;
+            }
+            client.pending.append(buffer, n);
+            size_t newline;
+            while (!closing[i] && (newline = client.pending.find('\n')) != std::string::npos) {
+                std::string_view line(client.pending.data(), newline);
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                closing[i] = !send_all(client.fd, answer(line));
+                client.pending.erase(0, newline + 1);
+            }
+            closing[i] = closing[i] || client.pending.size() > max_line;
+        }
+        for (size_t i = clients.size(); i-- > 0;) {
+            if (closing[i]) {
+                close(clients[i].fd);
+                clients.erase(clients.begin() + static_cast<long>(i));
+            }
+        }
+    }
+    for (const Client &client: clients) {
+        close(client.fd);
+    }
+}
+
+std::string UEHistory::answer(std::string_view line) {
+    queries++;
+    if (line == "list") {
+        return list();
+    }
+
+    int rnti = -1;
+    int source = -1;
+    double last = -1;
+    double from = -std::numeric_limits<double>::infinity();
+    double to = std::numeric_limits<double>::infinity();
+    double step = 0;
+    bool selected[column_count];
+    std::fill(std::begin(selected), std::end(selected), true);
+    auto fail = [](const std::string &error) {
+        return "error: " + error + "\n\n";
+    };
+
+    for (size_t start = 0; start < line.size();) {
+        size_t space = line.find(' ', start);
+        std::string_view option = line.substr(start, space == std::string_view::npos ? line.npos : space - start);
+        start = space == std::string_view::npos ? line.size() : space + 1;
+        if (option.empty()) {
+            continue;
+        }
+        size_t equals = option.find('=');
+        std::string_view key = option.substr(0, equals);
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : option.substr(equals + 1);
+        if (key == "rnti") {
+            uint16_t parsed;
+            auto [end, code] = std::from_chars(value.data(), value.data() + value.size(), parsed, 16);
+            if (code != std::errc() || end != value.data() + value.size() || value.empty()) {
+                return fail("bad RNTI " + std::string(value));
+            }
+            rnti = parsed;
+        } else if (key == "input") {
+            auto found = std::find(sources.begin(), sources.end(), value);
+            if (found == sources.end()) {
+                return fail("unknown input " + std::string(value));
+            }
+            source = static_cast<int>(found - sources.begin());
+        } else if (key == "last" || key == "from" || key == "to" || key == "step") {
+            double seconds;
+            if (!parse_seconds(value, seconds) || seconds < 0) {
+                return fail("bad " + std::string(key) + " " + std::string(value));
+            }
+            (key == "last" ? last : key == "from" ? from : key == "to" ? to : step) = seconds;
+        } else if (key == "columns") {
+            std::fill(std::begin(selected), std::end(selected), false);
+            while (!value.empty()) {
+                size_t comma = value.find(',');
+                std::string_view name = value.substr(0, comma);
+                value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+                size_t column = 0;
+                while (column < column_count && name != column_name(column)) {
+                    column++;
+                }
+                if (column == column_count) {
+                    return fail("unknown column " + std::string(name));
+                }
+                selected[column] = true;
+            }
+        } else {
+            return fail("unknown option " + std::string(option) + " (list, or rnti=, input=, last=, from=, to=, "
+                        "step=, columns=)");
+        }
+    }
+    if (rnti < 0) {
+        return fail("a query needs rnti=, or is list");
+    }
+    double infinity = std::numeric_limits<double>::infinity();
+    int64_t from_ms = last >= 0 ? now_ms() - static_cast<int64_t>(last * 1000)
+                      : from == -infinity ? std::numeric_limits<int64_t>::min()
+                      : static_cast<int64_t>(from * 1000);
+    int64_t to_ms = to == infinity ? std::numeric_limits<int64_t>::max() : static_cast<int64_t>(to * 1000);
+
+    // Copy the range out column by column, copy_blocks at a time, then format without the lock. Between
+    // two holds blocks may be evicted or filled further: the copy goes on after the last record it took.
+    std::vector<int64_t> times;
+    std::vector<double> values[column_count];
+    uint64_t generation = 0;
+    uint64_t next_record = 0;
+    for (bool done = false; !done;) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto ue = series.end();
+        for (size_t s = 0; s < sources.size() && ue == series.end(); s++) {
+            if (source < 0 || static_cast<size_t>(source) == s) {
+                ue = series.find(uint32_t(s) << 16 | uint32_t(rnti));
+            }
+        }
+        if (ue == series.end() && !generation) {
+            return fail("no records of " + rnti_str(static_cast<uint16_t>(rnti)));
+        }
+        if (ue == series.end() || (generation && ue->second.generation != generation)) {
+            break; // every block of the UE was evicted meanwhile
+        }
+        const Series &chain = ue->second;
+        size_t index;
+        if (!generation) {
+            generation = chain.generation;
+            // The first block reaching from_ms; the chain is in time order
+            index = std::partition_point(chain.blocks.begin(), chain.blocks.end(), [&](uint32_t id) {
+                return block(id).time_ms[infos[id].count - 1] < from_ms;
+            }) - chain.blocks.begin();
+        } else {
+            index = next_record < chain.evicted ? 0 : (next_record - chain.evicted) / block_records;
+        }
+        for (size_t copied = 0; !done && copied < copy_blocks; copied++, index++) {
+            if (index >= chain.blocks.size()) {
+                done = true;
+                break;
+            }
+            uint32_t id = chain.blocks[index];
+            uint64_t base = chain.evicted + index * block_records;
+            const Block &held = block(id);
+            const int64_t *first = held.time_ms;
+            const int64_t *end = held.time_ms + infos[id].count;
+            if (*first > to_ms) {
+                done = true;
+                break;
+            }
+            size_t lo = std::lower_bound(first, end, from_ms) - first;
+            size_t hi = std::upper_bound(first, end, to_ms) - first;
+            lo = std::max<size_t>(lo, next_record > base ? next_record - base : 0);
+            next_record = base + infos[id].count;
+            if (lo >= hi) {
+                continue;
+            }
+            times.insert(times.end(), first + lo, first + hi);
+            for (size_t column = 0; column < column_count; column++) {
+                if (!selected[column]) {
+                    continue;
+                }
+                if (column < metric_count) {
+                    values[column].insert(values[column].end(), held.metrics[column] + lo, held.metrics[column] + hi);
+                } else {
+                    const uint64_t *counters = column == metric_count ? held.mac_tx : held.mac_rx;
+                    values[column].insert(values[column].end(), counters + lo, counters + hi);
+                }
+            }
+        }
+    }
+
+    std::string out = "time";
+    for (size_t column = 0; column < column_count; column++) {
+        if (selected[column]) {
+            out += ',';
+            out += column_name(column);
+        }
+    }
+    out += '\n';
+    char number[32];
+    auto put_row = [&](int64_t time, auto &&value_of) {
+        put_time(out, time);
+        for (size_t column = 0; column < column_count; column++) {
+            if (selected[column]) {
+                std::snprintf(number, sizeof(number), column < metric_count ? ",%.6g" : ",%.0f", value_of(column));
+                out += number;
+            }
+        }
+        out += '\n';
+    };
+
+    auto step_ms = static_cast<int64_t>(step * 1000);
+    if (step_ms <= 0) {
+        for (size_t i = 0; i < times.size(); i++) {
+            put_row(times[i], [&](size_t column) {
+                return values[column][i];
+            });
+        }
+    } else {
+        // Buckets of step_ms from the start of the range (or the first record), empty ones left out
+        int64_t base = from_ms != std::numeric_limits<int64_t>::min() ? from_ms : times.empty() ? 0 : times[0];
+        for (size_t i = 0; i < times.size();) {
+            int64_t bucket = base + (times[i] - base) / step_ms * step_ms;
+            size_t j = i;
+            while (j < times.size() && times[j] < bucket + step_ms) {
+                j++;
+            }
+            put_row(bucket, [&](size_t column) {
+                if (column >= metric_count) {
+                    return values[column][j - 1];
+                }
+                double sum = 0;
+                for (size_t k = i; k < j; k++) {
+                    sum += values[column][k];
+                }
+                return sum / static_cast<double>(j - i);
+            });
+            i = j;
+        }
+    }
+    return out + "\n";
+}
+
+std::string UEHistory::list() {
+    struct Held {
+        uint16_t source;
+        uint16_t rnti;
+        uint64_t records;
+        int64_t first;
+        int64_t last;
+    };
+    std::vector<Held> held;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &[key, ue]: series) {
+            if (ue.blocks.empty()) {
+                continue;
+            }
+            Held entry{static_cast<uint16_t>(key >> 16), static_cast<uint16_t>(key), 0,
+                       block(ue.blocks.front()).time_ms[0], 0};
+            for (uint32_t id: ue.blocks) {
+                entry.records += infos[id].count;
+            }
+            const BlockInfo &newest = infos[ue.blocks.back()];
+            entry.last = newest.count ? block(ue.blocks.back()).time_ms[newest.count - 1] : entry.first;
+            held.push_back(entry);
+        }
+    }
+    std::sort(held.begin(), held.end(), [](const Held &a, const Held &b) {
+        return std::tie(a.source, a.rnti) < std::tie(b.source, b.rnti);
+    });
+
+    std::string out = "rnti,input,records,first,last\n";
+    for (const Held &entry: held) {
+        out += rnti_str(entry.rnti) + ',' + (entry.source < sources.size() ? sources[entry.source] : "") + ',' +
+                std::to_string(entry.records) + ',';
+        put_time(out, entry.first);
+        out += ',';
+        put_time(out, entry.last);
+        out += '\n';
+    }
+    return out + "\n";
+}
+
+void UEHistory::finish() {
+    if (!server.joinable()) {
+        return;
+    }
+    uint64_t one = 1;
+    ::write(wake_fd, &one, sizeof(one));
+    server.join();
+    close(wake_fd);
+    close(listen_fd);
+    unlink_endpoint(endpoint);
+
+    uint64_t held = 0;
+    for (uint32_t id: in_use) {
+        held += infos[id].count;
+    }
+    std::cerr << "--history: " << series.size() << " UEs, " << held << " records in " << in_use.size() << " of "
+            << block_count << " blocks, " << evicted_blocks << " blocks evicted, " << queries << " queries"
+            << std::endl;
+}
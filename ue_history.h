@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "huge_pages.h"
+#include "record_sink.h"
+#include "summary.h"
+
+
+/* --history unix:<path>: the recent records of every UE, in memory, for local queries
+ *
+ * A pool of fixed-size blocks is allocated up front from the --history-budget. Each block holds
+ * block_records records of one UE as columns (structure of arrays): the times, then each metric,
+ * then the MAC counters. A query for one metric only touches that metric's array. A UE owns a
+ * chain of blocks, oldest first, and takes a new block when its newest one is full. With the pool
+ * used up, that block is the oldest one in use, taken from whichever UE has it. Blocks are handed
+ * out in time order, so this is always the front of one queue.
+ *
+ * A client connects, sends a query per line and gets the answer as CSV ending in an empty line
+ * (or "error: ...", then the empty line). Times are Unix seconds of when the record was parsed, kept
+ * on the monotonic clock from the wall time at startup, so a step of the system clock never reorders
+ * them. A range is copied out a few blocks at a time and the parsers get the lock in between.
+ *   list                                 rnti,input,records,first,last for every UE held
+ *   rnti=928c last=60                    the last 60 s of that UE, every metric and MAC counter
+ *   rnti=928c from=<t> to=<t> step=5 columns=snr,dl_bler
+ *                                        a range, as the mean of every 5 s (MAC counters: the last)
+ * input=<name> picks the input when several have the same RNTI.
+ */
+class UEHistory : public RecordSink {
+public:
+    static constexpr size_t block_records = 64;
+    static constexpr size_t metric_count = static_cast<size_t>(Metric::Count);
+
+    struct Block {
+        int64_t time_ms[block_records];
+        float metrics[metric_count][block_records];
+        uint64_t mac_tx[block_records];
+        uint64_t mac_rx[block_records];
+    };
+
+private:
+    struct BlockInfo {
+        uint32_t owner; // source << 16 | rnti
+        uint32_t count;
+    };
+
+    struct Series {
+        std::deque<uint32_t> blocks; // oldest first; all but the newest are full
+        uint64_t evicted = 0; // records, so a record's number is evicted + its place in the chain
+        uint64_t generation = 0; // tells a UE held again apart from the one a query started on
+    };
+
+    RecordSink &next;
+    std::string endpoint;
+    std::vector<std::string> sources;
+
+    std::mutex lock; // parsers against queries
+    PageBuffer pool;
+    size_t block_count = 0;
+    std::vector<BlockInfo> infos;
+    std::vector<uint32_t> free_blocks;
+    std::deque<uint32_t> in_use; // in the order they were handed out
+    std::unordered_map<uint32_t, Series> series;
+    uint64_t series_created = 0;
+    uint64_t evicted_blocks = 0;
+    std::chrono::steady_clock::time_point clock_start = std::chrono::steady_clock::now();
+    int64_t clock_start_ms; // Unix milliseconds at clock_start
+
+    int listen_fd = -1;
+    int wake_fd = -1;
+    uint64_t queries = 0;
+    std::thread server;
+
+    Block &block(uint32_t id) {
+        return reinterpret_cast<Block *>(pool.data())[id];
+    }
+
+    // Unix milliseconds, never going back
+    int64_t now_ms() const {
+        return clock_start_ms + std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - clock_start).count();
+    }
+
+    // A free block for owner, evicting the oldest one when there is none
+    uint32_t take_block(uint32_t owner);
+
+    void run();
+
+    // The answer to one query line, including the closing empty line
+    std::string answer(std::string_view line);
+
+    std::string list();
+
+public:
+    UEHistory(RecordSink &next_sink, std::string endpoint_spec, std::vector<std::string> source_names,
+              uint64_t budget);
+
+    ~UEHistory() override;
+
+    // False when the budget does not hold a block or the socket could not be set up (reported on stderr)
+    bool is_open() const {
+        return listen_fd >= 0;
+    }
+
+    void write(const UEData &data) override;
+
+    void finish();
+};
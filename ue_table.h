@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ue_data.h"
+
+
+// Dense RNTI -> UEData table. A 64 Ki entry slot index replaces the tree lookup of a std::map,
+// and erased slots are recycled, so a steady UE population never allocates.
+class UETable {
+private:
+    std::vector<uint16_t> slot_of = std::vector<uint16_t>(65536, 0); // slot + 1, 0 when absent
+    std::vector<UEData> slots;
+    std::vector<uint16_t> free_slots;
+
+public:
+    UEData *find(uint16_t rnti) {
+        uint16_t slot = slot_of[rnti];
+        return slot ? &slots[slot - 1] : nullptr;
+    }
+
+    // Value-initialised (all zero) when the RNTI is new; created tells which case it was
+    UEData &get_or_create(uint16_t rnti, bool &created) {
+        uint16_t slot = slot_of[rnti];
+        created = slot == 0;
+        if (created) {
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+                slots[slot - 1] = UEData();
+            } else {
+                slots.emplace_back();
+                slot = static_cast<uint16_t>(slots.size());
+            }
+            slot_of[rnti] = slot;
+        }
+        return slots[slot - 1];
+    }
+
+    void erase(uint16_t rnti) {
+        if (slot_of[rnti]) {
+            free_slots.push_back(slot_of[rnti]);
+            slot_of[rnti] = 0;
+        }
+    }
+
+    size_t size() const {
+        return slots.size() - free_slots.size();
+    }
+
+    template<class F>
+    void for_each(F &&visit) const {
+        for (uint32_t rnti = 0; rnti < slot_of.size(); rnti++) {
+            if (slot_of[rnti]) {
+                visit(slots[slot_of[rnti] - 1]);
+            }
+        }
+    }
+};
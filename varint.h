@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+// LEB128 varints and zigzag, for the compact binary output formats
+namespace varint {
+    inline uint64_t zigzag(int64_t v) {
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t v) {
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    inline void put(std::string &out, uint64_t v) {
+        while (v >= 0x80) {
+            out += static_cast<char>(v | 0x80);
+            v >>= 7;
+        }
+        out += static_cast<char>(v);
+    }
+
+    // Returns nullptr on truncated or overlong input
+    inline const char *get(const char *p, const char *end, uint64_t &v) {
+        v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            auto byte = static_cast<uint8_t>(*p++);
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+}